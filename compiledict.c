@@ -30,6 +30,7 @@
 #include "translate.h"
 
 int HashDictionary(const char *string);
+unsigned int BloomHash(const char *word, int wlen);
 
 static FILE *f_log = NULL;
 extern char *dir_dictionary;
@@ -764,6 +765,13 @@ static void compile_dictlist_start() {
 static void compile_dictlist_end(FILE *f_out) {
     int hash;
     int length;
+    int ix;
+    int n_words = 0;
+    int bloom_log2;
+    unsigned int bloom_mask;
+    unsigned int h;
+    unsigned int h2;
+    unsigned char *bloom;
     char *p;
 
     if (f_log != NULL) {
@@ -778,6 +786,9 @@ static void compile_dictlist_end(FILE *f_out) {
 #endif
     }
 
+    for (hash = 0; hash < N_HASH_DICT; hash++)
+        n_words += hash_counts[hash];
+
     for (hash = 0; hash < N_HASH_DICT; hash++) {
         p = hash_chains[hash];
         hash_counts[hash] = (int) ftell(f_out);
@@ -789,6 +800,32 @@ static void compile_dictlist_end(FILE *f_out) {
         }
         fputc(0, f_out);
     }
+
+    // Follow the word lists with a Bloom filter of the words, so that LookupDict2()
+    // can reject most unlisted words without searching their hash chain.
+    // bytes 0-3: "Blm1"  byte 4: log2 of the number of bits  bytes 5-: the bits
+    for (bloom_log2 = 6; (bloom_log2 < 24) && ((1 << bloom_log2) < (n_words * DICT_BLOOM_BITS)); bloom_log2++);
+    bloom_mask = (1 << bloom_log2) - 1;
+
+    if ((bloom = (unsigned char *) calloc((bloom_mask + 1) / 8, 1)) == NULL)
+        return;
+
+    for (hash = 0; hash < N_HASH_DICT; hash++) {
+        for (p = hash_chains[hash]; p != NULL; memcpy(&p, p, sizeof(char *))) {
+            // the key is the length byte and the word, as matched by LookupDict2()
+            h = BloomHash(p + sizeof(char *) + 2, p[sizeof(char *) + 1] & 0x7f);
+            h2 = (h >> 17) | (h << 15) | 1;
+            for (ix = 0; ix < DICT_BLOOM_K; ix++) {
+                bloom[(h & bloom_mask) >> 3] |= 1 << (h & 7);
+                h += h2;
+            }
+        }
+    }
+
+    fwrite("Blm1", 4, 1, f_out);
+    fputc(bloom_log2, f_out);
+    fwrite(bloom, (bloom_mask + 1) / 8, 1, f_out);
+    free(bloom);
 }
 
 
@@ -1850,6 +1887,7 @@ int CompileDictionary(
     fclose(f_out);
     fflush(f_log);
 
+    UnpinDictionary(dict_name);   // a preloaded copy is now out of date
     LoadDictionary(translator, dict_name, 0);
 
     return (error_count);
@@ -0,0 +1,362 @@
+/***************************************************************************
+ *   Copyright (C) 2005 to 2014 by Jonathan Duddington                     *
+ *   email: jonsd@users.sourceforge.net                                    *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 3 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, see:                                 *
+ *               <http://www.gnu.org/licenses/>.                           *
+ ***************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "speech.h"
+
+#ifdef PLATFORM_WINDOWS
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+#include "databundle.h"
+
+extern int Reverse4Bytes(int word);
+
+
+static unsigned char *bundle_data = NULL;
+static unsigned int bundle_length = 0;
+static BUNDLE_ENTRY *bundle_index = NULL;
+static int bundle_n_entries = 0;
+static int bundle_mapped = 0;    // 1 = the bundle is a file mapping, 0 = compiled into the library
+
+
+static int CheckBundle(void)
+{//=========================
+// Check the header and index of a newly mapped bundle
+	int ix;
+	unsigned int offset;
+	unsigned int length;
+	int *pw;
+
+	if(bundle_length < BUNDLE_HEADER)
+		return(-1);
+	if(memcmp(bundle_data, BUNDLE_MAGIC, 8) != 0)
+		return(-1);
+
+	pw = (int *)bundle_data;
+	if(Reverse4Bytes(pw[2]) != BUNDLE_VERSION)
+		return(-1);
+
+	bundle_n_entries = Reverse4Bytes(pw[3]);
+	bundle_index = (BUNDLE_ENTRY *)&bundle_data[BUNDLE_HEADER];
+
+	if((bundle_n_entries < 0) || ((BUNDLE_HEADER + bundle_n_entries * sizeof(BUNDLE_ENTRY)) > bundle_length))
+		return(-1);
+
+	for(ix=0; ix<bundle_n_entries; ix++)
+	{
+		offset = Reverse4Bytes(bundle_index[ix].offset);
+		length = Reverse4Bytes(bundle_index[ix].length);
+		if((offset > bundle_length) || (length > (bundle_length - offset)))
+			return(-1);
+		if(bundle_index[ix].name[N_BUNDLE_NAME-1] != 0)
+			return(-1);
+	}
+	return(0);
+}
+
+
+char *MapFile(const char *fname, unsigned int *length, int zero_terminated)
+{//=======================================================================
+// Map a file into memory, as a private copy-on-write mapping, so the data may be
+// modified in place (eg. byte reversals on big-endian machines).
+// zero_terminated: the data must be followed by a zero byte.  The rest of the last page
+//   provides that, unless the file fills it exactly.  Then NULL is returned, and the
+//   caller should read the file instead.
+// Returns NULL if the file can't be mapped.
+	unsigned int page_size;
+	char *data;
+
+#ifdef PLATFORM_WINDOWS
+	HANDLE f;
+	HANDLE mapping;
+	SYSTEM_INFO sys_info;
+
+	GetSystemInfo(&sys_info);
+	page_size = sys_info.dwPageSize;
+
+	f = CreateFileA(fname, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if(f == INVALID_HANDLE_VALUE)
+		return(NULL);
+
+	*length = GetFileSize(f, NULL);
+	if((*length == 0) || (*length == INVALID_FILE_SIZE) || (zero_terminated && ((*length % page_size) == 0)))
+	{
+		CloseHandle(f);
+		return(NULL);
+	}
+
+	mapping = CreateFileMappingA(f, NULL, PAGE_WRITECOPY, 0, 0, NULL);
+	CloseHandle(f);
+	if(mapping == NULL)
+		return(NULL);
+
+	// the view keeps the mapping open
+	data = (char *)MapViewOfFile(mapping, FILE_MAP_COPY, 0, 0, 0);
+	CloseHandle(mapping);
+	return(data);
+#else
+	int fd;
+	struct stat statbuf;
+	void *p;
+
+	page_size = sysconf(_SC_PAGESIZE);
+
+	if((fd = open(fname, O_RDONLY)) < 0)
+		return(NULL);
+
+	if((fstat(fd, &statbuf) != 0) || (statbuf.st_size <= 0) || (statbuf.st_size > 0x7fffffff) ||
+		(zero_terminated && ((statbuf.st_size % page_size) == 0)))
+	{
+		close(fd);
+		return(NULL);
+	}
+
+	*length = statbuf.st_size;
+	p = mmap(NULL, *length, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if(p == MAP_FAILED)
+		return(NULL);
+	data = (char *)p;
+	return(data);
+#endif
+}  //  end of MapFile
+
+
+void UnmapFile(char *data, unsigned int length)
+{//============================================
+#ifdef PLATFORM_WINDOWS
+	UnmapViewOfFile(data);
+#else
+	munmap(data, length);
+#endif
+}
+
+
+int OpenDataBundle(const char *fname)
+{//==================================
+// Map a bundle file into memory.  Returns 0 if the bundle is now in use.
+// A bundle stays mapped for the life of the process, since translators and the
+// phoneme data may point into it.  So keep one which is already in use.
+	if(bundle_data != NULL)
+		return(0);
+
+	if((bundle_data = (unsigned char *)MapFile(fname, &bundle_length, 0)) == NULL)
+		return(-1);
+	bundle_mapped = 1;
+
+	if(CheckBundle() != 0)
+	{
+		fprintf(stderr,"Bad data bundle: '%s'\n",fname);
+		CloseDataBundle();
+		return(-1);
+	}
+	return(0);
+}  //  end of OpenDataBundle
+
+
+int AttachDataBundle(const unsigned char *data, unsigned int length)
+{//=================================================================
+// Use a bundle which is already in memory, eg. one which was compiled into the library.
+// The data is used in place, it's not copied.
+	if(bundle_data != NULL)
+		return(0);
+
+	bundle_data = (unsigned char *)data;
+	bundle_length = length;
+	bundle_mapped = 0;
+
+	if(CheckBundle() != 0)
+	{
+		fprintf(stderr,"Bad data bundle\n");
+		CloseDataBundle();
+		return(-1);
+	}
+	return(0);
+}
+
+
+void CloseDataBundle(void)
+{//=======================
+	if((bundle_data != NULL) && bundle_mapped)
+		UnmapFile((char *)bundle_data, bundle_length);
+	bundle_data = NULL;
+	bundle_length = 0;
+	bundle_index = NULL;
+	bundle_n_entries = 0;
+	bundle_mapped = 0;
+}
+
+
+const char *BundleEntry(int ix, int *size)
+{//=======================================
+// Returns the name of entry 'ix', or NULL if there is no such entry.
+	if((ix < 0) || (ix >= bundle_n_entries))
+		return(NULL);
+
+	if(size != NULL)
+		*size = Reverse4Bytes(bundle_index[ix].length);
+	return(bundle_index[ix].name);
+}
+
+
+const char *BundleLookup(const char *name, int *size)
+{//==================================================
+// Find a file in the bundle.  'name' is relative to the espeak-data directory.
+// Returns a pointer to the file's data, or NULL if it's not in the bundle.
+	int lo, hi, mid;
+	int cmp;
+	int ix;
+	char name2[N_BUNDLE_NAME];
+
+	if(bundle_n_entries == 0)
+		return(NULL);
+
+	// bundle names always use '/' as the path separator
+	for(ix=0; ix < (N_BUNDLE_NAME-1); ix++)
+	{
+		if((name2[ix] = name[ix]) == 0)
+			break;
+		if(name2[ix] == PATHSEP)
+			name2[ix] = '/';
+	}
+	if(name[ix] != 0)
+		return(NULL);   // name is too long to be in the bundle
+	name2[ix] = 0;
+
+	lo = 0;
+	hi = bundle_n_entries - 1;
+	while(lo <= hi)
+	{
+		mid = (lo + hi) / 2;
+		if((cmp = strcmp(name2, bundle_index[mid].name)) == 0)
+		{
+			if(size != NULL)
+				*size = Reverse4Bytes(bundle_index[mid].length);
+			return((const char *)&bundle_data[Reverse4Bytes(bundle_index[mid].offset)]);
+		}
+		if(cmp < 0)
+			hi = mid - 1;
+		else
+			lo = mid + 1;
+	}
+	return(NULL);
+}  //  end of BundleLookup
+
+
+int InBundle(const void *ptr)
+{//==========================
+	return((bundle_data != NULL) && ((const unsigned char *)ptr >= bundle_data) && ((const unsigned char *)ptr < &bundle_data[bundle_length]));
+}
+
+
+void FreeData(void *ptr)
+{//=====================
+// Free data which was returned by a data loader, unless it's used in place from the bundle
+	if(!InBundle(ptr))
+		Free(ptr);
+}
+
+
+int DataFileLength(const char *name)
+{//=================================
+// As GetFileLength(), but 'name' is relative to the espeak-data directory,
+// and the bundle is checked first.
+	int ix;
+	int len;
+	int size;
+	const char *p;
+	char fname[sizeof(path_home)+100];
+
+	if(BundleLookup(name, &size) != NULL)
+		return(size);
+
+	if(bundle_n_entries > 0)
+	{
+		// is it a directory in the bundle?
+		len = strlen(name);
+		for(ix=0; (p = BundleEntry(ix, NULL)) != NULL; ix++)
+		{
+			if((memcmp(p, name, len) == 0) && (p[len] == '/'))
+				return(-2);
+		}
+	}
+
+	sprintf(fname,"%s%c%s",path_home,PATHSEP,name);
+	return(GetFileLength(fname));
+}
+
+
+int DataOpen(DATA_FILE *df, const char *name)
+{//==========================================
+// Open a data file for reading with DataGets().  'name' is relative to the espeak-data directory.
+// Returns 0 if the file was opened.
+	int size;
+	char fname[sizeof(path_home)+100];
+
+	df->f = NULL;
+	if((df->p = BundleLookup(name, &size)) != NULL)
+	{
+		df->end = df->p + size;
+		return(0);
+	}
+
+	sprintf(fname,"%s%c%s",path_home,PATHSEP,name);
+	if((df->f = fopen(fname,"r")) == NULL)
+		return(-1);
+	return(0);
+}
+
+
+char *DataGets(char *buf, int size, DATA_FILE *df)
+{//===============================================
+// As fgets(), for a file which was opened by DataOpen()
+	int ix;
+
+	if(df->f != NULL)
+		return(fgets(buf, size, df->f));
+
+	if((df->p == NULL) || (df->p >= df->end) || (size <= 0))
+		return(NULL);
+
+	for(ix=0; (ix < size-1) && (df->p < df->end); )
+	{
+		if((buf[ix++] = *df->p++) == '\n')
+			break;
+	}
+	buf[ix] = 0;
+	return(buf);
+}
+
+
+void DataClose(DATA_FILE *df)
+{//==========================
+	if(df->f != NULL)
+		fclose(df->f);
+	df->f = NULL;
+	df->p = NULL;
+}
@@ -0,0 +1,80 @@
+#ifndef DATABUNDLE_H
+#define DATABUNDLE_H
+
+/*
+A data bundle is a single file which holds the contents of the espeak-data
+directory, so that initialization needs only one open() and one mmap()
+rather than one file open per data file.
+
+Layout (all numbers are 4-byte little-endian):
+
+   bytes 0-7    magic "eSpkBndl"
+   bytes 8-11   version (BUNDLE_VERSION)
+   bytes 12-15  number of entries
+   bytes 16-    the index: one BUNDLE_ENTRY for each file, sorted by name
+
+Each file's data starts on a BUNDLE_ALIGN boundary, so it can be used in
+place from the mapped memory. Entry names are paths relative to the
+espeak-data directory, using '/' as the separator (eg. "voices/!v/m1").
+
+The bundle for <dir>/espeak-data is looked for in <dir>/espeak-data.bundle
+
+If the library is built with EMBED_DATA, a bundle which was compiled into it
+(espeak_data_bundle[], generated by "espeak_bundle -c") is used in place instead.
+*/
+
+#include <stdio.h>
+
+#define BUNDLE_MAGIC     "eSpkBndl"
+#define BUNDLE_VERSION   1
+#define BUNDLE_ALIGN     4096
+#define BUNDLE_HEADER    16
+#define N_BUNDLE_NAME    56
+
+#ifdef ARCH_BIG
+#define BUNDLE_CONST     // InitGroups() reverses bytes in place
+#else
+#define BUNDLE_CONST  const
+#endif
+
+#ifdef _MSC_VER
+#define BUNDLE_ALIGNED  __declspec(align(BUNDLE_ALIGN))
+#else
+#define BUNDLE_ALIGNED  __attribute__((aligned(BUNDLE_ALIGN)))
+#endif
+
+#ifdef EMBED_DATA
+extern const unsigned int espeak_data_bundle_length;
+extern BUNDLE_ALIGNED BUNDLE_CONST unsigned char espeak_data_bundle[];
+#endif
+
+typedef struct {
+	unsigned int offset;       // from the start of the bundle
+	unsigned int length;
+	char name[N_BUNDLE_NAME];  // zero terminated
+} BUNDLE_ENTRY;
+
+// A data file which is read either from the bundle or from the file system
+typedef struct {
+	FILE *f;
+	const char *p;
+	const char *end;
+} DATA_FILE;
+
+char *MapFile(const char *fname, unsigned int *length, int zero_terminated);
+void UnmapFile(char *data, unsigned int length);
+
+int OpenDataBundle(const char *fname);
+int AttachDataBundle(const unsigned char *data, unsigned int length);
+void CloseDataBundle(void);
+const char *BundleLookup(const char *name, int *size);
+const char *BundleEntry(int ix, int *size);
+int InBundle(const void *ptr);
+void FreeData(void *ptr);
+
+int DataFileLength(const char *name);
+int DataOpen(DATA_FILE *df, const char *name);
+char *DataGets(char *buf, int size, DATA_FILE *df);
+void DataClose(DATA_FILE *df);
+
+#endif // DATABUNDLE_H
@@ -0,0 +1,66 @@
+#ifndef DELIVERY_H
+#define DELIVERY_H
+
+/*
+Pass the sound and events of AUDIO_OUTPUT_RETRIEVAL mode to the SynthCallback function
+from a thread of its own, so that synthesis of the next buffers continues while the
+callback is working (for example, writing to a network connection).
+
+Scenario:
+
+- delivery_add is called by the synthesis for each buffer, instead of the callback.
+  The buffer and its events are copied into a queue of DELIVERY_QUEUE_LENGTH buffers.
+  If the queue is full, the synthesis waits (a stall) until the callback has taken one.
+
+- The delivery thread calls the callback with the entries of the queue, in order.
+
+- If the callback returns 1, the rest of the sound of that text is not given to it,
+  and the next delivery_add for the text returns 1, so that its synthesis stops.
+  The espeakEVENT_MSG_TERMINATED of the text is still given, also after espeak_Cancel.
+
+*/
+
+#include <time.h>
+#include "speak_lib.h"
+
+#define DELIVERY_QUEUE_LENGTH  16
+
+// Start the delivery thread.
+// First function to be called.
+void delivery_init();
+void delivery_set_callback(t_espeak_callback* cb);
+
+// A function which returns 0 when the synthesis is to be stopped (espeak_Cancel),
+// so that delivery_add doesn't wait for space in the queue.
+void delivery_set_callback_is_output_enabled(int (*cb)(void));
+
+// Queue a buffer of sound for the callback.  The numsamples and events parameters are as
+// for the callback, and n_bytes is the size of the sound.  wav may be NULL.
+// An espeakEVENT_MSG_TERMINATED is always queued.
+// Return: 1 if the callback has asked to stop this text, or the synthesis is to be stopped;
+//         0 otherwise.
+int delivery_add (short* wav, int numsamples, int n_bytes, espeak_EVENT* events);
+
+// Drop the buffers which have not been given to the callback, except those with an
+// espeakEVENT_MSG_TERMINATED, and wait until it has returned from the current one.
+void delivery_clear_all ();
+
+// Is the callback working, or are there buffers waiting for it?
+int delivery_is_busy ();
+
+// Wait until the callback has been given all the buffers, or until the_end
+// (NULL = no time limit).
+// Returns 0 if it has, or 1 if there are still some at the_end.
+int delivery_wait_idle (const struct timespec* the_end);
+
+// Supply the number of buffers in the queue, and the most there have been, the number of
+// times the synthesis has waited for space in the queue, and the mean and the largest
+// time (in microseconds) that it waited.
+void delivery_get_stats (unsigned int* depth, unsigned int* max_depth,
+                         unsigned int* stalls, int* stall_mean_us, int* stall_max_us);
+
+// Stop the delivery thread.
+// Last function to be called.
+void delivery_terminate();
+
+#endif
@@ -30,11 +30,22 @@
 #include "phoneme.h"
 #include "synthesize.h"
 #include "translate.h"
+#include "databundle.h"
 
 
 int dictionary_skipwords;
 char dictionary_name[40];
 
+// Dictionaries which are kept loaded by espeak_Preload(), shared by the translators which use them
+typedef struct {
+    char name[40];
+    int size;
+    Translator *tr;   // copy of the translator's indexes into the dictionary data
+} RESIDENT_DICT;
+
+static RESIDENT_DICT resident_dict[N_RESIDENT_DICT];
+static int n_resident_dict = 0;
+
 extern void print_dictionary_flags(
         unsigned int *flags,
         char *buf, int buf_len);
@@ -219,6 +230,84 @@ static void InitGroups(Translator *tr) {
 }
 
 
+static RESIDENT_DICT *LookupResidentDict(const char *name) {
+    int ix;
+
+    if (name[0] == 0)
+        return (NULL);
+
+    for (ix = 0; ix < n_resident_dict; ix++) {
+        if (strcmp(name, resident_dict[ix].name) == 0)
+            return (&resident_dict[ix]);
+    }
+    return (NULL);
+}
+
+
+static int IsResidentDict(const char *data) {
+    int ix;
+
+    for (ix = 0; ix < n_resident_dict; ix++) {
+        if (data == resident_dict[ix].tr->data_dictlist)
+            return (1);
+    }
+    return (0);
+}
+
+
+// Keep the translator's dictionary loaded, so that later LoadDictionary()
+// calls for the same dictionary don't read the file or set up its indexes again.
+// Returns the number of bytes which are held.
+int PinDictionary(Translator *tr) {
+    RESIDENT_DICT *rd;
+
+    if (tr->data_dictlist == NULL)
+        return (0);
+    if ((rd = LookupResidentDict(tr->dictionary_name)) != NULL)
+        return (rd->size);
+    if (n_resident_dict >= N_RESIDENT_DICT)
+        return (0);
+
+    rd = &resident_dict[n_resident_dict];
+    if ((rd->tr = (Translator *) Alloc(sizeof(Translator))) == NULL)
+        return (0);
+    memcpy(rd->tr, tr, sizeof(Translator));
+    strcpy(rd->name, tr->dictionary_name);
+    rd->size = tr->data_dictsize + sizeof(Translator);
+    n_resident_dict++;
+    return (rd->size);
+}
+
+
+void UnpinDictionary(const char *name) {
+    RESIDENT_DICT *rd;
+
+    if ((rd = LookupResidentDict(name)) == NULL)
+        return;
+
+    // Other translators may still be using the data, so keep it but don't
+    // offer it to LoadDictionary() again.
+    rd->name[0] = 0;
+    rd->size = 0;
+}
+
+
+const char *ResidentDictionary(int ix, int *size) {
+    if ((ix < 0) || (ix >= n_resident_dict))
+        return (NULL);
+    *size = resident_dict[ix].size;
+    return (resident_dict[ix].name);
+}
+
+
+// Free a translator's dictionary data, unless it is resident or is in the data bundle
+void ReleaseDictionary(Translator *tr) {
+    if ((tr->data_dictlist != NULL) && !IsResidentDict(tr->data_dictlist))
+        FreeData(tr->data_dictlist);
+    tr->data_dictlist = NULL;
+}
+
+
 int LoadDictionary(Translator *tr, const char *name,
                    int no_error) {
     int hash;
@@ -229,33 +318,61 @@ int LoadDictionary(Translator *tr, const char *name,
     unsigned int size;
     char fname[sizeof(path_home) + 20];
 
+    RESIDENT_DICT *rd;
+
     // currently loaded dictionary name
     strcpy(dictionary_name, name);
     strcpy(tr->dictionary_name, name);
 
+    ReleaseDictionary(tr);
+
+    if ((rd = LookupResidentDict(name)) != NULL) {
+        // preloaded, use its data and indexes
+        tr->data_dictlist = rd->tr->data_dictlist;
+        tr->data_dictsize = rd->tr->data_dictsize;
+        tr->data_dictrules = rd->tr->data_dictrules;
+        tr->langopts.replace_chars = rd->tr->langopts.replace_chars;
+        tr->n_groups2 = rd->tr->n_groups2;
+        memcpy(tr->dict_hashtab, rd->tr->dict_hashtab, sizeof(tr->dict_hashtab));
+        tr->dict_bloom = rd->tr->dict_bloom;
+        tr->dict_bloom_mask = rd->tr->dict_bloom_mask;
+        memcpy(tr->letterGroups, rd->tr->letterGroups, sizeof(tr->letterGroups));
+        memcpy(tr->groups1, rd->tr->groups1, sizeof(tr->groups1));
+        memcpy(tr->groups3, rd->tr->groups3, sizeof(tr->groups3));
+        memcpy(tr->groups2, rd->tr->groups2, sizeof(tr->groups2));
+        memcpy(tr->groups2_name, rd->tr->groups2_name, sizeof(tr->groups2_name));
+        memcpy(tr->groups2_count, rd->tr->groups2_count, sizeof(tr->groups2_count));
+        memcpy(tr->groups2_start, rd->tr->groups2_start, sizeof(tr->groups2_start));
+        return (0);
+    }
+
     // Load a pronunciation data file into memory
     // bytes 0-3:  offset to rules data
     // bytes 4-7:  number of hash table entries
-    sprintf(fname, "%s%c%s_dict", path_home, PATHSEP, name);
-    size = GetFileLength(fname);
-
-    if (tr->data_dictlist != NULL) {
-        Free(tr->data_dictlist);
-        tr->data_dictlist = NULL;
-    }
+    sprintf(fname, "%s_dict", name);
+    if ((p = (char *) BundleLookup(fname, &length)) != NULL) {
+        // use the dictionary in place from the mapped bundle
+        tr->data_dictlist = p;
+        size = length;
+    } else {
+        sprintf(fname, "%s%c%s_dict", path_home, PATHSEP, name);
+        size = GetFileLength(fname);
 
-    f = fopen(fname, "rb");
-    if ((f == NULL) || (size <= 0)) {
-        if (no_error == 0) {
-            fprintf(stderr, "Can't read dictionary file: '%s'\n", fname);
+        f = fopen(fname, "rb");
+        if ((f == NULL) || (size <= 0)) {
+            if (no_error == 0) {
+                fprintf(stderr, "Can't read dictionary file: '%s'\n", fname);
+            }
+            if (f != NULL)
+                fclose(f);
+            return (1);
         }
-        return (1);
-    }
-
-    tr->data_dictlist = Alloc(size);
-    size = fread(tr->data_dictlist, 1, size, f);
-    fclose(f);
 
+        tr->data_dictlist = Alloc(size);
+        size = fread(tr->data_dictlist, 1, size, f);
+        fclose(f);
+    }
+    tr->data_dictsize = size;
 
     pw = (int *) (tr->data_dictlist);
     length = Reverse4Bytes(pw[1]);
@@ -287,6 +404,14 @@ int LoadDictionary(Translator *tr, const char *name,
         p++;   // skip over the zero which terminates the list for this hash value
     }
 
+    // a Bloom filter of the words may follow the hash chains (see compile_dictlist_end)
+    tr->dict_bloom = NULL;
+    if (((tr->data_dictrules - p) > 5) && (memcmp(p, "Blm1", 4) == 0) && (p[4] >= 6) && (p[4] < 24) &&
+        ((tr->data_dictrules - p) == (5 + (1 << p[4]) / 8))) {
+        tr->dict_bloom = (unsigned char *) &p[5];
+        tr->dict_bloom_mask = (1 << p[4]) - 1;
+    }
+
     if ((tr->dict_min_size > 0) &&
         (size < (unsigned int) tr->dict_min_size)) {
         fprintf(stderr, "Full dictionary is not installed for '%s'\n", name);
@@ -296,6 +421,39 @@ int LoadDictionary(Translator *tr, const char *name,
 }
 
 
+/* Generate the hash for the dictionary's Bloom filter, from the
+   word's length byte and its characters, as they are stored in the _dict file.
+*/
+unsigned int BloomHash(const char *word, int wlen) {
+    int ix;
+    unsigned int hash = 2166136261u;   // FNV-1a
+
+    hash = (hash ^ (wlen & 0x7f)) * 16777619;
+    for (ix = 0; ix < (wlen & 0x3f); ix++)
+        hash = (hash ^ (word[ix] & 0xff)) * 16777619;
+    return (hash);
+}
+
+
+static int InBloomFilter(Translator *tr, const char *word, int wlen) {
+    int ix;
+    unsigned int h;
+    unsigned int h2;
+
+    if (tr->dict_bloom == NULL)
+        return (1);   // no filter, the word may be present
+
+    h = BloomHash(word, wlen);
+    h2 = (h >> 17) | (h << 15) | 1;
+    for (ix = 0; ix < DICT_BLOOM_K; ix++) {
+        if ((tr->dict_bloom[(h & tr->dict_bloom_mask) >> 3] & (1 << (h & 7))) == 0)
+            return (0);
+        h += h2;
+    }
+    return (1);
+}
+
+
 /* Generate a hash code from the specified string
 	This is used to access the dictionary_2 word-lookup dictionary
 */
@@ -331,13 +489,10 @@ int HashDictionary(const char *string) {
 const char *EncodePhonemes(
         const char *p, char *outptr,
         int *bad_phoneme) {
-    int ix;
     unsigned char c;
-    int count;    /* num. of matching characters */
-    int max;      /* highest num. of matching found so far */
+    int max;      /* num. of matching characters */
     int max_ph;   /* corresponding phoneme with highest matching */
     int consumed;
-    unsigned int mnemonic_word;
 
     if (bad_phoneme != NULL)
         *bad_phoneme = 0;
@@ -368,29 +523,7 @@ const char *EncodePhonemes(
                 // lookup the phoneme mnemonic,
                 // find the phoneme with the highest number of
                 // matching characters
-                max = -1;
-                max_ph = 0;
-
-                for (ix = 1; ix < n_phoneme_tab; ix++) {
-                    if (phoneme_tab[ix] == NULL)
-                        continue;
-                    if (phoneme_tab[ix]->type == phINVALID)
-                        // this phoneme is not defined for this language
-                        continue;
-
-                    count = 0;
-                    mnemonic_word = phoneme_tab[ix]->mnemonic;
-
-                    while (((c = p[count]) > ' ') && (count < 4) &&
-                           (c == ((mnemonic_word >> (count * 8)) & 0xff)))
-                        count++;
-
-                    if ((count > max) &&
-                        ((count == 4) || (((mnemonic_word >> (count * 8)) & 0xff) == 0))) {
-                        max = count;
-                        max_ph = phoneme_tab[ix]->code;
-                    }
-                }
+                max_ph = MatchPhonemeMnemonic(p, &max);
 
                 if (max_ph == 0) {
                     // not recognised, report and ignore
@@ -2829,6 +2962,11 @@ static const char *LookupDict2(
         wlen = strlen(word);
     }
 
+    if ((wlen > 0x7f) || !InBloomFilter(tr, word, wlen)) {
+        // not in the dictionary, don't search the hash chain
+        return (0);
+    }
+
     hash = HashDictionary(word);
     p = tr->dict_hashtab[hash];
 
@@ -0,0 +1,261 @@
+/***************************************************************************
+ *   Copyright (C) 2005 to 2014 by Jonathan Duddington                     *
+ *   email: jonsd@users.sourceforge.net                                    *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 3 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, see:                                 *
+ *               <http://www.gnu.org/licenses/>.                           *
+ ***************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "speech.h"
+#include "encode.h"
+
+#define N_ULAW_TAB  0x4000    // indexed by the top 14 bits of a sample
+#define N_ALAW_TAB  0x2000    // indexed by the top 13 bits
+
+static unsigned char *ulaw_tab = NULL;
+static unsigned char *alaw_tab = NULL;
+
+// the largest magnitude in each segment of the G.711 encodings
+static const short ulaw_seg_end[8] = {0x3f, 0x7f, 0xff, 0x1ff, 0x3ff, 0x7ff, 0xfff, 0x1fff};
+static const short alaw_seg_end[8] = {0x1f, 0x3f, 0x7f, 0xff, 0x1ff, 0x3ff, 0x7ff, 0xfff};
+
+static const short adpcm_step[89] = {
+	    7,     8,     9,    10,    11,    12,    13,    14,    16,    17,
+	   19,    21,    23,    25,    28,    31,    34,    37,    41,    45,
+	   50,    55,    60,    66,    73,    80,    88,    97,   107,   118,
+	  130,   143,   157,   173,   190,   209,   230,   253,   279,   307,
+	  337,   371,   408,   449,   494,   544,   598,   658,   724,   796,
+	  876,   963,  1060,  1166,  1282,  1411,  1552,  1707,  1878,  2066,
+	 2272,  2499,  2749,  3024,  3327,  3660,  4026,  4428,  4871,  5358,
+	 5894,  6484,  7132,  7845,  8630,  9493, 10442, 11487, 12635, 13899,
+	15289, 16818, 18500, 20350, 22385, 24623, 27086, 29794, 32767 };
+
+static const signed char adpcm_index_change[8] = {-1, -1, -1, -1, 2, 4, 6, 8};
+
+
+static int Segment(int value, const short *seg_end)
+{//================================================
+	int seg;
+
+	for(seg=0; seg<8; seg++)
+	{
+		if(value <= seg_end[seg])
+			break;
+	}
+	return(seg);
+}
+
+
+static unsigned char *MakeUlawTable(void)
+{//======================================
+	int ix;
+	int value;
+	int mask;
+	int seg;
+	unsigned char *tab;
+
+	if((tab = (unsigned char *)malloc(N_ULAW_TAB)) == NULL)
+		return(NULL);
+
+	for(ix=0; ix<N_ULAW_TAB; ix++)
+	{
+		value = (ix < N_ULAW_TAB/2) ? ix : ix - N_ULAW_TAB;   // the sample >> 2
+		if(value < 0)
+		{
+			value = -value;
+			mask = 0x7f;
+		}
+		else
+			mask = 0xff;
+		if(value > 8159)
+			value = 8159;
+		value += 0x21;   // bias
+
+		if((seg = Segment(value, ulaw_seg_end)) >= 8)
+			tab[ix] = 0x7f ^ mask;
+		else
+			tab[ix] = ((seg << 4) | ((value >> (seg + 1)) & 0xf)) ^ mask;
+	}
+	return(tab);
+}
+
+
+static unsigned char *MakeAlawTable(void)
+{//======================================
+	int ix;
+	int value;
+	int mask;
+	int seg;
+	int aval;
+	unsigned char *tab;
+
+	if((tab = (unsigned char *)malloc(N_ALAW_TAB)) == NULL)
+		return(NULL);
+
+	for(ix=0; ix<N_ALAW_TAB; ix++)
+	{
+		value = (ix < N_ALAW_TAB/2) ? ix : ix - N_ALAW_TAB;   // the sample >> 3
+		if(value >= 0)
+			mask = 0xd5;
+		else
+		{
+			mask = 0x55;
+			value = -value - 1;
+		}
+
+		if((seg = Segment(value, alaw_seg_end)) >= 8)
+			tab[ix] = 0x7f ^ mask;
+		else
+		{
+			aval = seg << 4;
+			if(seg < 2)
+				aval |= (value >> 1) & 0xf;
+			else
+				aval |= (value >> seg) & 0xf;
+			tab[ix] = aval ^ mask;
+		}
+	}
+	return(tab);
+}
+
+
+void EncodeUlaw(const short *in, unsigned char *out, int n)
+{//=======================================================
+	int ix;
+
+	if((ulaw_tab == NULL) && ((ulaw_tab = MakeUlawTable()) == NULL))
+		return;
+
+	for(ix=0; ix<n; ix++)
+		out[ix] = ulaw_tab[(unsigned short)in[ix] >> 2];
+}
+
+
+void EncodeAlaw(const short *in, unsigned char *out, int n)
+{//=======================================================
+	int ix;
+
+	if((alaw_tab == NULL) && ((alaw_tab = MakeAlawTable()) == NULL))
+		return;
+
+	for(ix=0; ix<n; ix++)
+		out[ix] = alaw_tab[(unsigned short)in[ix] >> 3];
+}
+
+
+void AdpcmReset(ADPCM_STATE *st)
+{//=============================
+	st->predictor = 0;
+	st->index = 0;
+	st->nibble = -1;
+}
+
+
+static int AdpcmCode(ADPCM_STATE *st, int sample)
+{//==============================================
+// Returns the 4 bit code for the next sample, and updates the predictor to match the decoder
+	int diff;
+	int step;
+	int vpdiff;
+	int code = 0;
+
+	step = adpcm_step[st->index];
+	diff = sample - st->predictor;
+	if(diff < 0)
+	{
+		code = 8;
+		diff = -diff;
+	}
+
+	vpdiff = step >> 3;
+	if(diff >= step)
+	{
+		code |= 4;
+		diff -= step;
+		vpdiff += step;
+	}
+	step >>= 1;
+	if(diff >= step)
+	{
+		code |= 2;
+		diff -= step;
+		vpdiff += step;
+	}
+	step >>= 1;
+	if(diff >= step)
+	{
+		code |= 1;
+		vpdiff += step;
+	}
+
+	if(code & 8)
+	{
+		if((st->predictor -= vpdiff) < -32768)
+			st->predictor = -32768;
+	}
+	else
+	{
+		if((st->predictor += vpdiff) > 32767)
+			st->predictor = 32767;
+	}
+
+	st->index += adpcm_index_change[code & 7];
+	if(st->index < 0)
+		st->index = 0;
+	else
+	if(st->index > 88)
+		st->index = 88;
+	return(code);
+}
+
+
+int EncodeAdpcm(ADPCM_STATE *st, const short *in, unsigned char *out, int n)
+{//=========================================================================
+// Returns the number of bytes written to out
+	int ix = 0;
+	int n_out = 0;
+	int code;
+
+	if((st->nibble >= 0) && (n > 0))
+	{
+		code = AdpcmCode(st, in[ix++]);
+		out[n_out++] = st->nibble | (code << 4);
+		st->nibble = -1;
+	}
+
+	for(; ix+1 < n; ix += 2)
+	{
+		code = AdpcmCode(st, in[ix]);
+		out[n_out++] = code | (AdpcmCode(st, in[ix+1]) << 4);
+	}
+
+	if(ix < n)
+		st->nibble = AdpcmCode(st, in[ix]);
+	return(n_out);
+}
+
+
+int AdpcmFlush(ADPCM_STATE *st, unsigned char *out)
+{//================================================
+// Writes the code which is waiting for a second sample, if any. Returns the number of bytes.
+	if(st->nibble < 0)
+		return(0);
+	out[0] = st->nibble;
+	st->nibble = -1;
+	return(1);
+}
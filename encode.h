@@ -0,0 +1,33 @@
+#ifndef ENCODE_H
+#define ENCODE_H
+
+/*
+Encoding of 16 bit sound into G.711 mu-law and A-law, and IMA ADPCM.
+
+The G.711 encodings depend only on the top 14 (mu-law) or 13 (A-law) bits
+of a sample, so they are done by looking up a table which is made the
+first time it's needed.
+
+IMA ADPCM is a headerless stream of 4 bit codes, two to a byte with the
+earlier sample in the low 4 bits, as in the data of IMA ADPCM WAV files.
+The predictor and step index continue from one call of EncodeAdpcm() to
+the next.  AdpcmFlush() gives the last byte if there is an odd number of
+samples.
+
+The output may be written over the input, since each byte of output is
+written after the samples which it encodes have been read.
+*/
+
+typedef struct {
+	int predictor;
+	int index;        // into the step size table
+	int nibble;       // a code which is waiting for the next sample, or -1
+} ADPCM_STATE;
+
+void EncodeUlaw(const short *in, unsigned char *out, int n);
+void EncodeAlaw(const short *in, unsigned char *out, int n);
+void AdpcmReset(ADPCM_STATE *st);
+int EncodeAdpcm(ADPCM_STATE *st, const short *in, unsigned char *out, int n);
+int AdpcmFlush(ADPCM_STATE *st, unsigned char *out);
+
+#endif
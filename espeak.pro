@@ -10,8 +10,10 @@ CONFIG -= qt
 
 SOURCES += \
         compiledict.c \
+        databundle.c \
         debug.c \
         dictionary.c \
+        encode.c \
         espeak_command.c \
         espeak_libtest.c \
         intonation.c \
@@ -19,8 +21,10 @@ SOURCES += \
         numbers.c \
         phonemelist.c \
         readclause.c \
+        resample.c \
         setlengths.c \
         sonic.c \
+        soundcache.c \
         speak_lib.c \
         synth_mbrola.c \
         synthdata.c \
@@ -29,20 +33,26 @@ SOURCES += \
         translate.c \
         voices.c \
         wavegen.c \
+        msvc/delivery.c \
         msvc/event.c \
         msvc/fifo.c \
         msvc/wave.c
 
 HEADERS += \
+        databundle.h \
         debug.h \
+        delivery.h \
+        encode.h \
         espeak_command.h \
         event.h \
         fifo.h \
         klatt.h \
         phoneme.h \
         portaudio.h \
+        resample.h \
         sintab.h \
         sonic.h \
+        soundcache.h \
         speak_lib.h \
         translate.h \
         voice.h \
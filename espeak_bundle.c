@@ -0,0 +1,297 @@
+/***************************************************************************
+ *   Copyright (C) 2005 to 2014 by Jonathan Duddington                     *
+ *   email: jonsd@users.sourceforge.net                                    *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 3 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, see:                                 *
+ *               <http://www.gnu.org/licenses/>.                           *
+ ***************************************************************************/
+
+// Packs an espeak-data directory into a single data bundle file (see databundle.h)
+//
+//   espeak_bundle [-c] <espeak-data directory> <output file> [name ...]
+//
+// If names are given, only those files, or directories, are included.
+// Otherwise all the data files are included, except the dictionary and phoneme sources.
+//
+// -c  writes the bundle as C source, an array which is compiled into the library
+//     (see the ESPEAK_EMBED_DATA option in CMakeLists.txt)
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <dirent.h>
+#endif
+
+#include "databundle.h"
+
+#define N_FILES  2000
+
+typedef struct {
+	char name[N_BUNDLE_NAME];
+	unsigned int length;
+	unsigned int offset;
+} BUNDLE_FILE;
+
+static BUNDLE_FILE files[N_FILES];
+static int n_files = 0;
+
+static const char *excluded[] = {"dictsource", "phsource", NULL};
+
+static int c_source = 0;
+static unsigned int n_out = 0;
+
+
+static void PutByte(int c, FILE *f)
+{//================================
+	if(c_source)
+	{
+		if((n_out % 24) == 0)
+			fputs("\n",f);
+		fprintf(f,"%d,",c & 0xff);
+	}
+	else
+	{
+		fputc(c,f);
+	}
+	n_out++;
+}
+
+
+static void Write4Bytes(FILE *f, unsigned int value)
+{//=================================================
+// Write 4 bytes to a file, least significant first
+	int ix;
+
+	for(ix=0; ix<4; ix++)
+	{
+		PutByte(value & 0xff,f);
+		value = value >> 8;
+	}
+}
+
+
+static int GetFileLength(const char *filename)
+{//===========================================
+	struct stat statbuf;
+
+	if(stat(filename,&statbuf) != 0)
+		return(0);
+
+	if((statbuf.st_mode & S_IFMT) == S_IFDIR)
+		return(-2);  // a directory
+
+	return(statbuf.st_size);
+}
+
+
+static void AddPath(const char *data_dir, const char *name);
+
+
+static void AddDirectory(const char *data_dir, const char *name)
+{//=============================================================
+	char path[300];
+	char name2[300];
+
+#ifdef _WIN32
+	WIN32_FIND_DATAA find_data;
+	HANDLE h_find;
+
+	sprintf(path,"%s/%s/*",data_dir,name);
+	if((h_find = FindFirstFileA(path, &find_data)) == INVALID_HANDLE_VALUE)
+		return;
+	do {
+		if(find_data.cFileName[0] == '.')
+			continue;
+		sprintf(name2,"%s%s%s",name,(name[0] == 0) ? "" : "/",find_data.cFileName);
+		AddPath(data_dir, name2);
+	} while(FindNextFileA(h_find, &find_data) != 0);
+	FindClose(h_find);
+#else
+	DIR *dir;
+	struct dirent *ent;
+
+	sprintf(path,"%s/%s",data_dir,name);
+	if((dir = opendir(path)) == NULL)
+		return;
+	while((ent = readdir(dir)) != NULL)
+	{
+		if(ent->d_name[0] == '.')
+			continue;
+		sprintf(name2,"%s%s%s",name,(name[0] == 0) ? "" : "/",ent->d_name);
+		AddPath(data_dir, name2);
+	}
+	closedir(dir);
+#endif
+}
+
+
+static void AddPath(const char *data_dir, const char *name)
+{//========================================================
+// Add a file, or all the files in a directory.  'name' is relative to data_dir
+	int ix;
+	int length;
+	char path[300];
+
+	for(ix=0; excluded[ix] != NULL; ix++)
+	{
+		if(strcmp(name, excluded[ix]) == 0)
+			return;
+	}
+
+	sprintf(path,"%s/%s",data_dir,name);
+	length = GetFileLength(path);
+	if(length == -2)
+	{
+		AddDirectory(data_dir, name);
+		return;
+	}
+
+	if(length < 0)
+		return;
+	if(strlen(name) >= N_BUNDLE_NAME)
+	{
+		fprintf(stderr,"Name is too long, omitted: %s\n",name);
+		return;
+	}
+	if(n_files >= N_FILES)
+	{
+		fprintf(stderr,"Too many files, omitted: %s\n",name);
+		return;
+	}
+
+	strcpy(files[n_files].name, name);
+	files[n_files++].length = length;
+}
+
+
+static int NameSorter(const void *p1, const void *p2)
+{//==================================================
+	return(strcmp(((const BUNDLE_FILE *)p1)->name, ((const BUNDLE_FILE *)p2)->name));
+}
+
+
+int main(int argc, char *argv[])
+{//=============================
+	int ix;
+	int c;
+	unsigned int offset;
+	FILE *f_out;
+	FILE *f_in;
+	char path[300];
+
+	if((argc > 1) && (strcmp(argv[1],"-c") == 0))
+	{
+		c_source = 1;
+		argc--;
+		argv++;
+	}
+
+	if(argc < 3)
+	{
+		fprintf(stderr,"Usage: espeak_bundle [-c] <espeak-data directory> <output file> [name ...]\n");
+		return(1);
+	}
+
+	if(argc == 3)
+	{
+		AddDirectory(argv[1], "");
+	}
+	else
+	{
+		for(ix=3; ix<argc; ix++)
+			AddPath(argv[1], argv[ix]);
+	}
+
+	qsort(files, n_files, sizeof(files[0]), NameSorter);
+
+	// each file starts on a BUNDLE_ALIGN boundary after the index
+	offset = BUNDLE_HEADER + n_files * sizeof(BUNDLE_ENTRY);
+	for(ix=0; ix<n_files; ix++)
+	{
+		offset = (offset + BUNDLE_ALIGN - 1) & ~(BUNDLE_ALIGN - 1);
+		files[ix].offset = offset;
+		offset += files[ix].length;
+	}
+
+	if((f_out = fopen(argv[2],c_source ? "w" : "wb")) == NULL)
+	{
+		fprintf(stderr,"Can't write file: %s\n",argv[2]);
+		return(1);
+	}
+
+	if(c_source)
+	{
+		fprintf(f_out,"// Generated by espeak_bundle from %s, do not edit\n\n",argv[1]);
+		fprintf(f_out,"#include \"speech.h\"\n#include \"databundle.h\"\n\n");
+		fprintf(f_out,"const unsigned int espeak_data_bundle_length = %u;\n\n",offset);
+		fprintf(f_out,"BUNDLE_ALIGNED BUNDLE_CONST unsigned char espeak_data_bundle[%u] = {",offset);
+	}
+
+	for(ix=0; ix<8; ix++)
+		PutByte(BUNDLE_MAGIC[ix], f_out);
+	Write4Bytes(f_out, BUNDLE_VERSION);
+	Write4Bytes(f_out, n_files);
+
+	for(ix=0; ix<n_files; ix++)
+	{
+		char name[N_BUNDLE_NAME];
+
+		memset(name, 0, sizeof(name));
+		strcpy(name, files[ix].name);
+		Write4Bytes(f_out, files[ix].offset);
+		Write4Bytes(f_out, files[ix].length);
+		for(c=0; c<N_BUNDLE_NAME; c++)
+			PutByte(name[c], f_out);
+	}
+
+	for(ix=0; ix<n_files; ix++)
+	{
+		while(n_out < files[ix].offset)
+		{
+			PutByte(0, f_out);
+		}
+
+		sprintf(path,"%s/%s",argv[1],files[ix].name);
+		if((f_in = fopen(path,"rb")) == NULL)
+		{
+			fprintf(stderr,"Can't read file: %s\n",path);
+			fclose(f_out);
+			return(1);
+		}
+		while((c = fgetc(f_in)) != EOF)
+		{
+			PutByte(c, f_out);
+		}
+		fclose(f_in);
+
+		if(n_out != files[ix].offset + files[ix].length)
+		{
+			fprintf(stderr,"File changed while it was being read: %s\n",path);
+			fclose(f_out);
+			return(1);
+		}
+	}
+
+	if(c_source)
+		fprintf(f_out,"\n};\n");
+	fclose(f_out);
+
+	fprintf(stderr,"%d files, %u bytes\n",n_files,n_out);
+	return(0);
+}
@@ -136,6 +136,89 @@ t_espeak_command* create_espeak_terminated_msg(unsigned int unique_identifier, v
 
 
 
+//<create_espeak_file
+t_espeak_command* create_espeak_file(const char *path, unsigned int offset, unsigned int flags, void* user_data)
+{
+  int a_error=1;
+  char *a_path = NULL;
+  t_espeak_file* data = NULL;
+  t_espeak_command* a_command =
+          (t_espeak_command*)malloc(sizeof(t_espeak_command));
+
+  ENTER("create_espeak_file");
+
+  if (!path || !a_command)
+    {
+      goto file_error;
+    }
+
+  // the file is read when the command is processed, keep only its name
+  a_path = strdup(path);
+  if (!a_path)
+    {
+      goto file_error;
+    }
+
+  a_command->type = ET_FILE;
+  a_command->state = CS_UNDEFINED;
+  data = &(a_command->u.my_file);
+  data->unique_identifier = ++my_current_text_id;
+  data->path = a_path;
+  data->offset = offset;
+  data->flags = flags;
+  data->user_data = user_data;
+  a_error=0;
+
+  SHOW("ET_FILE path=%s, command=%x (uid=%d)\n", a_path, a_command, data->unique_identifier);
+
+ file_error:
+  if (a_error)
+    {
+      if (a_command)
+	{
+	  free (a_command);
+	}
+      a_command = NULL;
+    }
+
+  return a_command;
+}
+//>
+
+
+//<create_espeak_resume
+t_espeak_command* create_espeak_resume(const t_espeak_resume *resume)
+{
+  // the command takes the text and path, which have been allocated by the caller
+  t_espeak_command* a_command =
+          (t_espeak_command*)malloc(sizeof(t_espeak_command));
+
+  ENTER("create_espeak_resume");
+
+  if (!a_command)
+    {
+      if (resume->text)
+	{
+	  free(resume->text);
+	}
+      if (resume->path)
+	{
+	  free((void*)resume->path);
+	}
+      return NULL;
+    }
+
+  a_command->type = ET_RESUME;
+  a_command->state = CS_UNDEFINED;
+  a_command->u.my_resume = *resume;
+
+  SHOW("ET_RESUME command=%x (uid=%d)\n", a_command, resume->unique_identifier);
+
+  return a_command;
+}
+//>
+
+
 //<create_espeak_mark
 t_espeak_command* create_espeak_mark(const void *text, size_t size, const char *index_mark, unsigned int end_position, unsigned int flags, void* user_data)
 {
@@ -460,6 +543,24 @@ int delete_espeak_command( t_espeak_command* the_command)
 	    }
 	  break;
 
+	case ET_FILE:
+	  if (the_command->u.my_file.path)
+	    {
+	      free((void*)(the_command->u.my_file.path));
+	    }
+	  break;
+
+	case ET_RESUME:
+	  if (the_command->u.my_resume.text)
+	    {
+	      free(the_command->u.my_resume.text);
+	    }
+	  if (the_command->u.my_resume.path)
+	    {
+	      free((void*)(the_command->u.my_resume.path));
+	    }
+	  break;
+
 	case ET_MARK:
 	  if (the_command->u.my_mark.text)
 	    {
@@ -569,6 +670,18 @@ void process_espeak_command( t_espeak_command* the_command)
       }
       break;
 
+    case ET_FILE:
+      {
+	t_espeak_file* data = &(the_command->u.my_file);
+	sync_espeak_SynthFile( data->unique_identifier, data->path,
+			       data->offset, data->flags, data->user_data);
+      }
+      break;
+
+    case ET_RESUME:
+      sync_espeak_Resume(&(the_command->u.my_resume));
+      break;
+
     case ET_MARK:
       {
 	t_espeak_mark* data = &(the_command->u.my_mark);
@@ -657,6 +770,20 @@ void display_espeak_command( t_espeak_command* the_command)
       }
       break;
 
+    case ET_FILE:
+      {
+	t_espeak_file* data = &(the_command->u.my_file);
+	SHOW("display_espeak_command > (0x%x) uid=%d, FILE=%s, offset=%d, user_data=0x%x\n", the_command, data->unique_identifier, data->path, data->offset, (size_t)(data->user_data));
+      }
+      break;
+
+    case ET_RESUME:
+      {
+	t_espeak_resume* data = &(the_command->u.my_resume);
+	SHOW("display_espeak_command > (0x%x) uid=%d, RESUME=%s, offset=%d, user_data=0x%x\n", the_command, data->unique_identifier, (data->text) ? (char*)data->text : data->path, data->offset, (size_t)(data->user_data));
+      }
+      break;
+
     case ET_MARK:
       {
 	t_espeak_mark* data = &(the_command->u.my_mark);
@@ -16,7 +16,9 @@ typedef enum t_espeak_type
     ET_PUNCTUATION_LIST,
     ET_VOICE_NAME,
     ET_VOICE_SPEC,
-    ET_TERMINATED_MSG
+    ET_TERMINATED_MSG,
+    ET_FILE,
+    ET_RESUME
   }t_espeak_type;
 
 typedef struct 
@@ -31,6 +33,34 @@ typedef struct
   void* user_data;
 } t_espeak_text;
 
+typedef struct 
+{
+  unsigned int unique_identifier;
+  const char* path;
+  unsigned int offset;
+  unsigned int flags;
+  void* user_data;
+} t_espeak_file;
+
+// The rest of a text or file, which was suspended at the end of a clause
+// for commands of higher priority (see fifo_is_preempted).
+typedef struct 
+{
+  unsigned int unique_identifier;
+  void* text;              // the SSML tags of the elements which are open, and the rest of the text,
+  size_t size;             //   or NULL for the rest of a file
+  const char* path;
+  unsigned int offset;     // of the rest of the file
+  unsigned int end_position;
+  unsigned int flags;
+  void* user_data;
+  int start_char;          // events up to this character of the whole text are from the SSML tags
+  int char_shift;          // added to the text positions of the events
+  int word_base;           // added to the numbers of the words and sentences
+  int sentence_base;
+  int new_sentence;        // 0 if the rest of the text starts within a sentence
+} t_espeak_resume;
+
 typedef struct 
 {
   unsigned int unique_identifier;
@@ -94,6 +124,8 @@ typedef struct
     const char *my_voice_name;
     espeak_VOICE my_voice_spec;
     t_espeak_terminated_msg my_terminated_msg;
+    t_espeak_file my_file;
+    t_espeak_resume my_resume;
   } u;
 } t_espeak_command;
 
@@ -104,6 +136,10 @@ t_espeak_command* create_espeak_mark(const void *text, size_t size, const char *
 
 t_espeak_command* create_espeak_terminated_msg(unsigned int unique_identifier, void* user_data);
 
+t_espeak_command* create_espeak_file(const char *path, unsigned int offset, unsigned int flags, void* user_data);
+
+t_espeak_command* create_espeak_resume(const t_espeak_resume *resume);
+
 t_espeak_command* create_espeak_key(const char *key_name, void *user_data);
 
 t_espeak_command* create_espeak_char(wchar_t character, void *user_data);
@@ -129,6 +165,9 @@ espeak_ERROR sync_espeak_Synth(unsigned int unique_identifier, const void *text,
 espeak_ERROR sync_espeak_Synth_Mark(unsigned int unique_identifier, const void *text, size_t size, 
 			   const char *index_mark, unsigned int end_position, 
 			   unsigned int flags, void* user_data);
+espeak_ERROR sync_espeak_SynthFile(unsigned int unique_identifier, const char *path,
+			   unsigned int offset, unsigned int flags, void* user_data);
+espeak_ERROR sync_espeak_Resume(t_espeak_resume *resume);
 void sync_espeak_Key(const char *key);
 void sync_espeak_Char(wchar_t character);
 void sync_espeak_SetPunctuationList(const wchar_t *punctlist);
@@ -13,14 +13,15 @@ Scenario:
 
 - event_declare is called for each expected event.
 
-- A timeout is started for the first pending event.
+- The time at which the sample of the first pending event is played is given by the audio clock (wave_get_sample_time), and a timeout is started until then.
 
 - When the timeout happens, the synth_callback is called.
 
-Note: the timeout is checked against the real progress of the audio stream, which depends on pauses or underruns. If the real progress is lower than the expected one, a new timeout starts.
+Note: the audio clock follows the real progress of the audio stream, which depends on pauses or underruns. The time is checked again when the timeout happens, and if it has moved, a new timeout starts.
 
 */
 
+#include <time.h>
 #include "speak_lib.h"
 
 // Initialize the event component.
@@ -40,10 +41,25 @@ espeak_ERROR event_clear_all ();
 //
 // Return: EE_OK: operation achieved 
 //         EE_BUFFER_FULL: the event can not be buffered; 
-//           you may try after a while to call the function again.
+//           you may call event_wait_for_space and then call the function again.
 //         EE_INTERNAL_ERROR.
 espeak_ERROR event_declare (espeak_EVENT* event);
 
+// Wait until an event can be declared, or until the_end (NULL = no time limit).
+// Returns 0 if there is space, or 1 if the events are still full at the_end.
+int event_wait_for_space (const struct timespec* the_end);
+
+// Wait until all the declared events have been notified,
+// or until the_end (NULL = no time limit).
+// Returns 0 if there is no pending event, or 1 if there are still some at the_end.
+int event_wait_idle (const struct timespec* the_end);
+
+// Supply the number of callbacks of events which were timed by the audio clock,
+// and the mean and the largest delay (in microseconds) between the sound of
+// the event reaching the audio output and its callback.  The mean is negative
+// if the callbacks were early.
+void event_get_delays (unsigned int* count, int* mean_us, int* max_us);
+
 // Terminate the event component.
 // Last function to be called.
 void event_terminate();
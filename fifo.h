@@ -4,6 +4,7 @@
 // Helps to add espeak commands in a first-in first-out queue 
 // and run them asynchronously.
 
+#include <time.h>
 #include "espeak_command.h"
 #include "speak_lib.h"
 
@@ -33,6 +34,21 @@ espeak_ERROR fifo_add_command (t_espeak_command* c);
 //         EE_INTERNAL_ERROR.
 espeak_ERROR fifo_add_commands (t_espeak_command* c1, t_espeak_command* c2);
 
+// Set the lane of the commands which are added from now on:
+// espeakPRIORITY_NORMAL or espeakPRIORITY_HIGH.
+// The commands of the high lane are run before those of the normal lane.
+void fifo_set_priority (int priority);
+
+// Is a command waiting in a lane of higher priority than the running command?
+// The running command may then be suspended: it calls fifo_resume_command() with a
+// command which speaks the rest of it, and returns.
+// Returns 1 if yes; 0 otherwise.
+int fifo_is_preempted ();
+
+// Add a command at the head of the lane of the running command, so that it is run
+// after the commands of higher priority.  This is not limited by the number of commands.
+void fifo_resume_command (t_espeak_command* c);
+
 // The current running command must be stopped and the awaiting commands are cleared.
 // Return: EE_OK: operation achieved 
 //         EE_INTERNAL_ERROR.
@@ -42,6 +58,11 @@ espeak_ERROR fifo_stop ();
 // Returns 1 if yes; 0 otherwise.
 int fifo_is_busy ();
 
+// Wait until there is no running or awaiting command,
+// or until the_end (NULL = no time limit).
+// Returns 0 if the fifo is idle, or 1 if it is still busy at the_end.
+int fifo_wait_idle (const struct timespec* the_end);
+
 // Terminate the fifo component.
 // Last function to be called.
 void fifo_terminate();
@@ -43,10 +43,13 @@
 
 // my_mutex: protects my_thread_is_talking,
 static pthread_mutex_t my_mutex;
+// my_cond_is_changed: broadcast with my_mutex locked when an event is removed
+// from the list, and when my_event_is_running becomes 0.
+static pthread_cond_t my_cond_is_changed;
 static sem_t my_sem_start_is_required;
 static sem_t my_sem_stop_is_required;
 static sem_t my_sem_stop_is_acknowledged;
-// my_thread: polls the audio duration and compares it to the duration of the first event.
+// my_thread: waits until the sample of the first event is played, by the audio clock.
 static pthread_t my_thread;
 static int thread_inited;
 
@@ -54,11 +57,18 @@ static t_espeak_callback *my_callback = NULL;
 static int my_event_is_running = 0;
 
 enum {
-    MIN_TIMEOUT_IN_MS = 10,
-    ACTIVITY_TIMEOUT = 50, // in ms, check that the stream is active
-    MAX_ACTIVITY_CHECK = 6
+    MAX_NODE_COUNTER = 1000,
+    CLOCK_CHECK_TIMEOUT = 5 // in ms, check whether the stream is playing
 };
 
+// The delays of the callbacks after the sound of their events reached the
+// audio output.  Protected by my_mutex.
+static struct {
+    unsigned int count;
+    int64_t sum_ns;
+    int64_t max_ns;   // the largest, early or late
+} my_delays;
+
 
 typedef struct t_node {
     void *data;
@@ -91,6 +101,7 @@ void event_init() {
 
     // security
     pthread_mutex_init(&my_mutex, (const pthread_mutexattr_t *) NULL);
+    pthread_cond_init(&my_cond_is_changed, (const pthread_condattr_t *) NULL);
     init();
 
     assert(-1 != sem_init(&my_sem_start_is_required, 0, 0));
@@ -209,6 +220,7 @@ static void event_notify(espeak_EVENT *event) {
             case espeakEVENT_MARK:
             case espeakEVENT_WORD:
             case espeakEVENT_END:
+            case espeakEVENT_CLAUSE:
             case espeakEVENT_PHONEME: {
 // jonsd - I'm not sure what this is for. gilles says it's for when Gnome Speech reads a file of blank lines
                 if (a_old_uid != event->unique_identifier) {
@@ -314,6 +326,7 @@ espeak_ERROR event_clear_all() {
         a_event_is_running = 1;
     } else {
         init(); // clear pending events
+        pthread_cond_broadcast(&my_cond_is_changed);
     }
     SHOW_TIME("event_stop > unlocking\n");
     a_status = pthread_mutex_unlock(&my_mutex);
@@ -335,82 +348,154 @@ espeak_ERROR event_clear_all() {
 }
 
 //>
-//<sleep_until_timeout_or_stop_request
+//<event_wait_for_space, event_wait_idle
 
-static int sleep_until_timeout_or_stop_request(uint32_t time_in_ms) {
-    ENTER("sleep_until_timeout_or_stop_request");
-
-    int a_stop_is_required = 0;
-    struct timespec ts;
-    struct timeval tv;
+// Wait while cond_busy() is true, until the_end (NULL = no time limit).
+static int wait_while(int (*cond_busy)(), const struct timespec *the_end) {
+    int a_busy = 0;
     int err = 0;
 
-    clock_gettime2(&ts);
+    if (!thread_inited) {
+        return 0;
+    }
 
-#ifdef DEBUG_ENABLED
-    struct timespec to;
-    to.tv_sec = ts.tv_sec;
-    to.tv_nsec = ts.tv_nsec;
-#endif
+    if (pthread_mutex_lock(&my_mutex) != 0) {
+        return 1;
+    }
+    while ((a_busy = cond_busy()) && (err != ETIMEDOUT)) {
+        if (the_end == NULL) {
+            err = pthread_cond_wait(&my_cond_is_changed, &my_mutex);
+        } else {
+            err = pthread_cond_timedwait(&my_cond_is_changed, &my_mutex, the_end);
+        }
+    }
+    pthread_mutex_unlock(&my_mutex);
+    return a_busy;
+}
 
-    add_time_in_ms(&ts, time_in_ms);
+static int is_full() {
+    return (node_counter >= MAX_NODE_COUNTER);
+}
 
-    SHOW("polling_thread > sleep_until_timeout_or_stop_request > start sem_timedwait from %d.%09lu to %d.%09lu \n",
-         to.tv_sec, to.tv_nsec,
-         ts.tv_sec, ts.tv_nsec);
+static int is_busy() {
+    return (my_event_is_running || (head != NULL));
+}
 
-    while ((err = sem_timedwait(&my_sem_stop_is_required, &ts)) == -1
+int event_wait_for_space(const struct timespec *the_end) {
+    ENTER("event_wait_for_space");
+    return wait_while(is_full, the_end);
+}
+
+int event_wait_idle(const struct timespec *the_end) {
+    ENTER("event_wait_idle");
+    return wait_while(is_busy, the_end);
+}
+
+//>
+//<event_get_delays
+
+void event_get_delays(unsigned int *count, int *mean_us, int *max_us) {
+    if (!thread_inited) {
+        *count = 0;
+        *mean_us = *max_us = 0;
+        return;
+    }
+    pthread_mutex_lock(&my_mutex);
+    *count = my_delays.count;
+    *mean_us = (my_delays.count == 0) ? 0 : (int) (my_delays.sum_ns / my_delays.count / 1000);
+    *max_us = (int) (my_delays.max_ns / 1000);
+    pthread_mutex_unlock(&my_mutex);
+}
+
+// Called with my_mutex locked.
+static void add_delay(const struct timespec *the_time, const struct timespec *now) {
+    int64_t a_delay = (int64_t) (now->tv_sec - the_time->tv_sec) * 1000000000
+                      + (now->tv_nsec - the_time->tv_nsec);
+
+    my_delays.count++;
+    my_delays.sum_ns += a_delay;
+    if (a_delay < 0) {
+        a_delay = -a_delay;
+    }
+    if (a_delay > my_delays.max_ns) {
+        my_delays.max_ns = a_delay;
+    }
+}
+
+//>
+//<sleep_until_timeout_or_stop_request, sleep_until_time_or_stop_request
+
+static int sleep_until(struct timespec *ts) {
+    int a_stop_is_required = 0;
+    int err = 0;
+
+    while ((err = sem_timedwait(&my_sem_stop_is_required, ts)) == -1
            && errno == EINTR) {
         continue; // Restart when interrupted by handler
     }
 
-    assert (gettimeofday(&tv, NULL) != -1);
-    SHOW("polling_thread > sleep_until_timeout_or_stop_request > stop sem_timedwait %d.%09lu \n",
-         tv.tv_sec, tv.tv_usec * 1000);
-
     if (err == 0) {
-        SHOW("polling_thread > sleep_until_timeout_or_stop_request > %s\n", "stop required!");
+        SHOW("polling_thread > sleep_until > %s\n", "stop required!");
         a_stop_is_required = 1; // stop required
     }
     return a_stop_is_required;
 }
 
+static int sleep_until_timeout_or_stop_request(uint32_t time_in_ms) {
+    ENTER("sleep_until_timeout_or_stop_request");
+
+    struct timespec ts;
+
+    clock_gettime2(&ts);
+    add_time_in_ms(&ts, time_in_ms);
+    return sleep_until(&ts);
+}
+
+// the_time is on the monotonic clock, so that the events aren't moved when the
+// time of day is changed.  sem_timedwait() takes the time of day, so the
+// interval is added to that, and the caller checks the time again when it wakes.
+static int sleep_until_time_or_stop_request(const struct timespec *the_time) {
+    ENTER("sleep_until_time_or_stop_request");
+
+    struct timespec now;
+    struct timespec ts;
+    int64_t t_ns;
+
+    clock_gettime_mono(&now);
+    if (!time_is_before(&now, the_time)) {
+        return 0;
+    }
+    t_ns = (int64_t) (the_time->tv_sec - now.tv_sec) * 1000000000 + (the_time->tv_nsec - now.tv_nsec);
+    SHOW("polling_thread > sleep_until_time_or_stop_request > %d us\n", (int) (t_ns / 1000));
+
+    clock_gettime2(&ts);
+    t_ns += ts.tv_nsec;
+    ts.tv_sec += t_ns / 1000000000;
+    ts.tv_nsec = t_ns % 1000000000;
+
+    return sleep_until(&ts);
+}
+
 //>
-//<get_remaining_time
-// Asked for the time interval required for reaching the sample.
-// If the stream is opened but the audio samples are not played,
-// a timeout is started.
+//<get_event_time
+// Supply the time, on the monotonic clock, at which the sample is played.
+// If the stream is opened but not playing, which is before it's started, or
+// when it has played all its sound and is waiting for more, check it again
+// every CLOCK_CHECK_TIMEOUT ms.
+//
+// return 0 if ok, or -1 if the stream is not opened.
 
-static int get_remaining_time(uint32_t sample, uint32_t *time_in_ms, int *stop_is_required) {
-    ENTER("get_remaining_time");
+static int get_event_time(uint32_t sample, struct timespec *the_time, int *stop_is_required) {
+    ENTER("get_event_time");
 
     int err = 0;
     *stop_is_required = 0;
-    int i = 0;
 
-    for (i = 0; i < MAX_ACTIVITY_CHECK && (*stop_is_required == 0); i++) {
-        err = wave_get_remaining_time(sample, time_in_ms);
-
-        if (err || wave_is_busy(NULL) || (*time_in_ms == 0)) { // if err, stream not available: quit
-            // if wave is busy, time_in_ms is known: quit
-            // if wave is not busy but remaining time == 0, event is reached: quit
+    while ((err = wave_get_sample_time(sample, the_time)) == 1) {
+        *stop_is_required = sleep_until_timeout_or_stop_request(CLOCK_CHECK_TIMEOUT);
+        if (*stop_is_required) {
             break;
         }
-
-        // stream opened but not active
-        //
-        // Several possible states:
-        //   * the stream is opened but not yet started:
-        //
-        //       wait for the start of stream
-        //
-        //   * some samples have already been played,
-        //      ** the end of stream is reached
-        //      ** or there is an underrun
-        //
-        //       wait for the close of stream
-
-        *stop_is_required = sleep_until_timeout_or_stop_request(ACTIVITY_TIMEOUT);
     }
 
     return err;
@@ -429,6 +514,7 @@ static void *polling_thread(void *) {
         int a_status = pthread_mutex_lock(&my_mutex);
         SHOW_TIME("polling_thread > locked (my_event_is_running = 0)\n");
         my_event_is_running = 0;
+        pthread_cond_broadcast(&my_cond_is_changed);
         pthread_mutex_unlock(&my_mutex);
         SHOW_TIME("polling_thread > unlocked\n");
 
@@ -467,11 +553,17 @@ static void *polling_thread(void *) {
             espeak_EVENT *event = (espeak_EVENT *) (head->data);
             assert(event);
 
-            uint32_t time_in_ms = 0;
+            struct timespec the_time;
+            struct timespec now;
+            int err = 0;
+            int is_timed = (event->type != espeakEVENT_MSG_TERMINATED);
+
+            // MSG_TERMINATED has no sample, it follows the events before it
+            if (is_timed) {
+                err = get_event_time((uint32_t) event->sample, &the_time, &a_stop_is_required);
+            }
+            clock_gettime_mono(&now);
 
-            int err = get_remaining_time((uint32_t) event->sample,
-                                         &time_in_ms,
-                                         &a_stop_is_required);
             if (a_stop_is_required > 0) {
                 break;
             } else if (err != 0) {
@@ -480,9 +572,10 @@ static void *polling_thread(void *) {
                 a_status = pthread_mutex_lock(&my_mutex);
                 SHOW_TIME("polling_thread > locked\n");
                 event_delete((espeak_EVENT *) pop());
+                pthread_cond_broadcast(&my_cond_is_changed);
                 a_status = pthread_mutex_unlock(&my_mutex);
                 SHOW_TIME("polling_thread > unlocked\n");
-            } else if (time_in_ms == 0) { // the event is already reached.
+            } else if (!is_timed || !time_is_before(&now, &the_time)) { // the event is already reached.
                 if (my_callback) {
                     event_notify(event);
                     // the user_data (and the type) are cleaned to be sure
@@ -493,7 +586,11 @@ static void *polling_thread(void *) {
 
                 a_status = pthread_mutex_lock(&my_mutex);
                 SHOW_TIME("polling_thread > locked\n");
+                if (is_timed && my_callback) {
+                    add_delay(&the_time, &now);
+                }
                 event_delete((espeak_EVENT *) pop());
+                pthread_cond_broadcast(&my_cond_is_changed);
                 a_status = pthread_mutex_unlock(&my_mutex);
                 SHOW_TIME("polling_thread > unlocked\n");
 
@@ -507,8 +604,8 @@ static void *polling_thread(void *) {
                 } else {
                     a_stop_is_required = 0;
                 }
-            } else { // The event will be notified soon: sleep until timeout or stop request
-                a_stop_is_required = sleep_until_timeout_or_stop_request(time_in_ms);
+            } else { // The event will be notified soon: sleep until its time or stop request
+                a_stop_is_required = sleep_until_time_or_stop_request(&the_time);
             }
         }
 
@@ -517,6 +614,7 @@ static void *polling_thread(void *) {
 
         SHOW_TIME("polling_thread > my_event_is_running = 0\n");
         my_event_is_running = 0;
+        pthread_cond_broadcast(&my_cond_is_changed);
 
         if (a_stop_is_required <= 0) {
             a_status = sem_getvalue(&my_sem_stop_is_required, &a_stop_is_required);
@@ -537,6 +635,9 @@ static void *polling_thread(void *) {
             // no mutex required since the stop command is synchronous
             // and waiting for my_sem_stop_is_acknowledged
             init();
+            a_status = pthread_mutex_lock(&my_mutex);
+            pthread_cond_broadcast(&my_cond_is_changed);
+            a_status = pthread_mutex_unlock(&my_mutex);
             // acknowledge the stop request
             SHOW_TIME("polling_thread > post my_sem_stop_is_acknowledged\n");
             a_status = sem_post(&my_sem_stop_is_acknowledged);
@@ -548,9 +649,6 @@ static void *polling_thread(void *) {
 
 //>
 //<push, pop, init
-enum {
-    MAX_NODE_COUNTER = 1000
-};
 
 // return 1 if ok, 0 otherwise
 static espeak_ERROR push(void *the_data) {
@@ -631,6 +729,7 @@ void event_terminate() {
         pthread_cancel(my_thread);
         pthread_join(my_thread, NULL);
         pthread_mutex_destroy(&my_mutex);
+        pthread_cond_destroy(&my_cond_is_changed);
         sem_destroy(&my_sem_start_is_required);
         sem_destroy(&my_sem_stop_is_required);
         sem_destroy(&my_sem_stop_is_acknowledged);
@@ -50,6 +50,12 @@
 static pthread_mutex_t my_mutex;
 static int my_command_is_running = 0;
 static int my_stop_is_required = 0;
+// the lane of the commands which are added, and of the running command
+static int my_priority = espeakPRIORITY_NORMAL;
+static int my_command_priority = espeakPRIORITY_NORMAL;
+// my_cond_is_changed: broadcast with my_mutex locked when say_thread takes
+// a start request, and when my_command_is_running becomes 0.
+static pthread_cond_t my_cond_is_changed;
 // + fifo
 //
 
@@ -61,12 +67,15 @@ static sem_t my_sem_stop_is_acknowledged;
 static void* say_thread(void*);
 
 static espeak_ERROR push(t_espeak_command* the_command);
+static void push_front(t_espeak_command* the_command, int lane);
+static void wait_for_start();
 static t_espeak_command* pop();
 static void init(int process_parameters);
 static int node_counter=0;
 enum {MAX_NODE_COUNTER=400,
       INACTIVITY_TIMEOUT=50, // in ms, check that the stream is inactive
-      MAX_INACTIVITY_CHECK=2
+      MAX_INACTIVITY_CHECK=2,
+      N_LANES=espeakPRIORITY_HIGH+1
 };
 
 //>
@@ -77,6 +86,7 @@ void fifo_init()
 
   // security
   pthread_mutex_init( &my_mutex, (const pthread_mutexattr_t *)NULL);
+  pthread_cond_init( &my_cond_is_changed, (const pthread_condattr_t *)NULL);
   init(0);
 
   assert(-1 != sem_init(&my_sem_start_is_required, 0, 0));
@@ -103,6 +113,23 @@ void fifo_init()
     }
   SHOW_TIME("fifo > get my_sem_stop_is_acknowledged\n");
 }
+//>
+//<wait_for_start
+
+static void wait_for_start()
+{
+  // wait until say_thread has taken the start request
+  int val=1;
+  pthread_mutex_lock(&my_mutex);
+  sem_getvalue(&my_sem_start_is_required, &val);
+  while (val > 0)
+    {
+      pthread_cond_wait(&my_cond_is_changed, &my_mutex);
+      sem_getvalue(&my_sem_start_is_required, &val);
+    }
+  pthread_mutex_unlock(&my_mutex);
+}
+
 //>
 //<fifo_add_command
 
@@ -127,12 +154,7 @@ espeak_ERROR fifo_add_command (t_espeak_command* the_command)
       // (for possible forthcoming 'end of command' checks)
       SHOW_TIME("fifo_add_command > post my_sem_start_is_required\n");
       sem_post(&my_sem_start_is_required);
-      int val=1;
-      while (val > 0)
-	{
-        espeakSleep(50); // TBD: event?
-	  sem_getvalue(&my_sem_start_is_required, &val);
-	}
+      wait_for_start();
     }
 
   if (a_status != 0)
@@ -178,12 +200,7 @@ espeak_ERROR fifo_add_commands (t_espeak_command* command1, t_espeak_command* co
       // (for possible forthcoming 'end of command' checks)
       SHOW_TIME("fifo_add_command > post my_sem_start_is_required\n");
       sem_post(&my_sem_start_is_required);
-      int val=1;
-      while (val > 0)
-	{
-        espeakSleep(50); // TBD: event?
-	  sem_getvalue(&my_sem_start_is_required, &val);
-	}
+      wait_for_start();
     }
 
   if (a_status != 0)
@@ -251,6 +268,35 @@ int fifo_is_busy ()
   return my_command_is_running;
 }
 
+int fifo_wait_idle(const struct timespec* the_end)
+{
+  ENTER("fifo_wait_idle");
+
+  int a_busy;
+  int err = 0;
+  int a_status = pthread_mutex_lock(&my_mutex);
+  if (a_status != 0)
+    {
+      return 1;
+    }
+
+  while ((a_busy = (my_command_is_running || (node_counter > 0))) && (err != ETIMEDOUT))
+    {
+      if (the_end == NULL)
+	{
+	  err = pthread_cond_wait(&my_cond_is_changed, &my_mutex);
+	}
+      else
+	{
+	  err = pthread_cond_timedwait(&my_cond_is_changed, &my_mutex, the_end);
+	}
+    }
+  pthread_mutex_unlock(&my_mutex);
+
+  SHOW("fifo_wait_idle > busy=%d\n", a_busy);
+  return a_busy;
+}
+
 // int pause ()
 // {
 //   ENTER("pause");
@@ -358,6 +404,7 @@ static void close_stream()
       int a_status = pthread_mutex_lock(&my_mutex);
       assert (!a_status);
       my_command_is_running = 0;
+      pthread_cond_broadcast(&my_cond_is_changed);
 
       a_stop_is_required = my_stop_is_required;
       a_status = pthread_mutex_unlock(&my_mutex);
@@ -413,22 +460,27 @@ static void* say_thread(void*)
       SHOW_TIME("say_thread > get my_sem_start_is_required\n");
 
       SHOW_TIME("say_thread > my_command_is_running = 1\n");
+      int a_status = pthread_mutex_lock(&my_mutex);
+      assert (!a_status);
       my_command_is_running = 1;
+      pthread_cond_broadcast(&my_cond_is_changed);
+      a_status = pthread_mutex_unlock(&my_mutex);
 
       while( my_command_is_running)
 	{
 	  SHOW_TIME("say_thread > locking\n");
-	  int a_status = pthread_mutex_lock(&my_mutex);
+	  a_status = pthread_mutex_lock(&my_mutex);
 	  assert (!a_status);
 	  t_espeak_command* a_command = (t_espeak_command*)pop();
 
 	  if (a_command == NULL)
 	    {
 	      SHOW_TIME("say_thread > text empty (talking=0) \n");
-	      a_status = pthread_mutex_unlock(&my_mutex);
-	      SHOW_TIME("say_thread > unlocked\n");
 	      SHOW_TIME("say_thread > my_command_is_running = 0\n");
 	      my_command_is_running = 0;
+	      pthread_cond_broadcast(&my_cond_is_changed);
+	      a_status = pthread_mutex_unlock(&my_mutex);
+	      SHOW_TIME("say_thread > unlocked\n");
 	    }
 	  else
 	    {
@@ -438,6 +490,7 @@ static void* say_thread(void*)
 	      while(0 == sem_trywait(&my_sem_start_is_required))
 		{
 		};
+	      pthread_cond_broadcast(&my_cond_is_changed);
 
 	      if (my_stop_is_required)
 		{
@@ -466,10 +519,14 @@ static void* say_thread(void*)
 	  while(0==sem_trywait(&my_sem_start_is_required))
 	    {
 	    };
+	  a_status = pthread_mutex_lock(&my_mutex);
+	  assert (!a_status);
+	  pthread_cond_broadcast(&my_cond_is_changed);
+	  a_status = pthread_mutex_unlock(&my_mutex);
 
 	  // acknowledge the stop request
 	  SHOW_TIME("say_thread > post my_sem_stop_is_acknowledged\n");
-	  int a_status = sem_post(&my_sem_stop_is_acknowledged);
+	  a_status = sem_post(&my_sem_stop_is_acknowledged);
 	  assert( a_status != -1);
 	}
       // and wait for the next start
@@ -493,14 +550,16 @@ typedef struct t_node
     struct t_node *next;
 } node;
 
-static node* head=NULL;
-static node* tail=NULL;
+// a list for each lane, espeakPRIORITY_NORMAL and espeakPRIORITY_HIGH
+static node* head[N_LANES]={NULL};
+static node* tail[N_LANES]={NULL};
 // return 1 if ok, 0 otherwise
 static espeak_ERROR push(t_espeak_command* the_command)
 {
   ENTER("fifo > push");
 
-  assert((!head && !tail) || (head && tail));
+  int lane = my_priority;
+  assert((!head[lane] && !tail[lane]) || (head[lane] && tail[lane]));
 
   if (the_command == NULL)
     {
@@ -520,22 +579,22 @@ static espeak_ERROR push(t_espeak_command* the_command)
       return EE_INTERNAL_ERROR;
     }
 
-  if (head == NULL)
+  if (head[lane] == NULL)
     {
-      head = n;
-      tail = n;
+      head[lane] = n;
+      tail[lane] = n;
     }
   else
     {
-      tail->next = n;
-      tail = n;
+      tail[lane]->next = n;
+      tail[lane] = n;
     }
 
-  tail->next = NULL;
-  tail->data = the_command;
+  tail[lane]->next = NULL;
+  tail[lane]->data = the_command;
 
   node_counter++;
-  SHOW("push > counter=%d\n",node_counter);
+  SHOW("push > counter=%d, lane=%d\n",node_counter,lane);
 
   the_command->state = CS_PENDING;
   display_espeak_command(the_command);
@@ -543,26 +602,60 @@ static espeak_ERROR push(t_espeak_command* the_command)
   return EE_OK;
 }
 
-static t_espeak_command* pop()
+// Put the_command at the head of a lane, whatever the number of commands.
+static void push_front(t_espeak_command* the_command, int lane)
 {
-  ENTER("fifo > pop");
-  t_espeak_command* the_command = NULL;
+  ENTER("fifo > push_front");
 
-  assert((!head && !tail) || (head && tail));
+  node *n = (node *)malloc(sizeof(node));
+  if (n == NULL)
+    {
+      delete_espeak_command(the_command);
+      return;
+    }
 
-  if (head != NULL)
+  n->data = the_command;
+  n->next = head[lane];
+  head[lane] = n;
+  if (tail[lane] == NULL)
     {
-      node* n = head;
-      the_command = n->data;
-      head = n->next;
-      free(n);
-      node_counter--;
-      SHOW("pop > command=0x%x (counter=%d)\n",the_command, node_counter);
+      tail[lane] = n;
     }
 
-  if(head == NULL)
+  node_counter++;
+  SHOW("push_front > counter=%d, lane=%d\n",node_counter,lane);
+
+  the_command->state = CS_PENDING;
+  display_espeak_command(the_command);
+}
+
+// Take the first command of the highest lane which has one.
+static t_espeak_command* pop()
+{
+  ENTER("fifo > pop");
+  t_espeak_command* the_command = NULL;
+  int lane;
+
+  for (lane = N_LANES-1; lane >= 0; lane--)
     {
-      tail = NULL;
+      assert((!head[lane] && !tail[lane]) || (head[lane] && tail[lane]));
+
+      if (head[lane] != NULL)
+	{
+	  node* n = head[lane];
+	  the_command = n->data;
+	  head[lane] = n->next;
+	  free(n);
+	  node_counter--;
+	  my_command_priority = lane;
+	  SHOW("pop > command=0x%x (counter=%d, lane=%d)\n",the_command, node_counter, lane);
+
+	  if(head[lane] == NULL)
+	    {
+	      tail[lane] = NULL;
+	    }
+	  break;
+	}
     }
 
   display_espeak_command(the_command);
@@ -589,6 +682,39 @@ static void init(int process_parameters)
 }
 
 
+//>
+//<fifo_set_priority, fifo_is_preempted, fifo_resume_command
+
+void fifo_set_priority (int priority)
+{
+  ENTER("fifo_set_priority");
+
+  pthread_mutex_lock(&my_mutex);
+  my_priority = priority;
+  pthread_mutex_unlock(&my_mutex);
+}
+
+int fifo_is_preempted ()
+{
+  int a_preempted;
+
+  pthread_mutex_lock(&my_mutex);
+  a_preempted = (my_command_priority < espeakPRIORITY_HIGH) && (head[espeakPRIORITY_HIGH] != NULL);
+  pthread_mutex_unlock(&my_mutex);
+
+  SHOW("fifo_is_preempted > %d\n", a_preempted);
+  return a_preempted;
+}
+
+void fifo_resume_command (t_espeak_command* the_command)
+{
+  ENTER("fifo_resume_command");
+
+  pthread_mutex_lock(&my_mutex);
+  push_front(the_command, my_command_priority);
+  pthread_mutex_unlock(&my_mutex);
+}
+
 //>
 //<fifo_init
 void fifo_terminate()
@@ -598,6 +724,7 @@ void fifo_terminate()
   pthread_cancel(my_thread);
   pthread_join(my_thread,NULL);
   pthread_mutex_destroy(&my_mutex);
+  pthread_cond_destroy(&my_cond_is_changed);
   sem_destroy(&my_sem_start_is_required);
   sem_destroy(&my_sem_stop_is_acknowledged);
 
@@ -90,4 +90,8 @@ int  GetFileLength(const char *filename);
 char *Alloc(int size);
 void Free(void *ptr);
 void espeakSleep(unsigned int _ms);
+
+// the counters for espeak_GetStats(), which one thread adds to while another reads them
+#define STATS_LOAD(x)     __atomic_load_n(&(x), __ATOMIC_RELAXED)
+#define STATS_STORE(x,v)  __atomic_store_n(&(x), (v), __ATOMIC_RELAXED)
 #endif // SPEECH_H
@@ -30,6 +30,9 @@
 #include <assert.h>
 #include <sys/time.h>
 #include <time.h>
+#include <errno.h>
+#include <pthread.h>
+#include <semaphore.h>
 
 #include "portaudio.h"
 #ifdef PLATFORM_WINDOWS
@@ -63,7 +66,7 @@ enum {ONE_BILLION=1000000000};
 #define USE_PORTAUDIO   18
 #endif
 
-
+#define IDLE_CHECK_TIMEOUT 50   // ms, for an output which doesn't tell when it has finished
 
 
 #ifdef USE_PULSEAUDIO
@@ -82,9 +85,13 @@ void wave_port_terminate();
 uint32_t wave_port_get_read_position(void* theHandler);
 uint32_t wave_port_get_write_position(void* theHandler);
 void wave_port_flush(void* theHandler);
+void wave_port_abort(void* theHandler);
 void wave_port_set_callback_is_output_enabled(t_wave_callback* cb);
 void* wave_port_test_get_write_buffer();
 int wave_port_get_remaining_time(uint32_t sample, uint32_t* time);
+int wave_port_get_sample_time(uint32_t sample, struct timespec* the_time);
+void wave_port_get_xruns(uint32_t* underruns, uint32_t* overruns);
+int wave_port_wait_idle(void* theHandler, const struct timespec* the_end);
 
 // wave_pulse.cpp
 int is_pulse_running();
@@ -167,6 +174,12 @@ void wave_flush(void* theHandler) {
     wave_port_flush(theHandler);
 }
 
+void wave_abort(void* theHandler) {
+  // the PulseAudio output stops writing when the output is no longer enabled
+  if (!pulse_running)
+    wave_port_abort(theHandler);
+}
+
 void wave_set_callback_is_output_enabled(t_wave_callback* cb) {
   if (pulse_running)
     wave_pulse_set_callback_is_output_enabled(cb);
@@ -189,6 +202,54 @@ int wave_get_remaining_time(uint32_t sample, uint32_t* time)
     return wave_port_get_remaining_time(sample, time);
 }
 
+void wave_get_xruns(uint32_t* underruns, uint32_t* overruns)
+{
+  // the PulseAudio output has its own buffering
+  if (pulse_running)
+    *underruns = *overruns = 0;
+  else
+    wave_port_get_xruns(underruns, overruns);
+}
+
+int wave_get_sample_time(uint32_t sample, struct timespec* the_time)
+{
+  if (pulse_running)
+    {
+      // the PulseAudio output gives only the remaining time, in ms
+      uint32_t a_time = 0;
+      if (wave_pulse_get_remaining_time(sample, &a_time) != 0)
+	return -1;
+      if ((a_time > 0) && !wave_pulse_is_busy(NULL))
+	return 1;
+      clock_gettime_mono(the_time);
+      add_time_in_ms(the_time, a_time);
+      return 0;
+    }
+  else
+    return wave_port_get_sample_time(sample, the_time);
+}
+
+int wave_wait_idle(void* theHandler, const struct timespec* the_end)
+{
+  if (pulse_running)
+    {
+      // the PulseAudio output gives no notification, check it from time to time
+      struct timespec ts;
+      while (wave_pulse_is_busy(theHandler))
+	{
+	  clock_gettime2(&ts);
+	  if (the_end && !time_is_before(&ts, the_end))
+	    {
+	      return 1;
+	    }
+	  espeakSleep(IDLE_CHECK_TIMEOUT);
+	}
+      return 0;
+    }
+  else
+    return wave_port_wait_idle(theHandler, the_end);
+}
+
 // rename functions to be wrapped
 #define wave_init wave_port_init
 #define wave_open wave_port_open
@@ -199,9 +260,13 @@ int wave_get_remaining_time(uint32_t sample, uint32_t* time)
 #define wave_get_read_position wave_port_get_read_position
 #define wave_get_write_position wave_port_get_write_position
 #define wave_flush wave_port_flush
+#define wave_abort wave_port_abort
 #define wave_set_callback_is_output_enabled wave_port_set_callback_is_output_enabled
 #define wave_test_get_write_buffer wave_port_test_get_write_buffer
 #define wave_get_remaining_time wave_port_get_remaining_time
+#define wave_get_sample_time wave_port_get_sample_time
+#define wave_get_xruns wave_port_get_xruns
+#define wave_wait_idle wave_port_wait_idle
 
 #endif  // USE_PULSEAUDIO
 
@@ -209,13 +274,45 @@ int wave_get_remaining_time(uint32_t sample, uint32_t* time)
 static t_wave_callback* my_callback_is_output_enabled=NULL;
 
 #define N_WAV_BUF   10
-#define MAX_SAMPLE_RATE 22050
 #define FRAMES_PER_BUFFER 512
-#define BUFFER_LENGTH (MAX_SAMPLE_RATE*2*sizeof(uint16_t))
-//#define THRESHOLD (BUFFER_LENGTH/5)
-static char myBuffer[BUFFER_LENGTH];
-static char* myRead=NULL;
-static char* myWrite=NULL;
+#define RING_LENGTH 0x20000     // bytes, a power of 2, the space for RING_TARGET_MS at 48000Hz stereo or less
+#define RING_TARGET_MS 1000     // the sound which wave_write() may queue ahead of the audio output
+#define CACHE_LINE 64
+#define RING_WAIT_TIMEOUT 20    // ms, wave_write() checks whether output is still enabled
+
+// The ring buffer has one writer, wave_write(), and one reader, pa_callback().
+// They share only the counts of bytes written and read, each of which is changed
+// by one side only: it's stored with release ordering after the sound data, and
+// loaded by the other side with acquire ordering, so no lock is needed.  The
+// counts are on separate cache lines, so the two threads don't contend for one.
+// They wrap at 2^32, which is a multiple of RING_LENGTH.
+// The writer_waiting handshake stores one variable and then loads the other, on each side,
+// which needs RING_FENCE() between them so that a wakeup isn't lost.
+#define RING_LOAD(x)      __atomic_load_n(&(x), __ATOMIC_ACQUIRE)
+#define RING_STORE(x, v)  __atomic_store_n(&(x), (v), __ATOMIC_RELEASE)
+#define RING_FENCE()      __atomic_thread_fence(__ATOMIC_SEQ_CST)
+
+static struct {
+	char data[RING_LENGTH];
+	uint32_t written;
+	char pad1[CACHE_LINE - sizeof(uint32_t)];
+	uint32_t read;
+	char pad2[CACHE_LINE - sizeof(uint32_t)];
+	int writer_waiting;     // wave_write() is waiting for space, pa_callback() is to post my_sem_ring_space
+	int flushed;            // wave_flush() has been called since the last wave_write()
+	int aborted;            // wave_abort(): play silence and write nothing, until wave_close()
+	uint32_t underruns;     // pa_callback() ran out of sound which was still to come
+	uint32_t overruns;      // wave_write() found the ring full
+} ring;
+
+static sem_t my_sem_ring_space;
+static int my_sem_ring_space_ok = 0;
+
+// wave_wait_idle() waits on my_cond_is_finished, which is broadcast when the
+// stream has played its last sample, and when it's closed.
+static pthread_mutex_t my_mutex_is_finished = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t my_cond_is_finished = PTHREAD_COND_INITIALIZER;
+
 static int out_channels=1;
 static int my_stream_could_start=0;
 static int wave_samplerate;
@@ -242,37 +339,70 @@ static PaError pa_init_err=0;
 static uint32_t myReadPosition = 0; // in ms
 static uint32_t myWritePosition = 0;
 
+// The audio clock: the time on the monotonic clock at which the first sample of
+// the buffer which pa_callback() has just filled reaches the output (DAC), from
+// the time information which PortAudio gives to the callback.  It's written by
+// pa_callback() and read by wave_get_sample_time(), which retries if seq was
+// odd (being written) or has changed meanwhile.
+static struct {
+  uint32_t seq;
+  int state;            // 0 = not set since the stream was started, 1 = playing,
+                        // 2 = the buffer is the last, the stream then stops
+  uint32_t sample;      // the first sample of the buffer
+  uint32_t end;         // the sample after the buffer
+  int64_t time_ns;      // when the first sample is played
+} audio_clock;
+
+#define CLOCK_STORE(x, v)  __atomic_store_n(&(x), (v), __ATOMIC_RELAXED)
+#define CLOCK_LOAD(x)      __atomic_load_n(&(x), __ATOMIC_RELAXED)
+
+static void set_audio_clock(int state, uint32_t sample, uint32_t end, int64_t time_ns)
+{
+  uint32_t seq = audio_clock.seq;   // only one thread writes at a time
+
+  CLOCK_STORE(audio_clock.seq, seq + 1);
+  __atomic_thread_fence(__ATOMIC_RELEASE);
+  CLOCK_STORE(audio_clock.state, state);
+  CLOCK_STORE(audio_clock.sample, sample);
+  CLOCK_STORE(audio_clock.end, end);
+  CLOCK_STORE(audio_clock.time_ns, time_ns);
+  __atomic_store_n(&audio_clock.seq, seq + 2, __ATOMIC_RELEASE);
+}
+
 //>
 //<init_buffer, get_used_mem
 
 static void init_buffer()
 {
-  myWrite = myBuffer;
-  myRead = myBuffer;
-  memset(myBuffer,0,BUFFER_LENGTH);
+  // the stream is not running, so pa_callback() doesn't use the ring
+  RING_STORE(ring.written, 0);
+  RING_STORE(ring.read, 0);
+  RING_STORE(ring.flushed, 0);
+  RING_STORE(ring.aborted, 0);
+  memset(ring.data,0,RING_LENGTH);
   myReadPosition = myWritePosition = 0;
-  SHOW("init_buffer > myRead=0x%x, myWrite=0x%x, BUFFER_LENGTH=0x%x, myReadPosition = myWritePosition = 0\n", (size_t)myRead, (size_t)myWrite, BUFFER_LENGTH);
+  set_audio_clock(0, 0, 0, 0);
+  SHOW("init_buffer > RING_LENGTH=0x%x, myReadPosition = myWritePosition = 0\n", RING_LENGTH);
 }
 
-static unsigned int get_used_mem()
+// The bytes of the ring which are used, RING_TARGET_MS of sound at the stream's rate,
+// so that little sound is queued ahead of the audio output (e.g. before a text of high priority).
+static uint32_t ring_capacity()
 {
-  char* aRead = myRead;
-  char* aWrite = myWrite;
-  unsigned int used = 0;
-
-  assert ((aRead >= myBuffer)
-	  && (aRead <= myBuffer + BUFFER_LENGTH)
-	  && (aWrite >= myBuffer)
-	  && (aWrite <= myBuffer + BUFFER_LENGTH));
+  uint32_t n = (uint32_t)wave_samplerate * out_channels * sizeof(uint16_t) * RING_TARGET_MS / 1000;
 
-  if (aRead < aWrite)
+  if ((n == 0) || (n > RING_LENGTH))
     {
-      used = aWrite - aRead;
-    }
-  else
-    {
-      used = aWrite + BUFFER_LENGTH - aRead;
+      n = RING_LENGTH;
     }
+  return n;
+}
+
+static unsigned int get_used_mem()
+{
+  unsigned int used = RING_LOAD(ring.written) - RING_LOAD(ring.read);
+
+  assert (used <= RING_LENGTH);
   SHOW("get_used_mem > %d\n", used);
 
   return used;
@@ -288,6 +418,7 @@ static void start_stream()
 
   my_stream_could_start=0;
   mInCallbackFinishedState = 0;
+  set_audio_clock(0, myReadPosition, myReadPosition, 0);   // until pa_callback() sets it
 
   err = Pa_StartStream(pa_stream);
   SHOW("start_stream > Pa_StartStream=%d (%s)\n", err, Pa_GetErrorText(err));
@@ -323,88 +454,73 @@ static int pa_callback(void *inputBuffer, void *outputBuffer,
 #endif
 {
 	int aResult=0; // paContinue
-	char* aWrite = myWrite;
 	size_t n = out_channels*sizeof(uint16_t)*framesPerBuffer;
+	uint32_t aRead = ring.read;   // only changed by this thread
+	uint32_t aUsedMem = RING_LOAD(ring.written) - aRead;
+	uint32_t ix = aRead & (RING_LENGTH-1);
+	size_t aCopy = n;
+	size_t aTopMem;
+	struct timespec now;
+	double latency = 0;   // seconds, until the start of this buffer is played
+
+	if (RING_LOAD(ring.aborted))
+	{
+		// stop at once, the rest of the sound isn't wanted
+		memset(outputBuffer, 0, n);
+		mInCallbackFinishedState = 1;
+		return(1); // paComplete
+	}
 
-	myReadPosition += framesPerBuffer;
-	SHOW("pa_callback > myReadPosition=%u, framesPerBuffer=%lu (n=0x%x) \n",(int)myReadPosition, framesPerBuffer, n);
-
-	if (aWrite >= myRead)
+	clock_gettime_mono(&now);
+#if USE_PORTAUDIO == 19
+	if (outTime && (outTime->outputBufferDacTime > outTime->currentTime))
 	{
-		if((size_t)(aWrite - myRead) >= n)
-		{
-			memcpy(outputBuffer, myRead, n);
-			myRead += n;
-		}
-		else
-		{
-			SHOW_TIME("pa_callback > underflow");
-			aResult=1; // paComplete;
-			mInCallbackFinishedState = 1;
-			size_t aUsedMem=0;
-			aUsedMem = (size_t)(aWrite - myRead);
-			if (aUsedMem)
-			{
-				memcpy(outputBuffer, myRead, aUsedMem);
-			}
-			char* p = (char*)outputBuffer + aUsedMem;
-			memset(p, 0, n - aUsedMem);
-			//	  myReadPosition += aUsedMem/(out_channels*sizeof(uint16_t));
-			myRead = aWrite;
-		}
+		latency = outTime->outputBufferDacTime - outTime->currentTime;
 	}
-	else // myRead > aWrite
+#endif
+
+	if (aUsedMem < n)
 	{
-		if ((size_t)(myBuffer + BUFFER_LENGTH - myRead) >= n)
-		{
-			memcpy(outputBuffer, myRead, n);
-			myRead += n;
-		}
-		else if ((size_t)(aWrite + BUFFER_LENGTH - myRead) >= n)
+		SHOW_TIME("pa_callback > underflow");
+		if (RING_LOAD(ring.flushed) == 0)
 		{
-			int aTopMem = myBuffer + BUFFER_LENGTH - myRead;
-			if (aTopMem)
-			{
-				SHOW("pa_callback > myRead=0x%x, aTopMem=0x%x\n",(size_t)myRead, (int)aTopMem);
-				memcpy(outputBuffer, myRead, aTopMem);
-			}
-			int aRest = n - aTopMem;
-			if (aRest)
-			{
-				SHOW("pa_callback > myRead=0x%x, aRest=0x%x\n",(size_t)myRead, (int)aRest);
-				char* p = (char*)outputBuffer + aTopMem;
-				memcpy(p, myBuffer, aRest);
-			}
-			myRead = myBuffer + aRest;
+			// wave_write() has more sound, which didn't arrive in time
+			RING_STORE(ring.underruns, ring.underruns + 1);
 		}
-		else
-		{
-			SHOW_TIME("pa_callback > underflow");
-			aResult=1; // paComplete;
+		aResult=1; // paComplete;
+		mInCallbackFinishedState = 1;
+		aCopy = aUsedMem;
+		memset((char*)outputBuffer + aCopy, 0, n - aCopy);
+	}
 
-			int aTopMem = myBuffer + BUFFER_LENGTH - myRead;
-			if (aTopMem)
-			{
-				SHOW("pa_callback > myRead=0x%x, aTopMem=0x%x\n",(size_t)myRead, (int)aTopMem);
-				memcpy(outputBuffer, myRead, aTopMem);
-			}
-			int aRest = aWrite - myBuffer;
-			if (aRest)
-			{
-				SHOW("pa_callback > myRead=0x%x, aRest=0x%x\n",(size_t)myRead, (int)aRest);
-				char* p = (char*)outputBuffer + aTopMem;
-				memcpy(p, myBuffer, aRest);
-			}
+	// Count only the sound which was copied, not the silence after it, so that
+	// when the stream is started again the next sample written is the next played.
+	set_audio_clock(aResult ? 2 : 1, myReadPosition, myReadPosition + aCopy/(out_channels*sizeof(uint16_t)),
+			(int64_t)now.tv_sec * ONE_BILLION + now.tv_nsec + (int64_t)(latency * ONE_BILLION));
+	myReadPosition += aCopy/(out_channels*sizeof(uint16_t));
+	SHOW("pa_callback > myReadPosition=%u, framesPerBuffer=%lu (n=0x%x) \n",(int)myReadPosition, framesPerBuffer, n);
 
-			size_t aUsedMem = aTopMem + aRest;
-			char* p = (char*)outputBuffer + aUsedMem;
-			memset(p, 0, n - aUsedMem);
-			//	  myReadPosition += aUsedMem/(out_channels*sizeof(uint16_t));
-			myRead = aWrite;
-		}
+	aTopMem = RING_LENGTH - ix;
+	if (aTopMem >= aCopy)
+	{
+		memcpy(outputBuffer, &ring.data[ix], aCopy);
 	}
+	else
+	{
+		// wrap around at the end of the ring
+		memcpy(outputBuffer, &ring.data[ix], aTopMem);
+		memcpy((char*)outputBuffer + aTopMem, ring.data, aCopy - aTopMem);
+	}
+	RING_STORE(ring.read, aRead + aCopy);
 
-	SHOW("pa_callback > myRead=%x\n",(size_t)myRead);
+	RING_FENCE();   // the store of read before the load of writer_waiting
+	if (RING_LOAD(ring.writer_waiting))
+	{
+		RING_STORE(ring.writer_waiting, 0);
+		sem_post(&my_sem_ring_space);
+	}
+
+	SHOW("pa_callback > read=%x\n",(unsigned int)(aRead + aCopy));
 
 
   // #if USE_PORTAUDIO == 18
@@ -447,6 +563,26 @@ static int pa_callback(void *inputBuffer, void *outputBuffer,
 
 }  //  end of WaveCallBack
 
+//>
+//<pa_finished_callback
+
+static void notify_is_finished()
+{
+  pthread_mutex_lock(&my_mutex_is_finished);
+  pthread_cond_broadcast(&my_cond_is_finished);
+  pthread_mutex_unlock(&my_mutex_is_finished);
+}
+
+#if USE_PORTAUDIO == 19
+// Called by PortAudio when the stream becomes inactive, after the buffer in
+// which pa_callback() returned paComplete has been played.
+static void pa_finished_callback(void *userData)
+{
+  SHOW_TIME("pa_finished_callback");
+  notify_is_finished();
+}
+#endif
+
 //>
 
 
@@ -454,6 +590,9 @@ void wave_flush(void* theHandler)
 {
   ENTER("wave_flush");
 
+  // there is no more sound to come, so running out of it is not an underrun
+  RING_STORE(ring.flushed, 1);
+
   if (my_stream_could_start)
     {
 //       #define buf 1024
@@ -464,6 +603,31 @@ void wave_flush(void* theHandler)
     }
 }
 
+//<wave_abort
+
+void wave_abort(void* theHandler)
+{
+  ENTER("wave_abort");
+
+  // pa_callback() plays silence from its next buffer, and a wave_write() which
+  // is waiting for space returns at once
+  RING_STORE(ring.aborted, 1);
+  if (my_sem_ring_space_ok)
+    {
+      sem_post(&my_sem_ring_space);
+    }
+}
+
+// The stream has stopped after wave_abort(): drop the sound left in the ring.
+static void end_abort()
+{
+  if (RING_LOAD(ring.aborted))
+    {
+      init_buffer();
+    }
+}
+
+//>
 //<wave_open_sound
 
 static int wave_open_sound()
@@ -590,6 +754,10 @@ static int wave_open_sound()
 
 	  //	  err = Pa_OpenDefaultStream(&pa_stream,0,2,paInt16,(double)wave_samplerate,FRAMES_PER_BUFFER,pa_callback,(void *)userdata);
 	}
+      if (err == paNoError)
+	{
+	  Pa_SetStreamFinishedCallback(pa_stream, pa_finished_callback);
+	}
       mInCallbackFinishedState = 0;
 #endif
     }
@@ -776,6 +944,14 @@ int wave_init(int srate)
   mInCallbackFinishedState = 0;
   init_buffer();
 
+  if (!my_sem_ring_space_ok)
+    {
+      // not inside assert(), which NDEBUG removes
+      int a_status = sem_init(&my_sem_ring_space, 0, 0);
+      assert(a_status != -1);
+      my_sem_ring_space_ok = (a_status != -1);
+    }
+
   // PortAudio sound output library
   err = Pa_Initialize();
   pa_init_err = err;
@@ -820,13 +996,13 @@ static size_t copyBuffer(char* dest, char* src, const size_t theSizeInBytes)
 		// copy for one channel (mono)?
 		if(out_channels==1)
 		{
-			SHOW("copyBuffer > 1 channel > memcpy %x (%d bytes)\n", (size_t)myWrite, theSizeInBytes);
+			SHOW("copyBuffer > 1 channel > memcpy %x (%d bytes)\n", (size_t)dest, theSizeInBytes);
 			memcpy(dest, src, theSizeInBytes);
 			bytes_written = theSizeInBytes;
 		}
 		else // copy for 2 channels (stereo)
 		{
-			SHOW("copyBuffer > 2 channels > memcpy %x (%d bytes)\n", (size_t)myWrite, theSizeInBytes);
+			SHOW("copyBuffer > 2 channels > memcpy %x (%d bytes)\n", (size_t)dest, theSizeInBytes);
 			i = 0;
 			a_dest = (uint16_t* )dest;
 			a_src = (uint16_t* )src;
@@ -854,6 +1030,12 @@ size_t wave_write(void* theHandler, char* theMono16BitsWaveBuffer, size_t theSiz
 	size_t bytes_to_write = (out_channels==1) ? theSize : theSize*2;
 	my_stream_could_start = 0;
 
+	if (RING_LOAD(ring.aborted))
+	{
+		SHOW_TIME("wave_write > aborted");
+		return 0;
+	}
+
 	if(pa_stream == NULL)
 	{
 		SHOW_TIME("wave_write > wave_open_sound\n");
@@ -868,93 +1050,73 @@ size_t wave_write(void* theHandler, char* theMono16BitsWaveBuffer, size_t theSiz
 	{
 		my_stream_could_start = 1;
 	}
-	assert(BUFFER_LENGTH >= bytes_to_write);
+	assert(RING_LENGTH >= bytes_to_write);
+	RING_STORE(ring.flushed, 0);
 
-	if (myWrite >= myBuffer + BUFFER_LENGTH)
+	uint32_t aCapacity = ring_capacity();
+	if (aCapacity < bytes_to_write)
 	{
-		myWrite = myBuffer;
-	} // end if (myWrite >= myBuffer + BUFFER_LENGTH)
+		aCapacity = bytes_to_write;
+	}
 
-	size_t aTotalFreeMem=0;
-	char* aRead = myRead;
-	SHOW("wave_write > aRead=%x, myWrite=%x\n", (size_t)aRead, (size_t)myWrite);
+	uint32_t aWrite = ring.written;   // only changed by this thread
+	int aWaited = 0;
+	SHOW("wave_write > read=%x, written=%x\n", (unsigned int)RING_LOAD(ring.read), (unsigned int)aWrite);
 
-	while (1)
+	while ((aWrite - RING_LOAD(ring.read)) + bytes_to_write > aCapacity)
 	{
-		if (my_callback_is_output_enabled && (0==my_callback_is_output_enabled()))
+		if ((my_callback_is_output_enabled && (0==my_callback_is_output_enabled()))
+			|| RING_LOAD(ring.aborted))
 		{
 			SHOW_TIME("wave_write > my_callback_is_output_enabled: no!");
 			return 0;
 		}
 
-		aRead = myRead;
-
-		// write pointer is before read pointer?
-		if (myWrite >= aRead)
+		if (my_stream_could_start)
 		{
-			aTotalFreeMem = aRead + BUFFER_LENGTH - myWrite;
+			// the ring is full, so start playing it
+			start_stream();
 		}
-		else // read pointer is before write pointer!
-		{
-			aTotalFreeMem = aRead - myWrite;
-		} // end if (myWrite >= aRead)
-
-		if (aTotalFreeMem>1)
-		{
-			// -1 because myWrite must be different of aRead
-			// otherwise buffer would be considered as empty
-			aTotalFreeMem -= 1;
-		} // end if (aTotalFreeMem>1)
 
-		if (aTotalFreeMem >= bytes_to_write)
+		// wait until pa_callback() has taken some sound from the ring.
+		// Check again after asking it to post, in case it did so in between.
+		RING_STORE(ring.writer_waiting, 1);
+		RING_FENCE();   // the store of writer_waiting before the load of read
+		if ((aWrite - RING_LOAD(ring.read)) + bytes_to_write <= aCapacity)
 		{
 			break;
-		} // end if (aTotalFreeMem >= bytes_to_write)
-
-		//SHOW_TIME("wave_write > wait");
-		SHOW("wave_write > wait: aTotalFreeMem=%d\n", aTotalFreeMem);
-		SHOW("wave_write > aRead=%x, myWrite=%x\n", (size_t)aRead, (size_t)myWrite);
-        espeakSleep(10);
-	} // end while (1)
-
-	aRead = myRead;
-
-	// write pointer is ahead the read pointer?
-	if (myWrite >= aRead)
-	{
-		SHOW_TIME("wave_write > myWrite >= aRead");
-		// determine remaining free memory to the end of the ringbuffer
-		size_t aFreeMem = myBuffer + BUFFER_LENGTH - myWrite;
-		// is enough linear space available (regardless 1 or 2 channels)?
-		if (aFreeMem >= bytes_to_write)
+		}
+		if (aWaited++ == 0)
 		{
-			// copy direct - no wrap around at end of ringbuffer needed
-			myWrite += copyBuffer(myWrite, theMono16BitsWaveBuffer, theSize);
+			RING_STORE(ring.overruns, ring.overruns + 1);
 		}
-		else // not enough linear space available
+
+		SHOW("wave_write > wait: used=%d\n", aWrite - RING_LOAD(ring.read));
+		struct timespec ts;
+		clock_gettime2(&ts);
+		add_time_in_ms(&ts, RING_WAIT_TIMEOUT);
+		while ((sem_timedwait(&my_sem_ring_space, &ts) == -1) && (errno == EINTR))
 		{
-			// 2 channels (stereo)?
-			if (out_channels == 2)
-			{
-				// copy with wrap around at the end of ringbuffer
-				copyBuffer(myWrite, theMono16BitsWaveBuffer, aFreeMem/2);
-				myWrite = myBuffer;
-				myWrite += copyBuffer(myWrite, theMono16BitsWaveBuffer+aFreeMem/2, theSize - aFreeMem/2);
-			}
-			else // 1 channel (mono)
-			{
-				// copy with wrap around at the end of ringbuffer
-				copyBuffer(myWrite, theMono16BitsWaveBuffer, aFreeMem);
-				myWrite = myBuffer;
-				myWrite += copyBuffer(myWrite, theMono16BitsWaveBuffer+aFreeMem, theSize - aFreeMem);
-			} // end if (out_channels == 2)
-		} // end if (aFreeMem >= bytes_to_write)
-	} // if (myWrite >= aRead)
-	else // read pointer is ahead the write pointer
+			continue; // Restart when interrupted by handler
+		}
+	} // end while
+
+	uint32_t ix = aWrite & (RING_LENGTH-1);
+	size_t aFreeMem = RING_LENGTH - ix;   // space to the end of the ring
+	if (aFreeMem >= bytes_to_write)
 	{
-		SHOW_TIME("wave_write > myWrite <= aRead");
-		myWrite += copyBuffer(myWrite, theMono16BitsWaveBuffer, theSize);
-	} // end if (myWrite >= aRead)
+		// copy direct - no wrap around at end of ringbuffer needed
+		copyBuffer(&ring.data[ix], theMono16BitsWaveBuffer, theSize);
+	}
+	else
+	{
+		// copy with wrap around at the end of ringbuffer.
+		// aFreeMem is a whole number of frames, as are all the writes.
+		size_t aSrcSize = (out_channels == 2) ? aFreeMem/2 : aFreeMem;
+		copyBuffer(&ring.data[ix], theMono16BitsWaveBuffer, aSrcSize);
+		copyBuffer(ring.data, theMono16BitsWaveBuffer+aSrcSize, theSize - aSrcSize);
+	}
+	RING_STORE(ring.written, aWrite + bytes_to_write);
 
 	bytes_written = bytes_to_write;
 	myWritePosition += theSize/sizeof(uint16_t); // add number of samples
@@ -982,24 +1144,28 @@ int wave_close(void* theHandler)
   if( pa_stream == NULL )
     {
       SHOW_TIME("wave_close > LEAVE (NULL stream)");
+      end_abort();
       return 0;
     }
 
   if( Pa_IsStreamStopped( pa_stream ) )
     {
       SHOW_TIME("wave_close > LEAVE (stopped)");
+      end_abort();
       return 0;
     }
 #else
   if( pa_stream == NULL )
     {
       SHOW_TIME("wave_close > LEAVE (NULL stream)");
+      end_abort();
       return 0;
     }
 
   if( Pa_StreamActive( pa_stream ) == 0 && mInCallbackFinishedState == 0 )
     {
       SHOW_TIME("wave_close > LEAVE (not active)");
+      end_abort();
       return 0;
     }
 #endif
@@ -1047,9 +1213,12 @@ int wave_close(void* theHandler)
       Pa_AbortStream( pa_stream );
       SHOW_TIME("wave_close > Pa_AbortStream (end)");
 
+      // not while wave_wait_idle() is looking at the stream
+      pthread_mutex_lock(&my_mutex_is_finished);
       Pa_CloseStream( pa_stream );
       SHOW_TIME("wave_close > Pa_CloseStream (end)");
       pa_stream = NULL;
+      pthread_mutex_unlock(&my_mutex_is_finished);
       mInCallbackFinishedState = 0;
     }
 #else
@@ -1065,14 +1234,17 @@ int wave_close(void* theHandler)
 	  Pa_AbortStream( pa_stream );
 	  SHOW_TIME("wave_close > Pa_AbortStream (end)");
 	}
+      pthread_mutex_lock(&my_mutex_is_finished);
       Pa_CloseStream( pa_stream );
       SHOW_TIME("wave_close > Pa_CloseStream (end)");
 
       pa_stream = NULL;
+      pthread_mutex_unlock(&my_mutex_is_finished);
       mInCallbackFinishedState = 0;
     }
 #endif
   init_buffer();
+  notify_is_finished();
 
   aStopStreamCount = 0; // last action
   SHOW_TIME("wave_close > LEAVE");
@@ -1138,6 +1310,65 @@ int wave_is_busy(void* theHandler)
   return (active==1);
 }
 
+//>
+//<wave_wait_idle
+
+static int is_playing()
+{
+  if (pa_stream == NULL)
+    {
+      return 0;
+    }
+#if USE_PORTAUDIO == 19
+  // wave_is_busy() is 0 once pa_callback() has returned paComplete, but the
+  // stream stays active until the sound which it has been given is played
+  return (Pa_IsStreamActive(pa_stream) == 1);
+#else
+  return wave_is_busy(NULL);
+#endif
+}
+
+int wave_wait_idle(void* theHandler, const struct timespec* the_end)
+{
+  ENTER("wave_wait_idle");
+
+  int a_busy;
+  int err = 0;
+
+  pthread_mutex_lock(&my_mutex_is_finished);
+  while ((a_busy = is_playing()) && (err != ETIMEDOUT))
+    {
+#if USE_PORTAUDIO == 19
+      if (the_end == NULL)
+	{
+	  err = pthread_cond_wait(&my_cond_is_finished, &my_mutex_is_finished);
+	}
+      else
+	{
+	  err = pthread_cond_timedwait(&my_cond_is_finished, &my_mutex_is_finished, the_end);
+	}
+#else
+      // there is no notification when the sound has been played, check from time to time
+      struct timespec ts;
+      clock_gettime2(&ts);
+      add_time_in_ms(&ts, IDLE_CHECK_TIMEOUT);
+      if (the_end && !time_is_before(&ts, the_end))
+	{
+	  ts = *the_end;
+	}
+      err = pthread_cond_timedwait(&my_cond_is_finished, &my_mutex_is_finished, &ts);
+      if ((err == ETIMEDOUT) && ((the_end == NULL) || time_is_before(&ts, the_end)))
+	{
+	  err = 0;
+	}
+#endif
+    }
+  pthread_mutex_unlock(&my_mutex_is_finished);
+
+  SHOW("wave_wait_idle > busy=%d\n", a_busy);
+  return a_busy;
+}
+
 //>
 //<wave_terminate
 
@@ -1192,12 +1423,57 @@ int wave_get_remaining_time(uint32_t sample, uint32_t* time)
   return 0;
 }
 
+int wave_get_sample_time(uint32_t sample, struct timespec* the_time)
+{
+  uint32_t seq;
+  int state;
+  uint32_t a_sample;
+  uint32_t a_end;
+  int64_t a_time;
+
+  if (!the_time || !pa_stream)
+    {
+      return -1;
+    }
+
+  do
+    {
+      seq = __atomic_load_n(&audio_clock.seq, __ATOMIC_ACQUIRE);
+      state = CLOCK_LOAD(audio_clock.state);
+      a_sample = CLOCK_LOAD(audio_clock.sample);
+      a_end = CLOCK_LOAD(audio_clock.end);
+      a_time = CLOCK_LOAD(audio_clock.time_ns);
+      __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    }
+  while ((seq & 1) || (seq != CLOCK_LOAD(audio_clock.seq)));
+
+  // Samples after the buffer are played at the same rate, unless it's the last
+  // before the stream stops: then they wait until it's started again.
+  if ((state == 0) || ((state == 2) && ((int32_t)(sample - a_end) > 0)))
+    {
+      return 1;
+    }
+
+  a_time += ((int64_t)(int32_t)(sample - a_sample) * ONE_BILLION) / wave_samplerate;
+  the_time->tv_sec = a_time / ONE_BILLION;
+  the_time->tv_nsec = a_time % ONE_BILLION;
+
+  SHOW("wave_get_sample_time > sample=%u, time=%d.%09ld\n", sample, (int)the_time->tv_sec, the_time->tv_nsec);
+  return 0;
+}
+
+void wave_get_xruns(uint32_t* underruns, uint32_t* overruns)
+{
+  *underruns = RING_LOAD(ring.underruns);
+  *overruns = RING_LOAD(ring.overruns);
+}
+
 //>
 //<wave_test_get_write_buffer
 
 void *wave_test_get_write_buffer()
 {
-  return myWrite;
+  return &ring.data[ring.written & (RING_LENGTH-1)];
 }
 
 
@@ -1214,9 +1490,19 @@ void wave_terminate() {}
 uint32_t wave_get_read_position(void* theHandler) {return 0;}
 uint32_t wave_get_write_position(void* theHandler) {return 0;}
 void wave_flush(void* theHandler) {}
+void wave_abort(void* theHandler) {}
 typedef int (t_wave_callback)(void);
 void wave_set_callback_is_output_enabled(t_wave_callback* cb) {}
 extern void* wave_test_get_write_buffer() {return NULL;}
+void wave_get_xruns(uint32_t* underruns, uint32_t* overruns) {*underruns = *overruns = 0;}
+int wave_wait_idle(void* theHandler, const struct timespec* the_end) {return 0;}
+
+int wave_get_sample_time(uint32_t sample, struct timespec* the_time)
+{
+	if (!the_time) return(-1);
+	clock_gettime_mono(the_time);
+	return 0;
+}
 
 int wave_get_remaining_time(uint32_t sample, uint32_t* time)
 {
@@ -1228,7 +1514,7 @@ int wave_get_remaining_time(uint32_t sample, uint32_t* time)
 #endif  // of USE_PORTAUDIO
 
 //>
-//<clock_gettime2, add_time_in_ms
+//<clock_gettime2, clock_gettime_mono, add_time_in_ms, time_is_before
 
 void clock_gettime2(struct timespec *ts)
 {
@@ -1239,11 +1525,26 @@ void clock_gettime2(struct timespec *ts)
       return;
     }
 
-  assert (gettimeofday(&tv, NULL) != -1);
+  // not inside assert(), which NDEBUG removes
+  int a_status = gettimeofday(&tv, NULL);
+  assert (a_status != -1);
+  (void)a_status;
   ts->tv_sec = tv.tv_sec;
   ts->tv_nsec = tv.tv_usec*1000;
 }
 
+void clock_gettime_mono(struct timespec *ts)
+{
+  if (!ts)
+    {
+      return;
+    }
+
+  int a_status = clock_gettime(CLOCK_MONOTONIC, ts);
+  assert (a_status != -1);
+  (void)a_status;
+}
+
 void add_time_in_ms(struct timespec *ts, int time_in_ms)
 {
   if (!ts)
@@ -1261,6 +1562,46 @@ void add_time_in_ms(struct timespec *ts, int time_in_ms)
   ts->tv_nsec = (long int)t_ns;
 }
 
+int time_is_before(const struct timespec *ts, const struct timespec *the_end)
+{
+  return (ts->tv_sec < the_end->tv_sec)
+    || ((ts->tv_sec == the_end->tv_sec) && (ts->tv_nsec < the_end->tv_nsec));
+}
+
+//>
+//<wave_signal_sound_wanted, wave_wait_sound_wanted
+
+static sem_t my_sem_sound_wanted;
+static int my_sem_sound_wanted_ok = 0;
+
+void wave_signal_sound_wanted()
+{
+  if (my_sem_sound_wanted_ok)
+    {
+      sem_post(&my_sem_sound_wanted);
+    }
+}
+
+void wave_wait_sound_wanted(int timeout)
+{
+  struct timespec ts;
+
+  if (!my_sem_sound_wanted_ok)
+    {
+      my_sem_sound_wanted_ok = (sem_init(&my_sem_sound_wanted, 0, 0) != -1);
+      if (!my_sem_sound_wanted_ok)
+        {
+          return;
+        }
+    }
+  clock_gettime2(&ts);
+  add_time_in_ms(&ts, timeout);
+  while ((sem_timedwait(&my_sem_sound_wanted, &ts) == -1) && (errno == EINTR))
+    {
+      continue; // Restart when interrupted by handler
+    }
+}
+
 
 #endif   // USE_ASYNC
 
@@ -577,7 +577,9 @@ static void frame_init(klatt_frame_ptr frame) {
     static double amp_par_factor[7] = {0.6, 0.4, 0.15, 0.06, 0.04, 0.022, 0.03};
     long Gain0_tmp;
     int ix;
+    long nyquist_limit;
 
+    nyquist_limit = (kt_globals.samrate * 16) / 40;   // 80% of the Nyquist frequency
     kt_globals.original_f0 = frame->F0hz10 / 10;
 
     frame->AVdb_tmp = frame->AVdb - 7;
@@ -613,6 +615,17 @@ static void frame_init(klatt_frame_ptr frame) {
             kt_globals.rsn[ix].b_inc = (kt_globals.rsn_next[ix].b - kt_globals.rsn[ix].b) / 64.0;
             kt_globals.rsn[ix].c_inc = (kt_globals.rsn_next[ix].c - kt_globals.rsn[ix].c) / 64.0;
         }
+
+        if ((ix <= 8) && (frame->Fhz[ix] >= nyquist_limit)) {
+            // At a low sample rate, a formant near the Nyquist frequency would
+            // give a large peak there, so leave it out of the cascade.
+            kt_globals.rsn[ix].a = 1.0;
+            kt_globals.rsn[ix].b = 0;
+            kt_globals.rsn[ix].c = 0;
+            kt_globals.rsn[ix].a_inc = 0;
+            kt_globals.rsn[ix].b_inc = 0;
+            kt_globals.rsn[ix].c_inc = 0;
+        }
     }
 
     // nasal zero anti-resonator
@@ -628,6 +641,8 @@ static void frame_init(klatt_frame_ptr frame) {
     for (ix = 0; ix <= 6; ix++) {
         setabc(frame->Fhz[ix], frame->Bphz[ix], &(kt_globals.rsn[Rparallel + ix]));
         kt_globals.rsn[Rparallel + ix].a *= amp_par[ix];
+        if (frame->Fhz[ix] >= nyquist_limit)
+            kt_globals.rsn[Rparallel + ix].a = 0;
     }
 
     /* output low-pass filter */
@@ -652,7 +667,8 @@ static double impulsive_source() {
     static double vwave;
 
     if (kt_globals.nper < 3) {
-        vwave = doublet[kt_globals.nper];
+        // the doublet's spectrum is for 22050 Hz, keep its level at other rates
+        vwave = (doublet[kt_globals.nper] * kt_globals.samrate) / 22050;
     } else {
         vwave = 0.0;
     }
@@ -1260,7 +1276,7 @@ void KlattInit() {
     sample_count = 0;
 
     kt_globals.synthesis_model = CASCADE_PARALLEL;
-    kt_globals.samrate = 22050;
+    kt_globals.samrate = samplerate;
 
     kt_globals.glsource = IMPULSIVE; // IMPULSIVE, NATURAL, SAMPLED
     kt_globals.scale_wav = scale_wav_tab[kt_globals.glsource];
@@ -0,0 +1,438 @@
+/***************************************************************************
+ *   Copyright (C) 2005 to 2014 by Jonathan Duddington                     *
+ *   email: jonsd@users.sourceforge.net                                    *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 3 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, see:                                 *
+ *               <http://www.gnu.org/licenses/>.                           *
+ ***************************************************************************/
+
+#include "speech.h"
+
+#ifdef USE_ASYNC
+// This source file is only used for asynchronious modes
+
+
+//<includes
+#include <windows.h>
+#include <assert.h>
+#include <string.h>
+#include <stdlib.h>
+#include <errno.h>
+
+#include "speak_lib.h"
+#include "delivery.h"
+#include "wave.h"
+#include "debug.h"
+
+// my_lock: protects the queue and the fields below.
+static CRITICAL_SECTION my_lock;
+// my_cond_is_changed: woken with my_lock held when a buffer is added to
+// or removed from the queue, and when my_thread_must_stop is set.
+static CONDITION_VARIABLE my_cond_is_changed;
+// my_thread: gives the buffers of the queue to the callback.
+static HANDLE my_thread;
+static DWORD my_thread_id;
+static int thread_inited;
+static int my_thread_must_stop = 0;
+static t_espeak_callback *my_callback = NULL;
+static int (*my_callback_is_output_enabled)(void) = NULL;
+
+enum {
+    OUTPUT_CHECK_TIMEOUT = 5 // in ms, check whether the synthesis is to be stopped
+};
+
+typedef struct {
+    short *wav;             // a copy of the sound
+    int has_sound;          // 0 if the callback is given a NULL sound pointer
+    int numsamples;
+    int wav_size;           // the space of wav, in bytes
+    espeak_EVENT *events;   // copies of the events, up to espeakEVENT_LIST_TERMINATED
+    int n_events_max;       // the space of events
+} t_buffer;
+
+// The buffer at my_head is given to the callback, and stays in the queue until it returns.
+static t_buffer my_queue[DELIVERY_QUEUE_LENGTH];
+static int my_head = 0;
+static int my_count = 0;
+static int my_callback_is_running = 0;
+
+// The text whose sound the callback has stopped, by returning 1
+static int my_text_is_stopped = 0;
+static unsigned int my_stopped_uid = 0;
+
+// The depth of the queue, and the waits of the synthesis for space in it
+static struct {
+    int max_depth;
+    unsigned int count;
+    int64_t sum_ns;
+    int64_t max_ns;
+} my_stalls;
+
+static DWORD WINAPI delivery_thread(LPVOID);
+
+//>
+//<delivery_init
+
+void delivery_set_callback(t_espeak_callback *SynthCallback) {
+    my_callback = SynthCallback;
+}
+
+void delivery_set_callback_is_output_enabled(int (*cb)(void)) {
+    my_callback_is_output_enabled = cb;
+}
+
+void delivery_init() {
+    ENTER("delivery_init");
+
+    if (thread_inited) {
+        return;
+    }
+
+    InitializeCriticalSection(&my_lock);
+    InitializeConditionVariable(&my_cond_is_changed);
+    my_head = 0;
+    my_count = 0;
+    my_text_is_stopped = 0;
+    my_thread_must_stop = 0;
+
+    my_thread = CreateThread(
+            NULL, // default security attributes
+            0,    // default stack size
+            delivery_thread,
+            NULL, // no thread function arguments
+            0,    // default creation flags
+            &my_thread_id);
+    thread_inited = (my_thread != NULL);
+    assert(thread_inited);
+}
+
+//>
+//<buffer_copy, buffer_clear, drop_waiting_sound
+
+// Copy the sound and events into a buffer of the queue, keeping its space for next time.
+// return 0 if ok, -1 if there is no memory.
+static int buffer_copy(t_buffer *b, short *wav, int numsamples, int n_bytes, espeak_EVENT *events) {
+    int n_events;
+    int ix;
+
+    for (n_events = 1; events[n_events - 1].type != espeakEVENT_LIST_TERMINATED; n_events++) {}
+
+    if (n_events > b->n_events_max) {
+        espeak_EVENT *a_events = (espeak_EVENT *) realloc(b->events, n_events * sizeof(espeak_EVENT));
+        if (a_events == NULL) {
+            return -1;
+        }
+        b->events = a_events;
+        b->n_events_max = n_events;
+    }
+    if ((wav != NULL) && ((b->wav == NULL) || (n_bytes > b->wav_size))) {
+        // not NULL for an empty sound
+        short *a_wav = (short *) realloc(b->wav, n_bytes + 2);
+        if (a_wav == NULL) {
+            return -1;
+        }
+        b->wav = a_wav;
+        b->wav_size = n_bytes + 2;
+    }
+
+    memcpy(b->events, events, n_events * sizeof(espeak_EVENT));
+    for (ix = 0; ix < n_events; ix++) {
+        if (((events[ix].type == espeakEVENT_MARK) || (events[ix].type == espeakEVENT_PLAY))
+            && (events[ix].id.name != NULL)) {
+            // the names are in a buffer which is used again by the next text
+            b->events[ix].id.name = strdup(events[ix].id.name);
+        }
+    }
+    if (wav != NULL) {
+        memcpy(b->wav, wav, n_bytes);
+    }
+    b->has_sound = (wav != NULL);
+    b->numsamples = numsamples;
+    return 0;
+}
+
+static void buffer_clear(t_buffer *b) {
+    int ix;
+
+    for (ix = 0; b->events[ix].type != espeakEVENT_LIST_TERMINATED; ix++) {
+        if (((b->events[ix].type == espeakEVENT_MARK) || (b->events[ix].type == espeakEVENT_PLAY))
+            && (b->events[ix].id.name != NULL)) {
+            free((void *) b->events[ix].id.name);
+        }
+    }
+}
+
+// Drop the buffers which are waiting for the callback, except the espeakEVENT_MSG_TERMINATED
+// of each text, which is always given (the calling program may free its user data then).
+// Called with my_lock held.
+static void drop_waiting_sound() {
+    int ix;
+    int n_kept = my_callback_is_running;
+
+    for (ix = my_callback_is_running; ix < my_count; ix++) {
+        t_buffer *b = &my_queue[(my_head + ix) % DELIVERY_QUEUE_LENGTH];
+        if (b->events[0].type == espeakEVENT_MSG_TERMINATED) {
+            if (ix != n_kept) {
+                // keep the space of both buffers
+                t_buffer *a_kept = &my_queue[(my_head + n_kept) % DELIVERY_QUEUE_LENGTH];
+                t_buffer a_buffer = *a_kept;
+                *a_kept = *b;
+                *b = a_buffer;
+            }
+            n_kept++;
+        } else {
+            buffer_clear(b);
+        }
+    }
+    my_count = n_kept;
+}
+
+//>
+//<delivery_add
+
+// Called with my_lock held.
+static int is_output_enabled() {
+    return (my_callback_is_output_enabled == NULL) || my_callback_is_output_enabled();
+}
+
+int delivery_add(short *wav, int numsamples, int n_bytes, espeak_EVENT *events) {
+    ENTER("delivery_add");
+
+    int a_stop = 0;
+    int a_terminated = (events[0].type == espeakEVENT_MSG_TERMINATED);
+    t_buffer *b;
+
+    if (!thread_inited || (my_callback == NULL)) {
+        return 0;
+    }
+
+    EnterCriticalSection(&my_lock);
+    if (my_count >= DELIVERY_QUEUE_LENGTH) {
+        // a stall: wait for the callback, but only for a short time so that a stop request is noticed
+        struct timespec a_start;
+        struct timespec now;
+        int64_t a_wait;
+
+        clock_gettime_mono(&a_start);
+        while ((my_count >= DELIVERY_QUEUE_LENGTH) && is_output_enabled()) {
+            SleepConditionVariableCS(&my_cond_is_changed, &my_lock, OUTPUT_CHECK_TIMEOUT);
+        }
+        clock_gettime_mono(&now);
+
+        a_wait = (int64_t) (now.tv_sec - a_start.tv_sec) * 1000000000 + (now.tv_nsec - a_start.tv_nsec);
+        my_stalls.count++;
+        my_stalls.sum_ns += a_wait;
+        if (a_wait > my_stalls.max_ns) {
+            my_stalls.max_ns = a_wait;
+        }
+    }
+
+    if (a_terminated) {
+        if (my_count >= DELIVERY_QUEUE_LENGTH) {
+            // the synthesis is being stopped, and its sound will be dropped anyway
+            drop_waiting_sound();
+        }
+        while (my_count >= DELIVERY_QUEUE_LENGTH) {
+            SleepConditionVariableCS(&my_cond_is_changed, &my_lock, INFINITE);
+        }
+    } else if (!is_output_enabled()) {
+        a_stop = 1;
+    } else if (my_text_is_stopped && (events[0].unique_identifier == my_stopped_uid)) {
+        a_stop = 1;
+    }
+
+    if (!a_stop) {
+        b = &my_queue[(my_head + my_count) % DELIVERY_QUEUE_LENGTH];
+        if (buffer_copy(b, wav, numsamples, n_bytes, events) == 0) {
+            my_count++;
+            if (my_count > my_stalls.max_depth) {
+                my_stalls.max_depth = my_count;
+            }
+            WakeAllConditionVariable(&my_cond_is_changed);
+        }
+    }
+    LeaveCriticalSection(&my_lock);
+
+    SHOW("delivery_add > count=%d, stop=%d\n", my_count, a_stop);
+    return a_stop;
+}
+
+//>
+//<delivery_clear_all
+
+void delivery_clear_all() {
+    ENTER("delivery_clear_all");
+
+    if (!thread_inited) {
+        return;
+    }
+
+    EnterCriticalSection(&my_lock);
+    drop_waiting_sound();
+    my_text_is_stopped = 0;
+    WakeAllConditionVariable(&my_cond_is_changed);
+
+    // unless this is called by the callback itself
+    if (GetCurrentThreadId() != my_thread_id) {
+        while (my_callback_is_running) {
+            SleepConditionVariableCS(&my_cond_is_changed, &my_lock, INFINITE);
+        }
+    }
+    LeaveCriticalSection(&my_lock);
+}
+
+//>
+//<delivery_is_busy, delivery_wait_idle
+
+int delivery_is_busy() {
+    int a_busy;
+
+    if (!thread_inited) {
+        return 0;
+    }
+    EnterCriticalSection(&my_lock);
+    a_busy = (my_count > 0);
+    LeaveCriticalSection(&my_lock);
+    return a_busy;
+}
+
+int delivery_wait_idle(const struct timespec *the_end) {
+    ENTER("delivery_wait_idle");
+
+    int a_busy = 0;
+
+    if (!thread_inited) {
+        return 0;
+    }
+
+    EnterCriticalSection(&my_lock);
+    while ((a_busy = (my_count > 0))) {
+        DWORD a_time = INFINITE;
+        if (the_end != NULL) {
+            struct timespec ts;
+            clock_gettime2(&ts);
+            if (!time_is_before(&ts, the_end)) {
+                break;
+            }
+            a_time = (DWORD) ((the_end->tv_sec - ts.tv_sec) * 1000
+                              + (the_end->tv_nsec - ts.tv_nsec) / 1000000 + 1);
+        }
+        SleepConditionVariableCS(&my_cond_is_changed, &my_lock, a_time);
+    }
+    LeaveCriticalSection(&my_lock);
+    return a_busy;
+}
+
+//>
+//<delivery_get_stats
+
+void delivery_get_stats(unsigned int *depth, unsigned int *max_depth,
+                        unsigned int *stalls, int *stall_mean_us, int *stall_max_us) {
+    if (!thread_inited) {
+        *depth = *max_depth = *stalls = 0;
+        *stall_mean_us = *stall_max_us = 0;
+        return;
+    }
+    EnterCriticalSection(&my_lock);
+    *depth = my_count;
+    *max_depth = (unsigned int) my_stalls.max_depth;
+    *stalls = my_stalls.count;
+    *stall_mean_us = (my_stalls.count == 0) ? 0 : (int) (my_stalls.sum_ns / my_stalls.count / 1000);
+    *stall_max_us = (int) (my_stalls.max_ns / 1000);
+    LeaveCriticalSection(&my_lock);
+}
+
+//>
+//<delivery_thread
+
+static DWORD WINAPI delivery_thread(LPVOID arg) {
+    (void)arg;
+    ENTER("delivery_thread");
+
+    EnterCriticalSection(&my_lock);
+    while (!my_thread_must_stop) {
+        if (my_count == 0) {
+            SleepConditionVariableCS(&my_cond_is_changed, &my_lock, INFINITE);
+            continue;
+        }
+
+        t_buffer *b = &my_queue[my_head];
+        unsigned int a_uid = b->events[0].unique_identifier;
+        int a_terminated = (b->events[0].type == espeakEVENT_MSG_TERMINATED);
+        int a_result = 0;
+
+        if (!my_text_is_stopped || (a_uid != my_stopped_uid) || a_terminated) {
+            my_callback_is_running = 1;
+            LeaveCriticalSection(&my_lock);
+
+            a_result = my_callback(b->has_sound ? b->wav : NULL, b->numsamples, b->events);
+
+            EnterCriticalSection(&my_lock);
+            my_callback_is_running = 0;
+        }
+
+        if (a_terminated) {
+            my_text_is_stopped = 0;
+        } else if (a_result != 0) {
+            // as when the callback is called by the synthesis, the rest of the text is stopped
+            my_text_is_stopped = 1;
+            my_stopped_uid = a_uid;
+        }
+
+        // delivery_clear_all() has left this buffer in the queue
+        buffer_clear(b);
+        my_head = (my_head + 1) % DELIVERY_QUEUE_LENGTH;
+        my_count--;
+        WakeAllConditionVariable(&my_cond_is_changed);
+    }
+    LeaveCriticalSection(&my_lock);
+
+    return 0;
+}
+
+//>
+//<delivery_terminate
+
+void delivery_terminate() {
+    ENTER("delivery_terminate");
+
+    int ix;
+
+    if (thread_inited) {
+        EnterCriticalSection(&my_lock);
+        my_thread_must_stop = 1;
+        WakeAllConditionVariable(&my_cond_is_changed);
+        LeaveCriticalSection(&my_lock);
+        WaitForSingleObject(my_thread, INFINITE);
+        CloseHandle(my_thread);
+
+        while (my_count > 0) {
+            my_count--;
+            buffer_clear(&my_queue[(my_head + my_count) % DELIVERY_QUEUE_LENGTH]);
+        }
+        for (ix = 0; ix < DELIVERY_QUEUE_LENGTH; ix++) {
+            free(my_queue[ix].wav);
+            free(my_queue[ix].events);
+            my_queue[ix].wav = NULL;
+            my_queue[ix].events = NULL;
+            my_queue[ix].wav_size = 0;
+            my_queue[ix].n_events_max = 0;
+        }
+        DeleteCriticalSection(&my_lock);
+        thread_inited = 0;
+    }
+}
+
+#endif
+//>
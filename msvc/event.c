@@ -38,6 +38,9 @@ static int poll_stop_req_val = 0;
 static CONDITION_VARIABLE poll_start_req;
 static CONDITION_VARIABLE poll_stop_req;
 static CONDITION_VARIABLE poll_stop_ack;
+// poll_changed: woken when an event is removed from the list,
+// and when my_event_is_running becomes 0.
+static CONDITION_VARIABLE poll_changed;
 static CRITICAL_SECTION poll_lock;
 static HANDLE my_thread;
 static int thread_inited;
@@ -48,7 +51,8 @@ static int my_event_is_running = 0;
 enum {
     MIN_TIMEOUT_IN_MS = 10,
     ACTIVITY_TIMEOUT = 50, // in ms, check that the stream is active
-    MAX_ACTIVITY_CHECK = 6
+    MAX_ACTIVITY_CHECK = 6,
+    MAX_NODE_COUNTER = 1000
 };
 
 
@@ -81,6 +85,7 @@ void event_init() {
     InitializeConditionVariable(&poll_start_req);
     InitializeConditionVariable(&poll_stop_req);
     InitializeConditionVariable(&poll_stop_ack);
+    InitializeConditionVariable(&poll_changed);
     InitializeCriticalSection(&poll_lock);
 
     init();
@@ -188,6 +193,7 @@ static void event_notify(espeak_EVENT *event) {
             case espeakEVENT_MARK:
             case espeakEVENT_WORD:
             case espeakEVENT_END:
+            case espeakEVENT_CLAUSE:
             case espeakEVENT_PHONEME: {
 // jonsd - I'm not sure what this is for. gilles says it's for when Gnome Speech reads a file of blank lines
                 if (a_old_uid != event->unique_identifier) {
@@ -275,6 +281,7 @@ espeak_ERROR event_clear_all() {
     } else {
         LeaveCriticalSection(&poll_lock);
         init(); // clear pending events
+        WakeAllConditionVariable(&poll_changed);
     }
     if (a_event_is_running) {
         EnterCriticalSection(&poll_lock);
@@ -287,6 +294,59 @@ espeak_ERROR event_clear_all() {
     return EE_OK;
 }
 
+//>
+//<event_wait_for_space, event_wait_idle
+
+// Wait while cond_busy() is true, until the_end (NULL = no time limit).
+static int wait_while(int (*cond_busy)(), const struct timespec *the_end) {
+    int a_busy = 0;
+
+    if (!thread_inited) {
+        return 0;
+    }
+
+    EnterCriticalSection(&poll_lock);
+    while ((a_busy = cond_busy())) {
+        DWORD a_time = INFINITE;
+        if (the_end != NULL) {
+            struct timespec ts;
+            clock_gettime2(&ts);
+            if (!time_is_before(&ts, the_end)) {
+                break;
+            }
+            a_time = (DWORD) ((the_end->tv_sec - ts.tv_sec) * 1000
+                              + (the_end->tv_nsec - ts.tv_nsec) / 1000000 + 1);
+        }
+        SleepConditionVariableCS(&poll_changed, &poll_lock, a_time);
+    }
+    LeaveCriticalSection(&poll_lock);
+    return a_busy;
+}
+
+static int is_full() {
+    return (node_counter >= MAX_NODE_COUNTER);
+}
+
+static int is_busy() {
+    return (my_event_is_running || (head != NULL));
+}
+
+int event_wait_for_space(const struct timespec *the_end) {
+    ENTER("event_wait_for_space");
+    return wait_while(is_full, the_end);
+}
+
+int event_wait_idle(const struct timespec *the_end) {
+    ENTER("event_wait_idle");
+    return wait_while(is_busy, the_end);
+}
+
+void event_get_delays(unsigned int *count, int *mean_us, int *max_us) {
+    // the events are timed by wave_get_remaining_time(), in ms, and the delays aren't measured
+    *count = 0;
+    *mean_us = *max_us = 0;
+}
+
 static int sleep_until_timeout_or_stop_request(uint32_t time_in_ms) {
     int stop_request = 0;
 
@@ -378,6 +438,7 @@ static DWORD polling_thread(LPVOID arg) {
                 EnterCriticalSection(&poll_lock);
                 event_delete((espeak_EVENT *) pop());
                 LeaveCriticalSection(&poll_lock);
+                WakeAllConditionVariable(&poll_changed);
             } else if (time_in_ms == 0) {
                 // the event is already reached.
                 if (my_callback) {
@@ -393,6 +454,7 @@ static DWORD polling_thread(LPVOID arg) {
                 stop_request = poll_stop_req_val;
                 poll_stop_req_val = 0;
                 LeaveCriticalSection(&poll_lock);
+                WakeAllConditionVariable(&poll_changed);
             } else {
                 // The event will be notified soon: sleep until timeout or stop request
                 stop_request = sleep_until_timeout_or_stop_request(time_in_ms);
@@ -406,11 +468,13 @@ static DWORD polling_thread(LPVOID arg) {
             poll_stop_req_val = 0;
         }
         LeaveCriticalSection(&poll_lock);
+        WakeAllConditionVariable(&poll_changed);
 
         if (stop_request > 0) {
             // no mutex required since the stop command is synchronous
             // and waiting for my_sem_stop_is_acknowledged
             init();
+            WakeAllConditionVariable(&poll_changed);
             // acknowledge the stop request
             EnterCriticalSection(&poll_lock);
             poll_stop_req_val--;
@@ -420,10 +484,6 @@ static DWORD polling_thread(LPVOID arg) {
     }
 }
 
-enum {
-    MAX_NODE_COUNTER = 1000
-};
-
 // return 1 if ok, 0 otherwise
 static espeak_ERROR push(void *the_data) {
     node *n = NULL;
@@ -36,10 +36,16 @@
 static int my_command_is_running = 0;
 static int fifo_start_req_val = 0;
 static int fifo_stop_req_val = 0;
+// the lane of the commands which are added, and of the running command
+static int my_priority = espeakPRIORITY_NORMAL;
+static int my_command_priority = espeakPRIORITY_NORMAL;
 
 static CONDITION_VARIABLE fifo_start_req;
 static CONDITION_VARIABLE fifo_stop_req;
 static CONDITION_VARIABLE fifo_stop_ack;
+// fifo_changed: woken when say_thread takes a start request,
+// and when my_command_is_running becomes 0.
+static CONDITION_VARIABLE fifo_changed;
 static CRITICAL_SECTION fifo_lock;
 
 static DWORD say_thread(LPVOID);
@@ -48,6 +54,8 @@ static HANDLE fifo_thread = NULL;
 
 static espeak_ERROR push(t_espeak_command *the_command);
 
+static void push_front(t_espeak_command *the_command, int lane);
+
 static t_espeak_command *pop();
 
 static void init(int process_parameters);
@@ -56,7 +64,8 @@ static int node_counter = 0;
 enum {
     MAX_NODE_COUNTER = 400,
     INACTIVITY_TIMEOUT = 50, // in ms, check that the stream is inactive
-    MAX_INACTIVITY_CHECK = 2
+    MAX_INACTIVITY_CHECK = 2,
+    N_LANES = espeakPRIORITY_HIGH + 1
 };
 
 void fifo_init() {
@@ -66,6 +75,7 @@ void fifo_init() {
     InitializeConditionVariable(&fifo_start_req);
     InitializeConditionVariable(&fifo_stop_req);
     InitializeConditionVariable(&fifo_stop_ack);
+    InitializeConditionVariable(&fifo_changed);
     InitializeCriticalSection(&fifo_lock);
 
     init(0);
@@ -102,9 +112,11 @@ espeak_ERROR fifo_add_command(t_espeak_command *the_command) {
         fifo_start_req_val++;
         LeaveCriticalSection(&fifo_lock);
         WakeConditionVariable(&fifo_start_req);
+        EnterCriticalSection(&fifo_lock);
         while (fifo_start_req_val > 0) {
-            espeakSleep(50); // TBD: event?
+            SleepConditionVariableCS(&fifo_changed, &fifo_lock, INFINITE);
         }
+        LeaveCriticalSection(&fifo_lock);
     } else {
         LeaveCriticalSection(&fifo_lock);
     }
@@ -131,9 +143,11 @@ espeak_ERROR fifo_add_commands(
         fifo_start_req_val++;
         LeaveCriticalSection(&fifo_lock);
         WakeConditionVariable(&fifo_start_req);
+        EnterCriticalSection(&fifo_lock);
         while (fifo_start_req_val > 0) {
-            espeakSleep(50); // TBD: event?
+            SleepConditionVariableCS(&fifo_changed, &fifo_lock, INFINITE);
         }
+        LeaveCriticalSection(&fifo_lock);
     } else {
         LeaveCriticalSection(&fifo_lock);
     }
@@ -163,6 +177,27 @@ int fifo_is_busy() {
     return my_command_is_running;
 }
 
+int fifo_wait_idle(const struct timespec *the_end) {
+    int a_busy;
+    ENTER("fifo_wait_idle");
+    EnterCriticalSection(&fifo_lock);
+    while ((a_busy = (my_command_is_running || (node_counter > 0)))) {
+        DWORD a_time = INFINITE;
+        if (the_end != NULL) {
+            struct timespec ts;
+            clock_gettime2(&ts);
+            if (!time_is_before(&ts, the_end)) {
+                break;
+            }
+            a_time = (DWORD) ((the_end->tv_sec - ts.tv_sec) * 1000
+                              + (the_end->tv_nsec - ts.tv_nsec) / 1000000 + 1);
+        }
+        SleepConditionVariableCS(&fifo_changed, &fifo_lock, a_time);
+    }
+    LeaveCriticalSection(&fifo_lock);
+    return a_busy;
+}
+
 // Wait for the start request (my_sem_start_is_required).
 // Besides this, if the audio stream is still busy,
 // check from time to time its end.
@@ -213,6 +248,7 @@ static void close_stream() {
         my_command_is_running = 0;
         stop_flag = fifo_stop_req_val;
         LeaveCriticalSection(&fifo_lock);
+        WakeAllConditionVariable(&fifo_changed);
         if (stop_flag > 0) {
             WakeConditionVariable(&fifo_stop_ack);
         }
@@ -247,20 +283,22 @@ static DWORD say_thread(LPVOID arg) {
             SleepConditionVariableCS(&fifo_start_req, &fifo_lock, INFINITE);
         }
         fifo_start_req_val--;
+        my_command_is_running = 1;
         LeaveCriticalSection(&fifo_lock);
+        WakeAllConditionVariable(&fifo_changed);
 
-
-        my_command_is_running = 1;
         while (my_command_is_running) {
             t_espeak_command *a_command = NULL;
             EnterCriticalSection(&fifo_lock);
             a_command = (t_espeak_command *) pop();
             if (a_command == NULL) {
-                LeaveCriticalSection(&fifo_lock);
                 my_command_is_running = 0;
+                LeaveCriticalSection(&fifo_lock);
+                WakeAllConditionVariable(&fifo_changed);
             } else {
                 // purge start semaphore
                 fifo_start_req_val = 0;
+                WakeAllConditionVariable(&fifo_changed);
                 if (fifo_stop_req_val > 0) {
                     my_command_is_running = 0;
                 }
@@ -287,6 +325,7 @@ static DWORD say_thread(LPVOID arg) {
             stop_request = fifo_stop_req_val;
             LeaveCriticalSection(&fifo_lock);
             WakeConditionVariable(&fifo_stop_req);
+            WakeAllConditionVariable(&fifo_changed);
         }
     }
 }
@@ -300,16 +339,18 @@ typedef struct t_node {
     struct t_node *next;
 } node;
 
-static node *head = NULL;
-static node *tail = NULL;
+// a list for each lane, espeakPRIORITY_NORMAL and espeakPRIORITY_HIGH
+static node *head[N_LANES] = {NULL};
+static node *tail[N_LANES] = {NULL};
 
 // return 1 if ok, 0 otherwise
 static espeak_ERROR push(t_espeak_command *the_command) {
     node *n = NULL;
+    int lane = my_priority;
 
     ENTER("fifo > push");
 
-    assert((!head && !tail) || (head && tail));
+    assert((!head[lane] && !tail[lane]) || (head[lane] && tail[lane]));
 
     if (the_command == NULL) {
         SHOW("push > command=0x%x\n", NULL);
@@ -326,19 +367,19 @@ static espeak_ERROR push(t_espeak_command *the_command) {
         return EE_INTERNAL_ERROR;
     }
 
-    if (head == NULL) {
-        head = n;
-        tail = n;
+    if (head[lane] == NULL) {
+        head[lane] = n;
+        tail[lane] = n;
     } else {
-        tail->next = n;
-        tail = n;
+        tail[lane]->next = n;
+        tail[lane] = n;
     }
 
-    tail->next = NULL;
-    tail->data = the_command;
+    tail[lane]->next = NULL;
+    tail[lane]->data = the_command;
 
     node_counter++;
-    SHOW("push > counter=%d\n", node_counter);
+    SHOW("push > counter=%d, lane=%d\n", node_counter, lane);
 
     the_command->state = CS_PENDING;
     display_espeak_command(the_command);
@@ -346,25 +387,57 @@ static espeak_ERROR push(t_espeak_command *the_command) {
     return EE_OK;
 }
 
-static t_espeak_command *pop() {
-    t_espeak_command *the_command = NULL;
+// Put the_command at the head of a lane, whatever the number of commands.
+static void push_front(t_espeak_command *the_command, int lane) {
+    node *n = NULL;
 
-    ENTER("fifo > pop");
+    ENTER("fifo > push_front");
 
-    assert((!head && !tail) || (head && tail));
+    n = (node *) malloc(sizeof(node));
+    if (n == NULL) {
+        delete_espeak_command(the_command);
+        return;
+    }
 
-    if (head != NULL) {
-        node *n = head;
-        the_command = n->data;
-        head = n->next;
-        free(n);
-        node_counter--;
-        SHOW("pop > command=0x%x (counter=%d)\n",
-             the_command, node_counter);
+    n->data = the_command;
+    n->next = head[lane];
+    head[lane] = n;
+    if (tail[lane] == NULL) {
+        tail[lane] = n;
     }
 
-    if (head == NULL) {
-        tail = NULL;
+    node_counter++;
+    SHOW("push_front > counter=%d, lane=%d\n", node_counter, lane);
+
+    the_command->state = CS_PENDING;
+    display_espeak_command(the_command);
+}
+
+// Take the first command of the highest lane which has one.
+static t_espeak_command *pop() {
+    t_espeak_command *the_command = NULL;
+    int lane;
+
+    ENTER("fifo > pop");
+
+    for (lane = N_LANES - 1; lane >= 0; lane--) {
+        assert((!head[lane] && !tail[lane]) || (head[lane] && tail[lane]));
+
+        if (head[lane] != NULL) {
+            node *n = head[lane];
+            the_command = n->data;
+            head[lane] = n->next;
+            free(n);
+            node_counter--;
+            my_command_priority = lane;
+            SHOW("pop > command=0x%x (counter=%d, lane=%d)\n",
+                 the_command, node_counter, lane);
+
+            if (head[lane] == NULL) {
+                tail[lane] = NULL;
+            }
+            break;
+        }
     }
 
     display_espeak_command(the_command);
@@ -390,6 +463,34 @@ static void init(int process_parameters) {
     node_counter = 0;
 }
 
+void fifo_set_priority(int priority) {
+    ENTER("fifo_set_priority");
+
+    EnterCriticalSection(&fifo_lock);
+    my_priority = priority;
+    LeaveCriticalSection(&fifo_lock);
+}
+
+int fifo_is_preempted() {
+    int a_preempted;
+
+    EnterCriticalSection(&fifo_lock);
+    a_preempted = (my_command_priority < espeakPRIORITY_HIGH)
+                  && (head[espeakPRIORITY_HIGH] != NULL);
+    LeaveCriticalSection(&fifo_lock);
+
+    SHOW("fifo_is_preempted > %d\n", a_preempted);
+    return a_preempted;
+}
+
+void fifo_resume_command(t_espeak_command *the_command) {
+    ENTER("fifo_resume_command");
+
+    EnterCriticalSection(&fifo_lock);
+    push_front(the_command, my_command_priority);
+    LeaveCriticalSection(&fifo_lock);
+}
+
 void fifo_terminate() {
     ENTER("fifo_terminate");
     WakeAllConditionVariable(&fifo_start_req);
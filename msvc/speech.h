@@ -76,8 +76,13 @@ void Free(void *ptr);
 
 void espeakSleep(unsigned int _ms);
 
+// the int64_t counters for espeak_GetStats(), which one thread adds to while another reads them
 #ifdef _MSC_VER
-
+#define STATS_LOAD(x) InterlockedCompareExchange64(&(x), 0, 0)
+#define STATS_STORE(x, v) InterlockedExchange64(&(x), (v))
+#else
+#define STATS_LOAD(x) __atomic_load_n(&(x), __ATOMIC_RELAXED)
+#define STATS_STORE(x, v) __atomic_store_n(&(x), (v), __ATOMIC_RELAXED)
 #endif //_MSC_VER
 
 #endif // SPEECH_H
@@ -52,6 +52,7 @@ struct timespec {
 
 
 enum {ONE_BILLION=1000000000};
+#define IDLE_CHECK_TIMEOUT 50   // ms
 
 #ifdef USE_PORTAUDIO
 
@@ -82,9 +83,12 @@ void wave_port_terminate();
 uint32_t wave_port_get_read_position(void* theHandler);
 uint32_t wave_port_get_write_position(void* theHandler);
 void wave_port_flush(void* theHandler);
+void wave_port_abort(void* theHandler);
 void wave_port_set_callback_is_output_enabled(t_wave_callback* cb);
 void* wave_port_test_get_write_buffer();
 int wave_port_get_remaining_time(uint32_t sample, uint32_t* time);
+void wave_port_get_xruns(uint32_t* underruns, uint32_t* overruns);
+int wave_port_wait_idle(void* theHandler, const struct timespec* the_end);
 
 // wave_pulse.cpp
 int is_pulse_running();
@@ -167,6 +171,12 @@ void wave_flush(void* theHandler) {
     wave_port_flush(theHandler);
 }
 
+void wave_abort(void* theHandler) {
+  // the PulseAudio output stops writing when the output is no longer enabled
+  if (!pulse_running)
+    wave_port_abort(theHandler);
+}
+
 void wave_set_callback_is_output_enabled(t_wave_callback* cb) {
   if (pulse_running)
     wave_pulse_set_callback_is_output_enabled(cb);
@@ -189,6 +199,34 @@ int wave_get_remaining_time(uint32_t sample, uint32_t* time)
     return wave_port_get_remaining_time(sample, time);
 }
 
+void wave_get_xruns(uint32_t* underruns, uint32_t* overruns)
+{
+  if (pulse_running)
+    *underruns = *overruns = 0;
+  else
+    wave_port_get_xruns(underruns, overruns);
+}
+
+int wave_wait_idle(void* theHandler, const struct timespec* the_end)
+{
+  if (pulse_running)
+    {
+      struct timespec ts;
+      while (wave_pulse_is_busy(theHandler))
+	{
+	  clock_gettime2(&ts);
+	  if (the_end && !time_is_before(&ts, the_end))
+	    {
+	      return 1;
+	    }
+	  espeakSleep(IDLE_CHECK_TIMEOUT);
+	}
+      return 0;
+    }
+  else
+    return wave_port_wait_idle(theHandler, the_end);
+}
+
 // rename functions to be wrapped
 #define wave_init wave_port_init
 #define wave_open wave_port_open
@@ -199,9 +237,12 @@ int wave_get_remaining_time(uint32_t sample, uint32_t* time)
 #define wave_get_read_position wave_port_get_read_position
 #define wave_get_write_position wave_port_get_write_position
 #define wave_flush wave_port_flush
+#define wave_abort wave_port_abort
 #define wave_set_callback_is_output_enabled wave_port_set_callback_is_output_enabled
 #define wave_test_get_write_buffer wave_port_test_get_write_buffer
 #define wave_get_remaining_time wave_port_get_remaining_time
+#define wave_get_xruns wave_port_get_xruns
+#define wave_wait_idle wave_port_wait_idle
 
 #endif  // USE_PULSEAUDIO
 
@@ -221,6 +262,7 @@ static int my_stream_could_start=0;
 static int wave_samplerate;
 
 static int mInCallbackFinishedState = 0;
+static volatile int my_aborted = 0; // set by wave_abort(), until the buffer is emptied
 #if (USE_PORTAUDIO == 18)
 static PortAudioStream *pa_stream=NULL;
 #endif
@@ -251,6 +293,7 @@ static void init_buffer()
   myRead = myBuffer;
   memset(myBuffer,0,BUFFER_LENGTH);
   myReadPosition = myWritePosition = 0;
+  my_aborted = 0;
   SHOW("init_buffer > myRead=0x%x, myWrite=0x%x, BUFFER_LENGTH=0x%x, myReadPosition = myWritePosition = 0\n", (size_t)myRead, (size_t)myWrite, BUFFER_LENGTH);
 }
 
@@ -326,6 +369,13 @@ static int pa_callback(void *inputBuffer, void *outputBuffer,
 	char* aWrite = myWrite;
 	size_t n = out_channels*sizeof(uint16_t)*framesPerBuffer;
 
+	if (my_aborted)
+	{
+		memset(outputBuffer, 0, n);
+		mInCallbackFinishedState = 1;
+		return 1; // paComplete
+	}
+
 	myReadPosition += framesPerBuffer;
 	SHOW("pa_callback > myReadPosition=%u, framesPerBuffer=%lu (n=0x%x) \n",(int)myReadPosition, framesPerBuffer, n);
 
@@ -474,6 +524,26 @@ void wave_flush(void* theHandler)
     }
 }
 
+//<wave_abort
+
+void wave_abort(void* theHandler)
+{
+  ENTER("wave_abort");
+
+  // pa_callback() plays silence from its next buffer, and wave_write() returns
+  my_aborted = 1;
+}
+
+// The stream has stopped after wave_abort(): drop the sound left in the buffer.
+static void end_abort()
+{
+  if (my_aborted)
+    {
+      init_buffer();
+    }
+}
+
+//>
 //<wave_open_sound
 
 static int wave_open_sound()
@@ -870,6 +940,12 @@ size_t wave_write(void* theHandler, char* theMono16BitsWaveBuffer, size_t theSiz
 
 	my_stream_could_start = 0;
 
+	if (my_aborted)
+	{
+		SHOW_TIME("wave_write > aborted");
+		return 0;
+	}
+
 	if(pa_stream == NULL)
 	{
 		SHOW_TIME("wave_write > wave_open_sound\n");
@@ -896,7 +972,8 @@ size_t wave_write(void* theHandler, char* theMono16BitsWaveBuffer, size_t theSiz
 
 	while (1)
 	{
-		if (my_callback_is_output_enabled && (0==my_callback_is_output_enabled()))
+		if ((my_callback_is_output_enabled && (0==my_callback_is_output_enabled()))
+			|| my_aborted)
 		{
 			SHOW_TIME("wave_write > my_callback_is_output_enabled: no!");
 			return 0;
@@ -998,24 +1075,28 @@ int wave_close(void* theHandler)
   if( pa_stream == NULL )
     {
       SHOW_TIME("wave_close > LEAVE (NULL stream)");
+      end_abort();
       return 0;
     }
 
   if( Pa_IsStreamStopped( pa_stream ) )
     {
       SHOW_TIME("wave_close > LEAVE (stopped)");
+      end_abort();
       return 0;
     }
 #else
   if( pa_stream == NULL )
     {
       SHOW_TIME("wave_close > LEAVE (NULL stream)");
+      end_abort();
       return 0;
     }
 
   if( Pa_StreamActive( pa_stream ) == 0 && mInCallbackFinishedState == 0 )
     {
       SHOW_TIME("wave_close > LEAVE (not active)");
+      end_abort();
       return 0;
     }
 #endif
@@ -1208,6 +1289,35 @@ int wave_get_remaining_time(uint32_t sample, uint32_t* time)
   return 0;
 }
 
+//>
+//<wave_get_xruns, wave_wait_idle
+
+void wave_get_xruns(uint32_t* underruns, uint32_t* overruns)
+{
+  // not counted by this version of the buffer
+  *underruns = 0;
+  *overruns = 0;
+}
+
+int wave_wait_idle(void* theHandler, const struct timespec* the_end)
+{
+  struct timespec ts;
+
+  ENTER("wave_wait_idle");
+
+  // PortAudio calls no function here when the stream finishes, so check it from time to time
+  while (wave_is_busy(theHandler))
+    {
+      clock_gettime2(&ts);
+      if (the_end && !time_is_before(&ts, the_end))
+	{
+	  return 1;
+	}
+      espeakSleep(IDLE_CHECK_TIMEOUT);
+    }
+  return 0;
+}
+
 //>
 //<wave_test_get_write_buffer
 
@@ -1229,6 +1339,7 @@ void wave_terminate() {}
 uint32_t wave_get_read_position(void* theHandler) {return 0;}
 uint32_t wave_get_write_position(void* theHandler) {return 0;}
 void wave_flush(void* theHandler) {}
+void wave_abort(void* theHandler) {}
 typedef int (t_wave_callback)(void);
 void wave_set_callback_is_output_enabled(t_wave_callback* cb) {}
 extern void* wave_test_get_write_buffer() {return NULL;}
@@ -1240,10 +1351,13 @@ int wave_get_remaining_time(uint32_t sample, uint32_t* time)
 	return 0;
 }
 
+void wave_get_xruns(uint32_t* underruns, uint32_t* overruns) {*underruns = *overruns = 0;}
+int wave_wait_idle(void* theHandler, const struct timespec* the_end) {return 0;}
+
 #endif  // of USE_PORTAUDIO
 
 //>
-//<clock_gettime2, add_time_in_ms
+//<clock_gettime2, add_time_in_ms, time_is_before
 
 void clock_gettime2(struct timespec *ts)
 {
@@ -1255,9 +1369,47 @@ void clock_gettime2(struct timespec *ts)
       return;
     }
 
-  assert (gettimeofday(&tv, NULL) != -1);
+  // not inside assert(), which NDEBUG removes
+  int a_status = gettimeofday(&tv, NULL);
+  assert (a_status != -1);
+  (void)a_status;
   ts->tv_sec = tv.tv_sec;
   ts->tv_nsec = tv.tv_usec*1000;
+#else
+  // FILETIME counts 100 ns units
+  FILETIME ft;
+  ULARGE_INTEGER t;
+
+  if (!ts)
+    {
+      return;
+    }
+
+  GetSystemTimeAsFileTime(&ft);
+  t.LowPart = ft.dwLowDateTime;
+  t.HighPart = ft.dwHighDateTime;
+  ts->tv_sec = (long)(t.QuadPart / 10000000);
+  ts->tv_nsec = (long)(t.QuadPart % 10000000) * 100;
+#endif // __GNUC__
+}
+
+void clock_gettime_mono(struct timespec *ts)
+{
+#ifdef __GNUC__
+  clock_gettime2(ts);
+#else
+  LARGE_INTEGER freq;
+  LARGE_INTEGER t;
+
+  if (!ts)
+    {
+      return;
+    }
+
+  QueryPerformanceFrequency(&freq);
+  QueryPerformanceCounter(&t);
+  ts->tv_sec = (long)(t.QuadPart / freq.QuadPart);
+  ts->tv_nsec = (long)((t.QuadPart % freq.QuadPart) * 1000000000 / freq.QuadPart);
 #endif // __GNUC__
 }
 
@@ -1278,9 +1430,52 @@ void add_time_in_ms(struct timespec *ts, int time_in_ms)
       t_ns -= ONE_BILLION;
     }
   ts->tv_nsec = (long int)t_ns;
+#else
+  long t_ns;
+  if (!ts)
+    {
+      return;
+    }
+
+  t_ns = ts->tv_nsec + 1000000 * (time_in_ms % 1000);
+  ts->tv_sec += time_in_ms / 1000 + t_ns / ONE_BILLION;
+  ts->tv_nsec = t_ns % ONE_BILLION;
 #endif // __GNUC__
 }
 
+int time_is_before(const struct timespec *ts, const struct timespec *the_end)
+{
+  return (ts->tv_sec < the_end->tv_sec)
+    || ((ts->tv_sec == the_end->tv_sec) && (ts->tv_nsec < the_end->tv_nsec));
+}
+
+//>
+//<wave_signal_sound_wanted, wave_wait_sound_wanted
+
+// an auto-reset event: one wait returns for each signal
+static HANDLE my_event_sound_wanted = NULL;
+
+void wave_signal_sound_wanted()
+{
+  if (my_event_sound_wanted != NULL)
+    {
+      SetEvent(my_event_sound_wanted);
+    }
+}
+
+void wave_wait_sound_wanted(int timeout)
+{
+  if (my_event_sound_wanted == NULL)
+    {
+      my_event_sound_wanted = CreateEvent(NULL, FALSE, FALSE, NULL);
+      if (my_event_sound_wanted == NULL)
+        {
+          return;
+        }
+    }
+  WaitForSingleObject(my_event_sound_wanted, (DWORD)timeout);
+}
+
 
 #endif   // USE_ASYNC
 
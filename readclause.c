@@ -31,6 +31,7 @@
 #include "synthesize.h"
 #include "voice.h"
 #include "translate.h"
+#include "resample.h"
 
 #ifdef PLATFORM_POSIX
 #include <unistd.h>
@@ -431,6 +432,8 @@ int iswalpha2(int c)
 {
 	if(c < 0x80)
 		return(isalpha(c));
+	if(HaveCharProps(c))
+		return((CharProps(c)->flags & CHP_ALPHA) != 0);
 	if((c > 0x3040) && (c <= 0xa700))
 		return(1);  // japanese, chinese characters
 	if(c > MAX_WALPHA)
@@ -442,6 +445,8 @@ int iswlower2(int c)
 {
 	if(c < 0x80)
 		return(islower(c));
+	if(HaveCharProps(c))
+		return((CharProps(c)->flags & CHP_LOWER) != 0);
 	if(c > MAX_WALPHA)
 		return(iswlower(c));
 	if(walpha_tab[c-0x80] == 0xff)
@@ -454,6 +459,8 @@ int iswupper2(int c)
 	int x;
 	if(c < 0x80)
 		return(isupper(c));
+	if(HaveCharProps(c))
+		return((CharProps(c)->flags & CHP_UPPER) != 0);
 	if(c > MAX_WALPHA)
 		return(iswupper(c));
 	if(((x = walpha_tab[c-0x80]) > 0) && (x < 0xfe))
@@ -478,6 +485,9 @@ int towlower2(unsigned int c)
 	if(c < 0x80)
 		return(tolower(c));
 
+	if(HaveCharProps(c) && (CharProps(c)->flags & CHP_CASE))
+		return(c + CharProps(c)->lower);
+
 	if(c > MAX_WALPHA)
 		return(towlower(c));
 
@@ -499,6 +509,9 @@ int towlower2(unsigned int c)
 int towupper2(unsigned int c)
 {
 	int ix;
+	if(HaveCharProps(c) && (CharProps(c)->flags & CHP_CASE))
+		return(c + CharProps(c)->upper);
+
 	if(c > MAX_WALPHA)
 		return(towupper(c));
 
@@ -515,6 +528,91 @@ int towupper2(unsigned int c)
 	return(c);  // no
 }
 
+CHAR_PROPS *char_props[256];
+
+void InitCharProperties(void)
+{//==========================
+// Make tables of the results of the character classification functions for U+0080 to U+FFFF,
+// so that they are a single lookup.  This is called after the locale has been set, since
+// the wctype functions are used above MAX_WALPHA.  Blocks of 256 characters which have
+// the same properties (eg. CJK) share the same table.
+	int ix;
+	int block;
+	int c;
+	int lower;
+	int upper;
+	int n_blocks = 0;
+	unsigned char block_ix[256];
+	unsigned int checksum[256];
+	CHAR_PROPS *blocks;
+	CHAR_PROPS *props;
+	CHAR_PROPS *p;
+
+	if(char_props[0] != NULL)
+		return;   // already done
+
+	if((blocks = (CHAR_PROPS *)calloc(256 * 256, sizeof(CHAR_PROPS))) == NULL)
+		return;
+
+	for(block=0; block<256; block++)
+	{
+		props = &blocks[n_blocks * 256];
+		checksum[n_blocks] = 0;
+
+		for(ix=0; ix<256; ix++)
+		{
+			p = &props[ix];
+			c = (block << 8) + ix;
+			if(c < 0x80)
+				continue;   // ascii is not looked up in the tables
+
+			if(iswalpha2(c))
+				p->flags |= CHP_ALPHA;
+			if(IsAlpha(c))
+				p->flags |= CHP_ISALPHA;
+			if(iswupper2(c))
+				p->flags |= CHP_UPPER;
+			if(iswlower2(c))
+				p->flags |= CHP_LOWER;
+			if(IsDigit(c))
+				p->flags |= CHP_DIGIT;
+			if(IsSpace(c))
+				p->flags |= CHP_SPACE;
+
+			lower = towlower2(c) - c;
+			upper = towupper2(c) - c;
+			if((lower >= -0x8000) && (lower < 0x8000) && (upper >= -0x8000) && (upper < 0x8000))
+			{
+				p->flags |= CHP_CASE;
+				p->lower = lower;
+				p->upper = upper;
+			}
+			checksum[n_blocks] = (checksum[n_blocks] * 31) + p->flags + (lower << 8) + (upper << 20);
+		}
+
+		// is this the same as a previous block ?
+		for(ix=0; ix<n_blocks; ix++)
+		{
+			if((checksum[ix] == checksum[n_blocks]) && (memcmp(&blocks[ix * 256], props, 256 * sizeof(CHAR_PROPS)) == 0))
+				break;
+		}
+		if(ix == n_blocks)
+			n_blocks++;
+		else
+			memset(props, 0, 256 * sizeof(CHAR_PROPS));
+		block_ix[block] = ix;
+	}
+
+	if((props = (CHAR_PROPS *)realloc(blocks, n_blocks * 256 * sizeof(CHAR_PROPS))) == NULL)
+		props = blocks;
+
+	for(block=0; block<256; block++)
+	{
+		char_props[block] = &props[block_ix[block] * 256];
+	}
+}  //  end of InitCharProperties
+
+
 static int IsRomanU(unsigned int c)
 {//================================
 	if((c=='I') || (c=='V') || (c=='X') || (c=='L'))
@@ -536,6 +634,35 @@ static void GetC_unget(int c)
 	}
 }
 
+static int Utf8Length(int c)
+{//========================
+	if((c < 0x80) || (option_multibyte == espeakCHARS_8BIT))
+		return(1);
+	if(c < 0x800)
+		return(2);
+	if(c < 0x10000)
+		return(3);
+	return(4);
+}
+
+const char *InputPosition(const void *p_input)
+{//===========================================
+// p_input is the text pointer which will be given to the next TranslateClause().
+// Returns the position in the text of the next character which ReadClause() will read,
+// allowing for characters which have been read ahead and put back.
+// Only valid for UTF8 or 8-bit text in memory.
+	const char *p = (const char *)p_input;
+
+	if(p == NULL)
+		return(NULL);
+
+	if(ungot_char != 0)
+		p -= Utf8Length(ungot_char);
+	if(ungot_char2 != 0)
+		p -= Utf8Length(ungot_char2);
+	return(p);
+}
+
 int Eof(void)
 {//==========
 	if(ungot_char != 0)
@@ -555,13 +682,12 @@ static int GetC_get(void)
 
 	if(f_input != NULL)
 	{
-		c = fgetc(f_input);
-		if(feof(f_input)) c = ' ';
+		// only call feof() at the end of the file, or on a read error
+		if(((c = getc(f_input)) == (unsigned int)EOF) && feof(f_input)) c = ' ';
 
 		if(option_multibyte == espeakCHARS_16BIT)
 		{
-			c2 = fgetc(f_input);
-			if(feof(f_input)) c2 = 0;
+			if(((c2 = getc(f_input)) == (unsigned int)EOF) && feof(f_input)) c2 = 0;
 			c = c + (c2 << 8);
 		}
 		return(c);
@@ -621,6 +747,45 @@ static int GetC(void)
 		return(c1);
 	}
 
+	if((ungot2 == 0) && (f_input == NULL) && (option_multibyte < espeakCHARS_8BIT) && !end_of_input)
+	{
+		// Fast path for UTF8 text in memory: decode a complete and valid sequence in place.
+		// Otherwise use the general case below, which deals with the end of the text and
+		// with input which turns out not to be UTF8.
+		const unsigned char *p = p_textinput;
+
+		if((c1 = p[0]) < 0x80)
+		{
+			if(c1 != 0)
+			{
+				p_textinput++;
+				count_characters++;
+				return(c1);
+			}
+		}
+		else
+		if(((c1 & 0xe0) == 0xc0) && ((c1 & 0x1e) != 0) && ((p[1] & 0xc0) == 0x80))
+		{
+			p_textinput += 2;
+			count_characters++;
+			return(((c1 & 0x1f) << 6) + (p[1] & 0x3f));
+		}
+		else
+		if(((c1 & 0xf0) == 0xe0) && ((p[1] & 0xc0) == 0x80) && ((p[2] & 0xc0) == 0x80))
+		{
+			p_textinput += 3;
+			count_characters++;
+			return(((c1 & 0x0f) << 12) + ((p[1] & 0x3f) << 6) + (p[2] & 0x3f));
+		}
+		else
+		if(((c1 & 0xf8) == 0xf0) && ((c1 & 0x0f) <= 4) && ((p[1] & 0xc0) == 0x80) && ((p[2] & 0xc0) == 0x80) && ((p[3] & 0xc0) == 0x80))
+		{
+			p_textinput += 4;
+			count_characters++;
+			return(((c1 & 0x07) << 18) + ((p[1] & 0x3f) << 12) + ((p[2] & 0x3f) << 6) + (p[3] & 0x3f));
+		}
+	}
+
 	if(ungot2 != 0)
 	{
 		c1 = ungot2;
@@ -842,13 +1007,190 @@ int Read4Bytes(FILE *f)
 }
 
 
+static char *ReadSoundFile(const char *fname, int *length)
+{//=======================================================
+	FILE *f;
+	char *data;
+
+	if((*length = GetFileLength(fname)) <= 0)
+		return(NULL);
+	if((f = fopen(fname,"rb")) == NULL)
+		return(NULL);
+	if((data = (char *)malloc(*length)) != NULL)
+		*length = fread(data,1,*length,f);
+	fclose(f);
+	return(data);
+}
+
+
+static char *ConvertSoundFile(const unsigned char *data, int length, int *n_samples)
+{//================================================================================
+// Convert a WAV file to mono, 16 bit signed, at the current sample rate.
+// Returns it, with a 44 byte WAV header, or NULL if the file can't be read.
+	int ix;
+	int ch;
+	int pos;
+	int chunk;
+	int format = 0;
+	int n_channels = 0;
+	int rate = 0;
+	int bits = 0;
+	int n_frames;
+	int n_out;
+	int value;
+	double fvalue;
+	const unsigned char *p;
+	const unsigned char *wav = NULL;
+	short *mono;
+	short *out;
+	char *buf;
+	RESAMPLER *rs;
+
+	if((length < 12) || (memcmp(data,"RIFF",4) != 0) || (memcmp(&data[8],"WAVE",4) != 0))
+		return(NULL);
+
+	n_frames = 0;
+	for(pos = 12; pos+8 <= length; pos += 8 + chunk + (chunk & 1))
+	{
+		p = &data[pos];
+		chunk = p[4] + (p[5] << 8) + (p[6] << 16) + (p[7] << 24);
+		if((chunk < 0) || (chunk > length - pos - 8))
+			chunk = length - pos - 8;   // truncated file
+
+		if((memcmp(p,"fmt ",4) == 0) && (chunk >= 16))
+		{
+			format = p[8] + (p[9] << 8);
+			n_channels = p[10] + (p[11] << 8);
+			rate = p[12] + (p[13] << 8) + (p[14] << 16) + (p[15] << 24);
+			bits = p[22] + (p[23] << 8);
+			if((format == 0xfffe) && (chunk >= 26))
+				format = p[32] + (p[33] << 8);   // WAVE_FORMAT_EXTENSIBLE, use its SubFormat
+		}
+		else
+		if(memcmp(p,"data",4) == 0)
+		{
+			wav = &p[8];
+			n_frames = chunk;
+			break;
+		}
+	}
+
+	if((wav == NULL) || (n_channels <= 0) || (rate <= 0))
+		return(NULL);
+	if(!(((format == 1) && ((bits == 8) || (bits == 16) || (bits == 24) || (bits == 32))) || ((format == 3) && (bits == 32))))
+		return(NULL);   // not PCM or 32 bit float
+
+	n_frames = n_frames / (n_channels * (bits/8));
+
+	// mix the channels down to mono
+	if((mono = (short *)malloc((n_frames + 1) * sizeof(short))) == NULL)
+		return(NULL);
+	for(ix=0, p=wav; ix<n_frames; ix++)
+	{
+		fvalue = 0;
+		for(ch=0; ch<n_channels; ch++)
+		{
+			switch(bits)
+			{
+			case 8:
+				value = (p[0] - 128) << 8;   // 8 bit WAV data is unsigned
+				break;
+			case 16:
+				value = (short)(p[0] + (p[1] << 8));
+				break;
+			case 24:
+				value = (signed char)p[2];
+				value = ((value << 16) + (p[1] << 8) + p[0]) >> 8;
+				break;
+			default:
+				value = (int)(p[0] + (p[1] << 8) + (p[2] << 16) + ((unsigned int)p[3] << 24));
+				if(format == 3)
+				{
+					float f;
+					memcpy(&f,&value,4);
+					if(f > 1.0)
+						f = 1.0;
+					else
+					if(f < -1.0)
+						f = -1.0;
+					value = (int)(f * 32767);
+				}
+				else
+					value = value >> 16;
+				break;
+			}
+			fvalue += value;
+			p += bits/8;
+		}
+		fvalue = fvalue / n_channels;
+		if(fvalue > 32767)
+			fvalue = 32767;
+		else
+		if(fvalue < -32768)
+			fvalue = -32768;
+		mono[ix] = (short)fvalue;
+	}
+
+	n_out = n_frames;
+	if(rate != samplerate)
+		n_out = ResampleLength(n_frames, rate, samplerate);
+
+	if((buf = (char *)malloc(44 + (n_out + 1) * 2)) == NULL)
+	{
+		free(mono);
+		return(NULL);
+	}
+	out = (short *)&buf[44];
+
+	if(rate == samplerate)
+	{
+		memcpy(out, mono, n_out * sizeof(short));
+	}
+	else
+	{
+		if((rs = ResampleCreate(rate, samplerate)) == NULL)
+		{
+			free(mono);
+			free(buf);
+			return(NULL);
+		}
+		ix = Resample(rs, mono, n_frames, out, n_out);
+		ix += ResampleFlush(rs, &out[ix], n_out - ix);
+		ResampleDelete(rs);
+		n_out = ix;
+	}
+	free(mono);
+
+	// PlayWave() reads the samples as little-endian
+	for(ix=0; ix<n_out; ix++)
+	{
+		value = out[ix];
+		buf[44 + ix*2] = value & 0xff;
+		buf[45 + ix*2] = (value >> 8) & 0xff;
+	}
+
+	// a WAV header for mono, 16 bit, at samplerate
+	memcpy(buf, "RIFF\0\0\0\0WAVEfmt \20\0\0\0\1\0\1\0\0\0\0\0\0\0\0\0\2\0\20\0data", 40);
+	for(ix=0; ix<4; ix++)
+	{
+		buf[4+ix] = ((36 + n_out*2) >> (ix*8)) & 0xff;
+		buf[24+ix] = (samplerate >> (ix*8)) & 0xff;
+		buf[28+ix] = ((samplerate*2) >> (ix*8)) & 0xff;
+		buf[40+ix] = ((n_out*2) >> (ix*8)) & 0xff;
+	}
+
+	*n_samples = n_out;
+	return(buf);
+}  //  end of ConvertSoundFile
+
+
 static int LoadSoundFile(const char *fname, int index)
 {//===================================================
-	FILE *f;
+// Load a sound file into soundicon_tab[index], converting it to mono, 16 bit, at the current sample rate
+	char *data;
 	char *p;
-	int *ip;
-	int  length;
-	char fname_temp[100];
+	int length;
+	int n_samples;
 	char fname2[sizeof(path_home)+13+40];
 
 	if(fname == NULL)
@@ -867,62 +1209,41 @@ static int LoadSoundFile(const char *fname, int index)
 		fname = fname2;
 	}
 
-	f = NULL;
+	if((data = ReadSoundFile(fname, &length)) == NULL)
+		return(3);
+
+	p = ConvertSoundFile((unsigned char *)data, length, &n_samples);
+	free(data);
+
 #ifdef PLATFORM_POSIX
-	if((f = fopen(fname,"rb")) != NULL)
+	if(p == NULL)
 	{
-		int ix;
+		// not a WAV file which we can read, try to convert it with sox
 		int fd_temp;
-		int header[3];
+		char fname_temp[100];
 		char command[sizeof(fname2)+sizeof(fname2)+40];
 
-		fseek(f,20,SEEK_SET);
-		for(ix=0; ix<3; ix++)
-			header[ix] = Read4Bytes(f);
-
-		// if the sound file is not mono, 16 bit signed, at the correct sample rate, then convert it
-		if((header[0] != 0x10001) || (header[1] != samplerate) || (header[2] != samplerate*2))
+		strcpy(fname_temp,"/tmp/espeakXXXXXX");
+		if((fd_temp = mkstemp(fname_temp)) >= 0)
 		{
-			fclose(f);
-			f = NULL;
-
-			strcpy(fname_temp,"/tmp/espeakXXXXXX");
-			if((fd_temp = mkstemp(fname_temp)) >= 0)
+			close(fd_temp);
+			sprintf(command,"sox \"%s\" -r %d -c1 -t wav %s\n", fname, samplerate, fname_temp);
+			if((system(command) == 0) && ((data = ReadSoundFile(fname_temp, &length)) != NULL))
 			{
-				close(fd_temp);
-				sprintf(command,"sox \"%s\" -r %d -c1 -t wav %s\n", fname, samplerate, fname_temp);
-				if(system(command) == 0)
-				{
-					fname = fname_temp;
-				}
+				p = ConvertSoundFile((unsigned char *)data, length, &n_samples);
+				free(data);
 			}
+			remove(fname_temp);
 		}
 	}
 #endif
 
-	if(f == NULL)
-	{
-		f = fopen(fname,"rb");
-		if(f == NULL)
-		{
-//			fprintf(stderr,"Can't read temp file: %s\n",fname);
-			return(3);
-		}
-	}
-
-	length = GetFileLength(fname);
-	fseek(f,0,SEEK_SET);
-	if((p = (char *)realloc(soundicon_tab[index].data, length)) == NULL)
-	{
-		fclose(f);
+	if(p == NULL)
 		return(4);
-	}
-	length = fread(p,1,length,f);
-	fclose(f);
-	remove(fname_temp);
 
-	ip = (int *)(&p[40]);
-	soundicon_tab[index].length = (*ip) / 2;  // length in samples
+	free(soundicon_tab[index].data);
+	soundicon_tab[index].length = n_samples;
+	soundicon_tab[index].rate = samplerate;
 	soundicon_tab[index].data = p;
 	return(0);
 }  //  end of LoadSoundFile
@@ -937,7 +1258,7 @@ static int LookupSoundicon(int c)
 	{
 		if(soundicon_tab[ix].name == c)
 		{
-			if(soundicon_tab[ix].length == 0)
+			if((soundicon_tab[ix].length == 0) || (soundicon_tab[ix].rate != samplerate))
 			{
 				if(LoadSoundFile(NULL,ix)!=0)
 					return(-1);  // sound file is not available
@@ -960,7 +1281,15 @@ static int LoadSoundFile2(const char *fname)
 	for(ix=0; ix<n_soundicon_tab; ix++)
 	{
 		if(((soundicon_tab[ix].filename != NULL) && strcmp(fname, soundicon_tab[ix].filename) == 0))
+		{
+			if(soundicon_tab[ix].rate != samplerate)
+			{
+				// it was converted for a different sample rate
+				if(LoadSoundFile(fname, ix) != 0)
+					return(-1);
+			}
 			return(ix);   // already loaded
+		}
 	}
 
 	// load the file into the next slot
@@ -971,7 +1300,7 @@ static int LoadSoundFile2(const char *fname)
 	if(LoadSoundFile(fname, slot) != 0)
 		return(-1);
 
-	soundicon_tab[slot].filename = (char *)realloc(soundicon_tab[ix].filename, strlen(fname)+1);
+	soundicon_tab[slot].filename = (char *)realloc(soundicon_tab[slot].filename, strlen(fname)+1);
 	strcpy(soundicon_tab[slot].filename, fname);
 	return(slot);
 }
@@ -1169,6 +1498,121 @@ static MNEM_TAB ssmltags[] = {
 	{"code", HTML_NOSPACE},
 	{NULL,0}};
 
+// the attributes which are recognised in SSML tags
+#define SSML_ATTR_XML_LANG      0
+#define SSML_ATTR_XML_BASE      1
+#define SSML_ATTR_NAME          2
+#define SSML_ATTR_VARIANT       3
+#define SSML_ATTR_AGE           4
+#define SSML_ATTR_GENDER        5
+#define SSML_ATTR_FIELD         6
+#define SSML_ATTR_MODE          7
+#define SSML_ATTR_RATE          8
+#define SSML_ATTR_VOLUME        9
+#define SSML_ATTR_PITCH        10
+#define SSML_ATTR_RANGE        11
+#define SSML_ATTR_LEVEL        12
+#define SSML_ATTR_INTERPRET_AS 13
+#define SSML_ATTR_FORMAT       14
+#define SSML_ATTR_DETAIL       15
+#define SSML_ATTR_ALIAS        16
+#define SSML_ATTR_SRC          17
+#define SSML_ATTR_STRENGTH     18
+#define SSML_ATTR_TIME         19
+#define N_SSML_ATTR            20
+
+static MNEM_TAB ssmlattrs[] = {
+	{"xml:lang", SSML_ATTR_XML_LANG},
+	{"xml:base", SSML_ATTR_XML_BASE},
+	{"name", SSML_ATTR_NAME},
+	{"variant", SSML_ATTR_VARIANT},
+	{"age", SSML_ATTR_AGE},
+	{"gender", SSML_ATTR_GENDER},
+	{"field", SSML_ATTR_FIELD},
+	{"mode", SSML_ATTR_MODE},
+	{"rate", SSML_ATTR_RATE},
+	{"volume", SSML_ATTR_VOLUME},
+	{"pitch", SSML_ATTR_PITCH},
+	{"range", SSML_ATTR_RANGE},
+	{"level", SSML_ATTR_LEVEL},
+	{"interpret-as", SSML_ATTR_INTERPRET_AS},
+	{"format", SSML_ATTR_FORMAT},
+	{"detail", SSML_ATTR_DETAIL},
+	{"alias", SSML_ATTR_ALIAS},
+	{"src", SSML_ATTR_SRC},
+	{"strength", SSML_ATTR_STRENGTH},
+	{"time", SSML_ATTR_TIME},
+	{NULL,-1}};
+
+
+// Hash tables of the names in ssmltags[] and ssmlattrs[].
+// With this hash function each of the names has a slot of its own, so a lookup is a
+// single probe and one string comparison.
+#define N_SSML_HASH  128     // a power of 2
+typedef struct {
+	const char *name;        // NULL = empty slot
+	int value;
+} SSML_HASH;
+
+static SSML_HASH ssml_tag_hash[N_SSML_HASH];
+static SSML_HASH ssml_attr_hash[N_SSML_HASH];
+static int ssml_hash_done = 0;
+
+
+static int SsmlHash(const char *name)
+{//==================================
+	unsigned int hash = 0;
+
+	while(*name != 0)
+		hash = (hash * 132) + (unsigned char)*name++;
+	return(((hash * 0x9e3779b1) & 0xffffffff) >> 25);
+}
+
+
+static void MakeSsmlHash(SSML_HASH *table, MNEM_TAB *mtab)
+{//=======================================================
+	int ix;
+	int slot;
+
+	for(ix=0; mtab[ix].mnem != NULL; ix++)
+	{
+		slot = SsmlHash(mtab[ix].mnem);
+		while(table[slot].name != NULL)
+			slot = (slot + 1) & (N_SSML_HASH-1);
+		table[slot].name = mtab[ix].mnem;
+		table[slot].value = mtab[ix].value;
+	}
+}
+
+
+static int LookupSsmlHash(SSML_HASH *table, const char *name, int not_found)
+{//=========================================================================
+	int slot;
+
+	if(ssml_hash_done == 0)
+	{
+		MakeSsmlHash(ssml_tag_hash, ssmltags);
+		MakeSsmlHash(ssml_attr_hash, ssmlattrs);
+		ssml_hash_done = 1;
+	}
+
+	slot = SsmlHash(name);
+	while(table[slot].name != NULL)
+	{
+		if(strcmp(table[slot].name, name) == 0)
+			return(table[slot].value);
+		slot = (slot + 1) & (N_SSML_HASH-1);
+	}
+	return(not_found);
+}
+
+
+static int LookupSsmlTag(const char *name)
+{//=======================================
+// Returns the tag type, or 0 if it's not a recognised tag
+	return(LookupSsmlHash(ssml_tag_hash, name, 0));
+}
+
 
 
 
@@ -1356,39 +1800,71 @@ static void PopParamStack(int tag_type, char *outbuf, int *outix)
 
 
 
-static wchar_t *GetSsmlAttribute(wchar_t *pw, const char *name)
-{//============================================================
-// Gets the value string for an attribute.
-// Returns NULL if the attribute is not present
+static void GetSsmlAttributes(wchar_t *pw, wchar_t **attrs)
+{//========================================================
+// Finds the value strings of the recognised attributes in one pass through the tag.
+// attrs[] is indexed by SSML_ATTR_*, and is NULL if the attribute is not present.
 	int ix;
+	int n;
+	int c;
+	int quote;
+	wchar_t *value;
+	char name[20];
 	static wchar_t empty[1] = {0};
 
-	while(*pw != 0)
+	for(ix=0; ix<N_SSML_ATTR; ix++)
+		attrs[ix] = NULL;
+
+	for(;;)
 	{
-		if(iswspace(pw[-1]))
+		while(iswspace(*pw)) pw++;
+		if(*pw == 0)
+			break;
+
+		// the attribute name
+		n = 0;
+		while(((c = *pw) != 0) && (c != '=') && (c != '"') && (c != '\'') && !iswspace(c))
+		{
+			if(n < (int)sizeof(name)-1)
+				name[n++] = (c < 0x80) ? c : '?';
+			pw++;
+		}
+		name[n] = 0;
+
+		while(iswspace(*pw)) pw++;
+		c = *pw;
+		if(c == '=')
+		{
+			pw++;
+			while(iswspace(*pw)) pw++;
+		}
+
+		value = empty;
+		if((*pw == '"') || (*pw == '\''))  // allow single-quotes ?
 		{
-			ix = 0;
-			while(*pw == name[ix])
+			quote = *pw++;
+			value = pw;
+			while(((c = *pw) != 0) && (c != quote))
 			{
+				if((c == '\\') && (pw[1] == '"'))
+					pw++;    // \" doesn't end the value, see attrcopy_utf8()
 				pw++;
-				ix++;
-			}
-			if(name[ix]==0)
-			{
-				// found the attribute, now get the value
-				while(iswspace(*pw)) pw++;
-				if(*pw == '=') pw++;
-				while(iswspace(*pw)) pw++;
-				if((*pw == '"') || (*pw == '\''))  // allow single-quotes ?
-					return(pw+1);
-				else
-					return(empty);
 			}
+			if(c != 0)
+				pw++;
 		}
-		pw++;
+		else
+		if(c == '=')
+		{
+			// an unquoted value
+			while((*pw != 0) && !iswspace(*pw)) pw++;
+		}
+
+		// if an attribute is repeated, use the first
+		if(((ix = LookupSsmlHash(ssml_attr_hash, name, -1)) >= 0) && (attrs[ix] == NULL))
+			attrs[ix] = value;
 	}
-	return(NULL);
-}  //  end of GetSsmlAttribute
+}  //  end of GetSsmlAttributes
 
 
 static int attrcmp(const wchar_t *string1, const char *string2)
@@ -1585,7 +2061,7 @@ void SetVoiceStack(espeak_VOICE *v, const char *variant_name)
 }
 
 
-static int GetVoiceAttributes(wchar_t *pw, int tag_type)
+static int GetVoiceAttributes(wchar_t **attrs, int tag_type)
 {//=====================================================
 // Determines whether voice attribute are specified in this tag, and if so, whether this means
 // a voice change.
@@ -1619,7 +2095,7 @@ static int GetVoiceAttributes(wchar_t *pw, int tag_type)
 	else
 	{
 		// add a stack frame if any voice details are specified
-		lang = GetSsmlAttribute(pw,"xml:lang");
+		lang = attrs[SSML_ATTR_XML_LANG];
 
 		if(tag_type != SSML_VOICE)
 		{
@@ -1631,10 +2107,10 @@ static int GetVoiceAttributes(wchar_t *pw, int tag_type)
 		}
 		else
 		{
-			name = GetSsmlAttribute(pw,"name");
-			variant = GetSsmlAttribute(pw,"variant");
-			age = GetSsmlAttribute(pw,"age");
-			gender = GetSsmlAttribute(pw,"gender");
+			name = attrs[SSML_ATTR_NAME];
+			variant = attrs[SSML_ATTR_VARIANT];
+			age = attrs[SSML_ATTR_AGE];
+			gender = attrs[SSML_ATTR_GENDER];
 		}
 
 		if((tag_type != SSML_VOICE) && (lang==NULL))
@@ -1779,6 +2255,7 @@ static int ProcessSsmlTag(wchar_t *xml_buf, char *outbuf, int *outix, int n_outb
 	wchar_t *attr1;
 	wchar_t *attr2;
 	wchar_t *attr3;
+	wchar_t *attrs[N_SSML_ATTR];
 	int terminator;
 	char *uri;
 	int param_type;
@@ -1829,8 +2306,8 @@ static int ProcessSsmlTag(wchar_t *xml_buf, char *outbuf, int *outix, int n_outb
 		{"x-strong",5},
 		{NULL,-1}};
 
-	static const char *prosody_attr[5] = {
-	 NULL, "rate", "volume", "pitch", "range" };
+	static const unsigned char prosody_attr[5] = {
+	 0, SSML_ATTR_RATE, SSML_ATTR_VOLUME, SSML_ATTR_PITCH, SSML_ATTR_RANGE };
 
 	for(ix=0; ix<(sizeof(tag_name)-1); ix++)
 	{
@@ -1845,7 +2322,7 @@ static int ProcessSsmlTag(wchar_t *xml_buf, char *outbuf, int *outix, int n_outb
 	if(tag_name[0] == '/')
 	{
 		// closing tag
-		if((tag_type = LookupMnem(ssmltags,&tag_name[1])) != HTML_NOSPACE)
+		if((tag_type = LookupSsmlTag(&tag_name[1])) != HTML_NOSPACE)
 		{
 			outbuf[(*outix)++] = ' ';
 		}
@@ -1853,7 +2330,7 @@ static int ProcessSsmlTag(wchar_t *xml_buf, char *outbuf, int *outix, int n_outb
 	}
 	else
 	{
-		if((tag_type = LookupMnem(ssmltags,tag_name)) != HTML_NOSPACE)
+		if((tag_type = LookupSsmlTag(tag_name)) != HTML_NOSPACE)
 		{
 			// separate SSML tags from the previous word (but not HMTL tags such as <b> <font> which can occur inside a word)
 			outbuf[(*outix)++] = ' ';
@@ -1863,6 +2340,7 @@ static int ProcessSsmlTag(wchar_t *xml_buf, char *outbuf, int *outix, int n_outb
 			return(0);
 	}
 
+	GetSsmlAttributes(px, attrs);
 
 	voice_change_flag = 0;
 	terminator = CLAUSE_NONE;
@@ -1872,8 +2350,8 @@ static int ProcessSsmlTag(wchar_t *xml_buf, char *outbuf, int *outix, int n_outb
 	{
 	case SSML_STYLE:
 		sp = PushParamStack(tag_type);
-		attr1 = GetSsmlAttribute(px,"field");
-		attr2 = GetSsmlAttribute(px,"mode");
+		attr1 = attrs[SSML_ATTR_FIELD];
+		attr2 = attrs[SSML_ATTR_MODE];
 
 
 		if(attrcmp(attr1,"punctuation")==0)
@@ -1896,7 +2374,7 @@ static int ProcessSsmlTag(wchar_t *xml_buf, char *outbuf, int *outix, int n_outb
 		// look for attributes:  rate, volume, pitch, range
 		for(param_type=espeakRATE; param_type <= espeakRANGE; param_type++)
 		{
-			if((attr1 = GetSsmlAttribute(px,prosody_attr[param_type])) != NULL)
+			if((attr1 = attrs[prosody_attr[param_type]]) != NULL)
 			{
 				SetProsodyParameter(param_type, attr1, sp);
 			}
@@ -1908,7 +2386,7 @@ static int ProcessSsmlTag(wchar_t *xml_buf, char *outbuf, int *outix, int n_outb
 	case SSML_EMPHASIS:
 		sp = PushParamStack(tag_type);
 		value = 3;   // default is "moderate"
-		if((attr1 = GetSsmlAttribute(px,"level")) != NULL)
+		if((attr1 = attrs[SSML_ATTR_LEVEL]) != NULL)
 		{
 			value = attrlookup(attr1,mnem_emphasis);
 		}
@@ -1937,9 +2415,9 @@ static int ProcessSsmlTag(wchar_t *xml_buf, char *outbuf, int *outix, int n_outb
 		break;
 
 	case SSML_SAYAS:
-		attr1 = GetSsmlAttribute(px,"interpret-as");
-		attr2 = GetSsmlAttribute(px,"format");
-		attr3 = GetSsmlAttribute(px,"detail");
+		attr1 = attrs[SSML_ATTR_INTERPRET_AS];
+		attr2 = attrs[SSML_ATTR_FORMAT];
+		attr3 = attrs[SSML_ATTR_DETAIL];
 		value = attrlookup(attr1,mnem_interpret_as);
 		value2 = attrlookup(attr2,mnem_sayas_format);
 		if(value2 == 1)
@@ -1976,7 +2454,7 @@ static int ProcessSsmlTag(wchar_t *xml_buf, char *outbuf, int *outix, int n_outb
 		break;
 
 	case SSML_SUB:
-		if((attr1 = GetSsmlAttribute(px,"alias")) != NULL)
+		if((attr1 = attrs[SSML_ATTR_ALIAS]) != NULL)
 		{
 			// use the alias  rather than the text
 			ignore_text = 1;
@@ -1994,7 +2472,7 @@ static int ProcessSsmlTag(wchar_t *xml_buf, char *outbuf, int *outix, int n_outb
 		break;
 
 	case SSML_MARK:
-		if((attr1 = GetSsmlAttribute(px,"name")) != NULL)
+		if((attr1 = attrs[SSML_ATTR_NAME]) != NULL)
 		{
 			// add name to circular buffer of marker names
 			attrcopy_utf8(buf,attr1,sizeof(buf));
@@ -2019,7 +2497,7 @@ static int ProcessSsmlTag(wchar_t *xml_buf, char *outbuf, int *outix, int n_outb
 	case SSML_AUDIO:
 		sp = PushParamStack(tag_type);
 
-		if((attr1 = GetSsmlAttribute(px,"src")) != NULL)
+		if((attr1 = attrs[SSML_ATTR_SRC]) != NULL)
 		{
 			char fname[256];
 			attrcopy_utf8(buf,attr1,sizeof(buf));
@@ -2075,7 +2553,7 @@ static int ProcessSsmlTag(wchar_t *xml_buf, char *outbuf, int *outix, int n_outb
 		value = 21;
 		terminator = CLAUSE_NONE;
 
-		if((attr1 = GetSsmlAttribute(px,"strength")) != NULL)
+		if((attr1 = attrs[SSML_ATTR_STRENGTH]) != NULL)
 		{
 			static int break_value[6] = {0,7,14,21,40,80};  // *10mS
 			value = attrlookup(attr1,mnem_break);
@@ -2088,7 +2566,7 @@ static int ProcessSsmlTag(wchar_t *xml_buf, char *outbuf, int *outix, int n_outb
 			}
 			value = break_value[value];
 		}
-		if((attr2 = GetSsmlAttribute(px,"time")) != NULL)
+		if((attr2 = attrs[SSML_ATTR_TIME]) != NULL)
 		{
 			value2 = attrnumber(attr2,0,1);   // pause in mS
 
@@ -2116,7 +2594,7 @@ static int ProcessSsmlTag(wchar_t *xml_buf, char *outbuf, int *outix, int n_outb
 		break;
 
 	case SSML_SPEAK:
-		if((attr1 = GetSsmlAttribute(px,"xml:base")) != NULL)
+		if((attr1 = attrs[SSML_ATTR_XML_BASE]) != NULL)
 		{
 			attrcopy_utf8(buf,attr1,sizeof(buf));
 			if((index = AddNameData(buf,0)) >= 0)
@@ -2124,12 +2602,12 @@ static int ProcessSsmlTag(wchar_t *xml_buf, char *outbuf, int *outix, int n_outb
 				xmlbase = &namedata[index];
 			}
 		}
-		if(GetVoiceAttributes(px, tag_type) == 0)
+		if(GetVoiceAttributes(attrs, tag_type) == 0)
 			return(0);   // no voice change
 		return(CLAUSE_VOICE);
 
 	case SSML_VOICE:
-		if(GetVoiceAttributes(px, tag_type) == 0)
+		if(GetVoiceAttributes(attrs, tag_type) == 0)
 			return(0);   // no voice change
 		return(CLAUSE_VOICE);
 
@@ -2139,7 +2617,7 @@ static int ProcessSsmlTag(wchar_t *xml_buf, char *outbuf, int *outix, int n_outb
 		{
 			n_ssml_stack--;
 		}
-		return(CLAUSE_PERIOD + GetVoiceAttributes(px, tag_type));
+		return(CLAUSE_PERIOD + GetVoiceAttributes(attrs, tag_type));
 
 	case SSML_VOICE + SSML_CLOSE:
 		// unwind stack until the previous <voice> or <speak> tag
@@ -2149,7 +2627,7 @@ static int ProcessSsmlTag(wchar_t *xml_buf, char *outbuf, int *outix, int n_outb
 		}
 
 terminator=0;  // ??  Sentence intonation, but no pause ??
-		return(terminator + GetVoiceAttributes(px, tag_type));
+		return(terminator + GetVoiceAttributes(attrs, tag_type));
 
 	case HTML_BREAK:
 	case HTML_BREAK + SSML_CLOSE:
@@ -2159,9 +2637,9 @@ terminator=0;  // ??  Sentence intonation, but no pause ??
 		if(ssml_sp->tag_type == SSML_SENTENCE)
 		{
 			// new sentence implies end-of-sentence
-			voice_change_flag = GetVoiceAttributes(px, SSML_SENTENCE+SSML_CLOSE);
+			voice_change_flag = GetVoiceAttributes(attrs, SSML_SENTENCE+SSML_CLOSE);
 		}
-		voice_change_flag |= GetVoiceAttributes(px, tag_type);
+		voice_change_flag |= GetVoiceAttributes(attrs, tag_type);
 		return(CLAUSE_PARAGRAPH + voice_change_flag);
 
 
@@ -2169,14 +2647,14 @@ terminator=0;  // ??  Sentence intonation, but no pause ??
 		if(ssml_sp->tag_type == SSML_SENTENCE)
 		{
 			// new paragraph implies end-of-sentence or end-of-paragraph
-			voice_change_flag = GetVoiceAttributes(px, SSML_SENTENCE+SSML_CLOSE);
+			voice_change_flag = GetVoiceAttributes(attrs, SSML_SENTENCE+SSML_CLOSE);
 		}
 		if(ssml_sp->tag_type == SSML_PARAGRAPH)
 		{
 			// new paragraph implies end-of-sentence or end-of-paragraph
-			voice_change_flag |= GetVoiceAttributes(px, SSML_PARAGRAPH+SSML_CLOSE);
+			voice_change_flag |= GetVoiceAttributes(attrs, SSML_PARAGRAPH+SSML_CLOSE);
 		}
-		voice_change_flag |= GetVoiceAttributes(px, tag_type);
+		voice_change_flag |= GetVoiceAttributes(attrs, tag_type);
 		return(CLAUSE_PARAGRAPH + voice_change_flag);
 
 
@@ -2184,7 +2662,7 @@ terminator=0;  // ??  Sentence intonation, but no pause ??
 		if(ssml_sp->tag_type == SSML_SENTENCE)
 		{
 			// end of a sentence which specified a language
-			voice_change_flag = GetVoiceAttributes(px, tag_type);
+			voice_change_flag = GetVoiceAttributes(attrs, tag_type);
 		}
 		return(CLAUSE_PERIOD + voice_change_flag);
 
@@ -2194,7 +2672,7 @@ terminator=0;  // ??  Sentence intonation, but no pause ??
 		{
 			// End of a paragraph which specified a language.
 			// (End-of-paragraph also implies end-of-sentence)
-			return(GetVoiceAttributes(px, tag_type) + CLAUSE_PARAGRAPH);
+			return(GetVoiceAttributes(attrs, tag_type) + CLAUSE_PARAGRAPH);
 		}
 		return(CLAUSE_PARAGRAPH);
 	}
@@ -2968,3 +3446,284 @@ void InitText2(void)
 	xmlbase = NULL;
 }
 
+
+
+typedef struct {
+	int type;
+	int offset;
+	int length;
+	int blocking;   // don't split the text inside this element
+	int repeat;     // repeat the tag at the start of a segment
+} SEGMENT_TAG;
+
+static int AddSegment(TEXT_SEGMENT *seg, int offset, int char_offset, SEGMENT_TAG *stack, int n_stack)
+{//=====================================================================================================
+// Returns 0 if the segment can't be started here, because too many elements are open.
+	int ix;
+
+	seg->offset = offset;
+	seg->char_offset = char_offset;
+	seg->n_tags = 0;
+	for(ix=0; ix<n_stack; ix++)
+	{
+		if(stack[ix].repeat)
+		{
+			if(seg->n_tags >= N_SEGMENT_TAGS)
+				return(0);
+			seg->tag_offset[seg->n_tags] = stack[ix].offset;
+			seg->tag_length[seg->n_tags++] = stack[ix].length;
+		}
+	}
+	return(1);
+}
+
+
+static int SegmentTag(const char *text, int ix, int length, SEGMENT_TAG *stack, int *n_stack, int *n_blocking, int *paragraph)
+{//=========================================================================================================================
+// Update the stack of open elements for the SSML tag at text[ix].
+// paragraph is set if the tag starts a <p> or <s> element.
+// Returns the offset of the '>' at the end of the tag, or -1 if the tag is incomplete,
+// or -2 if the elements are nested too deeply.
+	int j;
+	int c;
+	int tag_type;
+	int tag_end;
+	int blocking;
+	int repeat;
+	char tag_name[40];
+
+	*paragraph = 0;
+
+	// find the tag name and the end of the tag
+	for(j=ix+1; (j < length) && (j-ix < (int)sizeof(tag_name)); j++)
+	{
+		if(((c = (unsigned char)text[j]) == 0) || (c == '>') || isspace(c) || ((c == '/') && (j > ix+1)))
+			break;
+		tag_name[j-ix-1] = tolower(c);
+	}
+	tag_name[j-ix-1] = 0;
+
+	for(tag_end = j; (tag_end < length) && (text[tag_end] != 0) && (text[tag_end] != '>'); tag_end++) ;
+	if((tag_end >= length) || (text[tag_end] == 0))
+		return(-1);
+
+	if(tag_name[0] == '/')
+	{
+		// closing tag, remove the element and any which are inside it from the stack
+		tag_type = LookupSsmlTag(&tag_name[1]);
+		for(j = *n_stack-1; j >= 0; j--)
+		{
+			if(stack[j].type == tag_type)
+				break;
+		}
+		while((j >= 0) && (*n_stack > j))
+		{
+			(*n_stack)--;
+			*n_blocking -= stack[*n_stack].blocking;
+		}
+	}
+	else
+	if(text[tag_end-1] != '/')
+	{
+		blocking = 0;
+		repeat = 1;
+		switch(tag_type = LookupSsmlTag(tag_name))
+		{
+		case SSML_SENTENCE:
+		case SSML_PARAGRAPH:
+			// repeating <p> or <s> would give a pause at the start of the segment,
+			// so only do that if it has attributes, such as xml:lang
+			*paragraph = 1;
+			if(!isspace((unsigned char)text[j]))
+				repeat = 0;
+			break;
+		case SSML_SPEAK:
+		case SSML_VOICE:
+		case SSML_PROSODY:
+		case SSML_EMPHASIS:
+		case SSML_STYLE:
+			break;
+		case SSML_SAYAS:
+		case SSML_PHONEME:
+		case SSML_SUB:
+		case SSML_AUDIO:
+		case SSML_IGNORE_TEXT:
+			blocking = 1;
+			break;
+		default:
+			tag_type = -1;   // no content which needs to be tracked
+			break;
+		}
+
+		if(tag_type >= 0)
+		{
+			if(*n_stack >= N_SSML_STACK)
+				return(-2);
+			stack[*n_stack].type = tag_type;
+			stack[*n_stack].offset = ix;
+			stack[*n_stack].length = tag_end + 1 - ix;
+			stack[*n_stack].repeat = repeat;
+			stack[(*n_stack)++].blocking = blocking;
+			*n_blocking += blocking;
+		}
+	}
+	return(tag_end);
+}
+
+
+int FindSegments(const char *text, int length, int flags, int min_length, TEXT_SEGMENT *segments, int n_segments)
+{//============================================================================================================
+// Find places where the text can be split into segments which can be spoken separately and give
+// the same speech as speaking the whole text.  These are paragraph breaks and the ends of sentences,
+// using the same punctuation as ReadClause().  Segments are at least min_length bytes, or
+// 2*min_length bytes if they end at a sentence rather than a paragraph.
+// With SSML, a segment starts after the tags which follow the end of a sentence, and the elements
+// which are open at that point are listed so that their tags can be repeated in front of it.
+// Splits are not made inside elements such as <say-as> and <audio>.
+// Returns the number of segments.
+	int ix;
+	int j;
+	int c;
+	int n_bytes;
+	int n_chars = 0;
+	int punct;
+	int split;
+	int seg_length;
+	int word_length = 0;  // characters since the last space
+	int word_dot = 0;     // the word contains '.'
+	int end_sentence = 0; // 1=after sentence punctuation, 2=and a following space or tag
+	int n_newlines = 0;
+	int gap = 0;          // 1=tags after the end of a sentence, 2=including a paragraph
+	int candidate = 0;    // segments[n_seg] is a place to split at the end of the tags
+	int n_seg = 1;
+	int n_stack = 0;
+	int n_blocking = 0;   // elements in the stack which we can't split inside
+	int paragraph;
+	int tag_end;
+	int utf8 = ((flags & 7) < espeakCHARS_8BIT);
+	int ssml = flags & espeakSSML;
+	SEGMENT_TAG stack[N_SSML_STACK];
+
+	AddSegment(&segments[0], 0, 0, stack, 0);
+
+	for(ix=0; (ix < length) && (text[ix] != 0); ix += n_bytes)
+	{
+		if(n_seg >= n_segments)
+			break;
+
+		c = text[ix] & 0xff;
+		n_bytes = 1;
+		if(utf8 && (c >= 0xc0))
+			n_bytes = utf8_in(&c, &text[ix]);
+
+		if(ssml && (c == '<'))
+		{
+			if((tag_end = SegmentTag(text, ix, length, stack, &n_stack, &n_blocking, &paragraph)) == -1)
+				break;   // incomplete tag at the end of the text
+			if(tag_end == -2)
+				return(n_seg);   // too deeply nested, don't split the rest of the text
+			if(paragraph)
+				gap = 2;
+
+			// count the characters of the tag, as ReadClause() does
+			for(j=ix; j<=tag_end; j++)
+			{
+				if(!utf8 || ((text[j] & 0xc0) != 0x80))
+					n_chars++;
+			}
+			n_bytes = tag_end + 1 - ix;
+
+			if(end_sentence)
+			{
+				end_sentence = 2;
+				if(gap == 0)
+					gap = 1;
+			}
+			if(gap && (n_blocking == 0))
+				candidate = AddSegment(&segments[n_seg], tag_end + 1, n_chars, stack, n_stack);
+			continue;
+		}
+
+		if(IsSpace(c))
+		{
+			if(c == '\n')
+				n_newlines++;
+			if(end_sentence == 1)
+				end_sentence = 2;
+			word_length = 0;
+			word_dot = 0;
+			n_chars++;
+			continue;
+		}
+
+		// the start of a word
+		split = 0;   // 1=end of sentence, 2=paragraph
+		if((end_sentence == 2) && !iswlower2(c))
+			split = 1;
+		if((n_newlines >= 2) || (gap == 2))
+			split = 2;
+
+		if(split && (n_blocking == 0))
+		{
+			if(!candidate)
+				candidate = AddSegment(&segments[n_seg], ix, n_chars, stack, n_stack);
+
+			seg_length = segments[n_seg].offset - segments[n_seg-1].offset;
+			if(candidate && ((seg_length >= min_length*2) || ((split == 2) && (seg_length >= min_length))))
+				n_seg++;
+		}
+		n_newlines = 0;
+		end_sentence = 0;
+		gap = 0;
+		candidate = 0;
+
+		if(((punct = lookupwchar(punct_chars, c)) != 0) && (punct_attributes[punct] & CLAUSE_BIT_SENTENCE))
+		{
+			// a full stop may be part of an abbreviation or a number, only split after a longer word
+			if((c != '.') || ((word_length >= 4) && !word_dot))
+				end_sentence = (punct_attributes[punct] & 0x8000) ? 2 : 1;
+		}
+		if(c == '.')
+			word_dot = 1;
+		word_length++;
+		n_chars++;
+	}
+	return(n_seg);
+}  //  end of FindSegments
+
+
+int SegmentAt(const char *text, int offset, int flags, TEXT_SEGMENT *seg)
+{//======================================================================
+// Make a segment which starts at offset in the text, where ReadClause() has ended a clause,
+// so that the rest of the text can be spoken later.  With SSML, the elements which are open
+// there are listed, as FindSegments() does.
+// Returns 0 if the text can't be split there, inside an element such as <say-as>.
+	int ix;
+	int tag_end;
+	int paragraph;
+	int n_chars = 0;
+	int n_stack = 0;
+	int n_blocking = 0;
+	int utf8 = ((flags & 7) < espeakCHARS_8BIT);
+	SEGMENT_TAG stack[N_SSML_STACK];
+
+	for(ix=0; ix < offset; ix++)
+	{
+		if((flags & espeakSSML) && (text[ix] == '<'))
+		{
+			if((tag_end = SegmentTag(text, ix, offset, stack, &n_stack, &n_blocking, &paragraph)) < 0)
+				return(0);
+			for(; ix < tag_end; ix++)
+			{
+				if(!utf8 || ((text[ix] & 0xc0) != 0x80))
+					n_chars++;
+			}
+		}
+		if(!utf8 || ((text[ix] & 0xc0) != 0x80))
+			n_chars++;
+	}
+
+	if(n_blocking > 0)
+		return(0);
+	return(AddSegment(seg, offset, n_chars, stack, n_stack));
+}  //  end of SegmentAt
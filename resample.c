@@ -0,0 +1,310 @@
+/***************************************************************************
+ *   Copyright (C) 2005 to 2014 by Jonathan Duddington                     *
+ *   email: jonsd@users.sourceforge.net                                    *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 3 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, see:                                 *
+ *               <http://www.gnu.org/licenses/>.                           *
+ ***************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "speech.h"
+#include "resample.h"
+
+#define N_RESAMPLE_TAB  (RESAMPLE_ZEROS * RESAMPLE_PHASES)
+#define N_RESAMPLE_BANK      0x40000   // the most filter coefficients in a RESAMPLER's bank
+#define RESAMPLE_BANK_SHIFT  14        // the bank's coefficients are scaled by 2^14
+#define KAISER_BETA     8.0
+#define PI              3.14159265358979
+
+// one side of the windowed sinc, from the centre to the last zero crossing
+static float resample_tab[N_RESAMPLE_TAB + 2];
+static int resample_tab_done = 0;
+
+
+static double BesselI0(double x)
+{//=============================
+	int k;
+	double term = 1.0;
+	double sum = 1.0;
+
+	for(k=1; k<40; k++)
+	{
+		term *= (x / (2*k)) * (x / (2*k));
+		sum += term;
+		if(term < sum * 1.0e-12)
+			break;
+	}
+	return(sum);
+}
+
+
+static double WindowedSinc(double x)
+{//================================
+// x is the distance from the centre, in zero crossings
+	double sinc;
+	double w;
+
+	x = fabs(x);
+	if(x >= RESAMPLE_ZEROS)
+		return(0);
+	if(x == 0)
+		sinc = 1.0;
+	else
+		sinc = sin(PI * x) / (PI * x);
+
+	w = x / RESAMPLE_ZEROS;
+	return(sinc * BesselI0(KAISER_BETA * sqrt(1.0 - w*w)) / BesselI0(KAISER_BETA));
+}
+
+
+static void MakeResampleTable(void)
+{//================================
+	int ix;
+
+	for(ix=0; ix<=N_RESAMPLE_TAB; ix++)
+	{
+		resample_tab[ix] = (float)WindowedSinc((double)ix / RESAMPLE_PHASES);
+	}
+	resample_tab[N_RESAMPLE_TAB+1] = 0;
+	resample_tab_done = 1;
+}
+
+
+static void MakeResampleBank(RESAMPLER *rs)
+{//========================================
+// Make the filter for each of the out_rate positions of an output sample between
+// two input samples, if it's not too big
+	int phase;
+	int j;
+	double x;
+	short *coef;
+
+	if(((long64)rs->out_rate * rs->n_taps) > N_RESAMPLE_BANK)
+		return;
+	if((rs->bank = (short *)malloc(rs->out_rate * rs->n_taps * sizeof(short))) == NULL)
+		return;
+
+	for(phase=0; phase < rs->out_rate; phase++)
+	{
+		coef = &rs->bank[phase * rs->n_taps];
+		for(j=0; j < rs->n_taps; j++)
+		{
+			// distance of input sample (pos - half_width + 1 + j) from the output sample
+			x = (rs->half_width - 1 - j) + (double)phase / rs->out_rate;
+			coef[j] = (short)floor(WindowedSinc(x * rs->cutoff) * rs->cutoff * (1 << RESAMPLE_BANK_SHIFT) + 0.5);
+		}
+	}
+}
+
+
+static int Hcf(int a, int b)
+{//=========================
+	int c;
+
+	while(b != 0)
+	{
+		c = a % b;
+		a = b;
+		b = c;
+	}
+	return(a);
+}
+
+
+int ResampleLength(int n_in, int in_rate, int out_rate)
+{//====================================================
+// The number of output samples for n_in input samples
+	return((int)(((long64)n_in * out_rate + in_rate - 1) / in_rate));
+}
+
+
+RESAMPLER *ResampleCreate(int in_rate, int out_rate)
+{//=================================================
+	RESAMPLER *rs;
+	int hcf;
+
+	if((in_rate <= 0) || (out_rate <= 0))
+		return(NULL);
+
+	if(resample_tab_done == 0)
+		MakeResampleTable();
+
+	if((rs = (RESAMPLER *)calloc(1, sizeof(RESAMPLER))) == NULL)
+		return(NULL);
+
+	hcf = Hcf(in_rate, out_rate);
+	rs->in_rate = in_rate / hcf;
+	rs->out_rate = out_rate / hcf;
+
+	// leave a transition band below the lower of the two Nyquist frequencies
+	rs->cutoff = 0.97;
+	if(out_rate < in_rate)
+		rs->cutoff = (0.97 * out_rate) / in_rate;
+	rs->half_width = (int)(RESAMPLE_ZEROS / rs->cutoff) + 1;
+	rs->n_taps = 2 * rs->half_width;
+	MakeResampleBank(rs);
+
+	// start with half_width zero samples, so that the first output sample
+	// is centred on the first input sample
+	rs->max_buf = 2*rs->half_width + 1024;
+	if((rs->buf = (short *)calloc(rs->max_buf, sizeof(short))) == NULL)
+	{
+		free(rs);
+		return(NULL);
+	}
+	rs->n_buf = rs->half_width;
+	rs->pos = rs->half_width;
+	return(rs);
+}
+
+
+void ResampleDelete(RESAMPLER *rs)
+{//===============================
+	if(rs != NULL)
+	{
+		free(rs->buf);
+		free(rs->bank);
+		free(rs);
+	}
+}
+
+
+static int AddResampleInput(RESAMPLER *rs, const short *in, int n_in)
+{//==================================================================
+	short *p;
+	int size;
+
+	if(rs->n_buf + n_in > rs->max_buf)
+	{
+		size = rs->n_buf + n_in + 1024;
+		if((p = (short *)realloc(rs->buf, size * sizeof(short))) == NULL)
+			return(-1);
+		rs->buf = p;
+		rs->max_buf = size;
+	}
+	if(in == NULL)
+		memset(&rs->buf[rs->n_buf], 0, n_in * sizeof(short));
+	else
+		memcpy(&rs->buf[rs->n_buf], in, n_in * sizeof(short));
+	rs->n_buf += n_in;
+	return(0);
+}
+
+
+static int ResampleOutput(RESAMPLER *rs, short *out, int max_out, long64 max_total)
+{//===============================================================================
+// Make the output samples for which all the filter's input is present
+	int n_out = 0;
+	int k;
+	int ix;
+	int discard;
+	int hw = rs->half_width;
+	int acc;
+	const short *in;
+	const short *coef;
+	double step;
+	double x;
+	double sum;
+
+	step = rs->cutoff * RESAMPLE_PHASES;
+
+	while((n_out < max_out) && (rs->n_out < max_total) && (rs->pos + hw < rs->n_buf))
+	{
+		in = &rs->buf[rs->pos - hw + 1];
+		if(rs->bank != NULL)
+		{
+			// a plain integer dot product, which compilers can vectorize
+			coef = &rs->bank[rs->frac * rs->n_taps];
+			acc = 0;
+			for(k=0; k < rs->n_taps; k++)
+				acc += in[k] * coef[k];
+			sum = (double)acc / (1 << RESAMPLE_BANK_SHIFT);
+		}
+		else
+		{
+			// x is the distance of each input sample from the output sample, in table steps
+			x = ((double)(hw - 1) + (double)rs->frac / rs->out_rate) * step;
+			sum = 0;
+			for(k=0; k < rs->n_taps; k++, x -= step)
+			{
+				double ax = fabs(x);
+				if((ix = (int)ax) < N_RESAMPLE_TAB)
+					sum += in[k] * (resample_tab[ix] + (ax - ix) * (resample_tab[ix+1] - resample_tab[ix]));
+			}
+			sum *= rs->cutoff;
+		}
+
+		if(sum > 32767)
+			sum = 32767;
+		else
+		if(sum < -32768)
+			sum = -32768;
+		out[n_out++] = (short)floor(sum + 0.5);
+		rs->n_out++;
+
+		rs->frac += rs->in_rate;
+		while(rs->frac >= rs->out_rate)
+		{
+			rs->frac -= rs->out_rate;
+			rs->pos++;
+		}
+	}
+
+	// discard the input which is no longer needed
+	if((discard = rs->pos - hw + 1) > 0)
+	{
+		if(discard > rs->n_buf)
+			discard = rs->n_buf;
+		memmove(rs->buf, &rs->buf[discard], (rs->n_buf - discard) * sizeof(short));
+		rs->n_buf -= discard;
+		rs->pos -= discard;
+	}
+	return(n_out);
+}
+
+
+int Resample(RESAMPLER *rs, const short *in, int n_in, short *out, int max_out)
+{//============================================================================
+// Adds n_in input samples and writes up to max_out output samples.
+// Returns the number of output samples. If this is max_out, there may be more,
+// which can be got by calling again with n_in = 0.
+	if(n_in > 0)
+	{
+		if(AddResampleInput(rs, in, n_in) != 0)
+			return(0);
+		rs->n_in += n_in;
+	}
+	return(ResampleOutput(rs, out, max_out, ~(long64)0));
+}
+
+
+int ResampleFlush(RESAMPLER *rs, short *out, int max_out)
+{//======================================================
+// Writes the output samples for the end of the input, up to max_out
+	long64 total;
+
+	if(rs->flushed == 0)
+	{
+		// the filter needs input beyond the last sample
+		if(AddResampleInput(rs, NULL, rs->half_width + 1) != 0)
+			return(0);
+		rs->flushed = 1;
+	}
+	total = (rs->n_in * rs->out_rate + rs->in_rate - 1) / rs->in_rate;
+	return(ResampleOutput(rs, out, max_out, total));
+}
@@ -0,0 +1,49 @@
+#ifndef RESAMPLE_H
+#define RESAMPLE_H
+
+/*
+Sample rate conversion of 16 bit mono sound.
+
+The filter is a Kaiser-windowed sinc. With the two rates divided by their
+highest common factor, an output sample can fall at only out_rate different
+positions between two input samples, so a polyphase bank of filters, one for
+each position, is made when the RESAMPLER is created and each output sample
+is an integer dot product. If the bank would be too big (rates such as
+44099 -> 22050) the filter is tabulated at RESAMPLE_PHASES points between zero
+crossings instead, interpolating between the two nearest points.
+
+When the rate is reduced the cutoff is lowered to below the new Nyquist
+frequency, so the output is band-limited.
+
+The conversion can be done in pieces: Resample() keeps the input which is
+still needed for later output samples, and ResampleFlush() gives the output
+for the end of the input.
+*/
+
+#define RESAMPLE_ZEROS    16     // zero crossings on each side of the filter centre
+#define RESAMPLE_PHASES   128    // filter points tabulated between zero crossings
+
+typedef struct {
+	int in_rate;          // the two rates, divided by their highest common factor
+	int out_rate;
+	double cutoff;        // as a fraction of the input Nyquist frequency
+	int half_width;       // half the filter length, in input samples
+	int n_taps;
+	short *bank;          // n_taps coefficients for each of the out_rate phases, or NULL
+	short *buf;           // input samples which are still needed
+	int n_buf;
+	int max_buf;
+	int pos;              // the input sample at or before the next output sample
+	int frac;             // and the output's distance after it, in units of 1/out_rate
+	long64 n_in;          // input and output samples so far
+	long64 n_out;
+	int flushed;
+} RESAMPLER;
+
+RESAMPLER *ResampleCreate(int in_rate, int out_rate);
+void ResampleDelete(RESAMPLER *rs);
+int Resample(RESAMPLER *rs, const short *in, int n_in, short *out, int max_out);
+int ResampleFlush(RESAMPLER *rs, short *out, int max_out);
+int ResampleLength(int n_in, int in_rate, int out_rate);
+
+#endif
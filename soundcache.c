@@ -0,0 +1,525 @@
+/***************************************************************************
+ *   Copyright (C) 2005 to 2014 by Jonathan Duddington                     *
+ *   email: jonsd@users.sourceforge.net                                    *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 3 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, see:                                 *
+ *               <http://www.gnu.org/licenses/>.                           *
+ ***************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <wchar.h>
+
+#include "speak_lib.h"
+#include "speech.h"
+#include "phoneme.h"
+#include "synthesize.h"
+#include "voice.h"
+#include "translate.h"
+#include "soundcache.h"
+
+#ifdef PLATFORM_WINDOWS
+#include <process.h>
+#define getpid _getpid
+#else
+#include <unistd.h>
+#endif
+
+#define N_SOUND_CACHE_HASH  1024
+#define N_CACHE_OUTPUT      8     // settings from speak_lib.c which are part of the state
+
+// what the sound in the cache depends on
+typedef struct {
+	voice_t voice;
+	Translator *translator;
+	int parameters[N_SPEECH_PARAM];
+	wchar_t punctlist[N_PUNCTLIST];
+	int samplerate;
+	int output[N_CACHE_OUTPUT];
+} SOUND_CACHE_STATE;
+
+struct SOUND_CACHE {
+	SOUND_CACHE_ENTRY *hash[N_SOUND_CACHE_HASH];
+	SOUND_CACHE_ENTRY *newest;
+	SOUND_CACHE_ENTRY *oldest;
+	int max_size;           // the most memory to use, in bytes
+	int size;
+	char *spill_path;       // directory for the sound of entries which don't fit in memory, or NULL
+	int spill_max;          // the most bytes to write there
+	int spill_size;
+	SOUND_CACHE_STATE state;   // for SoundCacheCheck()
+
+	// the entry which is being recorded
+	SOUND_CACHE_ENTRY *recording;
+	int recording_max_bufs;
+	int recording_max_bytes;
+	int recording_max_events;
+};
+
+static int spill_file_count = 0;
+
+
+static unsigned int SoundCacheHash(const unsigned char *key, int key_len)
+{//======================================================================
+	unsigned int hash = 2166136261u;
+
+	while(key_len-- > 0)
+		hash = (hash ^ *key++) * 16777619u;
+	return(hash);
+}
+
+
+static int IndexSize(SOUND_CACHE_ENTRY *p)
+{//=======================================
+// The memory used by an entry, apart from its sound and events
+	return(sizeof(SOUND_CACHE_ENTRY) + p->key_len + p->n_bufs * sizeof(SOUND_CACHE_BUF));
+}
+
+
+static int DataSize(SOUND_CACHE_ENTRY *p)
+{//======================================
+	return(p->n_bytes + p->n_events * sizeof(espeak_EVENT));
+}
+
+
+static void SpillFileName(SOUND_CACHE *cache, int number, char *fname)
+{//===================================================================
+	sprintf(fname, "%s%cespeak-%d-%d.snd", cache->spill_path, PATHSEP, (int)getpid(), number);
+}
+
+
+static void FreeEntry(SOUND_CACHE_ENTRY *p)
+{//========================================
+	if(p == NULL)
+		return;
+	free(p->key);
+	free(p->bufs);
+	free(p->sound);
+	free(p->events);
+	free(p);
+}
+
+
+static void UnlinkEntry(SOUND_CACHE *cache, SOUND_CACHE_ENTRY *p)
+{//==============================================================
+// Take an entry out of the list in order of use
+	if(p->newer != NULL)
+		p->newer->older = p->older;
+	else
+		cache->newest = p->older;
+	if(p->older != NULL)
+		p->older->newer = p->newer;
+	else
+		cache->oldest = p->newer;
+	p->newer = p->older = NULL;
+}
+
+
+static void LinkNewest(SOUND_CACHE *cache, SOUND_CACHE_ENTRY *p)
+{//=============================================================
+	p->older = cache->newest;
+	p->newer = NULL;
+	if(cache->newest != NULL)
+		cache->newest->newer = p;
+	else
+		cache->oldest = p;
+	cache->newest = p;
+}
+
+
+static void RemoveEntry(SOUND_CACHE *cache, SOUND_CACHE_ENTRY *p)
+{//==============================================================
+	SOUND_CACHE_ENTRY **pp;
+	char fname[sizeof(path_home)+80];
+
+	for(pp = &cache->hash[p->hash & (N_SOUND_CACHE_HASH-1)]; *pp != NULL; pp = &(*pp)->next)
+	{
+		if(*pp == p)
+		{
+			*pp = p->next;
+			break;
+		}
+	}
+	UnlinkEntry(cache, p);
+
+	cache->size -= IndexSize(p);
+	if(p->spill_file != 0)
+	{
+		SpillFileName(cache, p->spill_file, fname);
+		remove(fname);
+		cache->spill_size -= DataSize(p);
+	}
+	else
+		cache->size -= DataSize(p);
+	FreeEntry(p);
+}
+
+
+static int SpillEntry(SOUND_CACHE *cache, SOUND_CACHE_ENTRY *p)
+{//============================================================
+// Write the sound and events of an entry to a file, and free their memory.  Returns 1 if done.
+	SOUND_CACHE_ENTRY *q;
+	SOUND_CACHE_ENTRY *newer;
+	FILE *f;
+	int ok;
+	char fname[sizeof(path_home)+80];
+
+	if((cache->spill_path == NULL) || (DataSize(p) > cache->spill_max))
+		return(0);
+
+	// remove the least recently used entries which are in files, to make room
+	for(q = cache->oldest; (q != NULL) && (cache->spill_size + DataSize(p) > cache->spill_max); q = newer)
+	{
+		newer = q->newer;
+		if((q->spill_file != 0) && (q != p))
+			RemoveEntry(cache, q);
+	}
+	if(cache->spill_size + DataSize(p) > cache->spill_max)
+		return(0);
+
+	p->spill_file = ++spill_file_count;
+	SpillFileName(cache, p->spill_file, fname);
+	if((f = fopen(fname, "wb")) == NULL)
+	{
+		p->spill_file = 0;
+		return(0);
+	}
+	ok = (fwrite(p->sound, 1, p->n_bytes, f) == (size_t)p->n_bytes);
+	if(ok && (p->n_events > 0))
+		ok = (fwrite(p->events, sizeof(espeak_EVENT), p->n_events, f) == (size_t)p->n_events);
+	if(fclose(f) != 0)
+		ok = 0;
+	if(!ok)
+	{
+		remove(fname);
+		p->spill_file = 0;
+		return(0);
+	}
+
+	free(p->sound);
+	free(p->events);
+	p->sound = NULL;
+	p->events = NULL;
+	cache->size -= DataSize(p);
+	cache->spill_size += DataSize(p);
+	return(1);
+}
+
+
+static int UnspillEntry(SOUND_CACHE *cache, SOUND_CACHE_ENTRY *p)
+{//==============================================================
+// Read back the sound and events of an entry from its file.  Returns 1 if done.
+	FILE *f;
+	int ok;
+	char fname[sizeof(path_home)+80];
+
+	p->sound = (unsigned char *)malloc(p->n_bytes + 1);
+	p->events = (espeak_EVENT *)malloc(p->n_events * sizeof(espeak_EVENT) + 1);
+	if((p->sound == NULL) || (p->events == NULL))
+		return(0);
+
+	SpillFileName(cache, p->spill_file, fname);
+	if((f = fopen(fname, "rb")) == NULL)
+		return(0);
+	ok = (fread(p->sound, 1, p->n_bytes, f) == (size_t)p->n_bytes);
+	if(ok && (p->n_events > 0))
+		ok = (fread(p->events, sizeof(espeak_EVENT), p->n_events, f) == (size_t)p->n_events);
+	fclose(f);
+	if(!ok)
+		return(0);
+
+	remove(fname);
+	p->spill_file = 0;
+	cache->spill_size -= DataSize(p);
+	cache->size += DataSize(p);
+	return(1);
+}
+
+
+static void MakeRoom(SOUND_CACHE *cache, int needed)
+{//=================================================
+// Reduce the memory which is used, by the least recently used entries, so that 'needed' bytes
+// can be added
+	SOUND_CACHE_ENTRY *p;
+
+	while(cache->size + needed > cache->max_size)
+	{
+		// move the sound of the oldest entry which is in memory to the spill directory
+		for(p = cache->oldest; (p != NULL) && (p->spill_file != 0); p = p->newer);
+		if(p == NULL)
+			break;
+		if(SpillEntry(cache, p) == 0)
+			RemoveEntry(cache, p);
+	}
+
+	// then remove the oldest entries which are in files
+	while((cache->size + needed > cache->max_size) && (cache->oldest != NULL))
+		RemoveEntry(cache, cache->oldest);
+}
+
+
+SOUND_CACHE *SoundCacheCreate(int max_size)
+{//========================================
+// max_size: the most memory, in bytes, for the cache
+	SOUND_CACHE *cache;
+
+	if((cache = (SOUND_CACHE *)calloc(1, sizeof(SOUND_CACHE))) == NULL)
+		return(NULL);
+	cache->max_size = max_size;
+	return(cache);
+}
+
+
+void SoundCacheDelete(SOUND_CACHE *cache)
+{//======================================
+	if(cache == NULL)
+		return;
+	SoundCacheClear(cache);
+	free(cache->spill_path);
+	free(cache);
+}
+
+
+int SoundCacheSpill(SOUND_CACHE *cache, const char *path, int max_size)
+{//====================================================================
+// Use the directory 'path' for sound which doesn't fit in memory, up to max_size bytes.
+// path=NULL: don't use files.  Returns -1 if the path can't be used.
+	SoundCacheClear(cache);
+	free(cache->spill_path);
+	cache->spill_path = NULL;
+	cache->spill_max = 0;
+
+	if((path == NULL) || (max_size <= 0))
+		return(0);
+	if((strlen(path) >= sizeof(path_home)) || (GetFileLength(path) != -2))
+		return(-1);   // not a directory
+	if((cache->spill_path = strdup(path)) == NULL)
+		return(-1);
+	cache->spill_max = max_size;
+	return(0);
+}
+
+
+void SoundCacheClear(SOUND_CACHE *cache)
+{//=====================================
+	SoundCacheEnd(cache, 0);
+	while(cache->oldest != NULL)
+		RemoveEntry(cache, cache->oldest);
+	cache->size = 0;
+	cache->spill_size = 0;
+}
+
+
+int SoundCacheState(const unsigned char **state_bytes, const int *output, int n_output)
+{//====================================================================================
+// Gives the voice, speech parameters and output settings, which the sound depends on.
+// 'output' are settings which are kept by the caller.  Returns the size of the state.
+	static SOUND_CACHE_STATE state;
+	int ix;
+
+	memset(&state, 0, sizeof(state));
+	if(voice != NULL)
+		memcpy(&state.voice, voice, sizeof(voice_t));
+	state.translator = translator;
+	for(ix=0; ix<N_SPEECH_PARAM; ix++)
+		state.parameters[ix] = param_stack[0].parameter[ix];
+	memcpy(state.punctlist, option_punctlist, sizeof(state.punctlist));
+	state.samplerate = samplerate;
+	for(ix=0; (ix < n_output) && (ix < N_CACHE_OUTPUT); ix++)
+		state.output[ix] = output[ix];
+
+	*state_bytes = (const unsigned char *)&state;
+	return(sizeof(state));
+}
+
+
+int SoundCacheCheck(SOUND_CACHE *cache, const int *output, int n_output)
+{//=====================================================================
+// Empty the cache if the voice, speech parameters or output settings have changed since
+// its sounds were spoken.  Returns 1 if the cache has been emptied.
+	const unsigned char *state;
+
+	SoundCacheState(&state, output, n_output);
+	if(memcmp(state, &cache->state, sizeof(cache->state)) != 0)
+	{
+		SoundCacheClear(cache);
+		memcpy(&cache->state, state, sizeof(cache->state));
+		return(1);
+	}
+	return(0);
+}
+
+
+static SOUND_CACHE_ENTRY *FindEntry(SOUND_CACHE *cache, const void *key, int key_len, unsigned int hash)
+{//=====================================================================================================
+	SOUND_CACHE_ENTRY *p;
+
+	for(p = cache->hash[hash & (N_SOUND_CACHE_HASH-1)]; p != NULL; p = p->next)
+	{
+		if((p->hash == hash) && (p->key_len == key_len) && (memcmp(p->key, key, key_len) == 0))
+			return(p);
+	}
+	return(NULL);
+}
+
+
+SOUND_CACHE_ENTRY *SoundCacheLookup(SOUND_CACHE *cache, const void *key, int key_len)
+{//==================================================================================
+// Returns the entry for 'key', with its sound in memory, or NULL
+	SOUND_CACHE_ENTRY *p;
+
+	if((p = FindEntry(cache, key, key_len, SoundCacheHash((const unsigned char *)key, key_len))) == NULL)
+		return(NULL);
+
+	// it's now the most recently used
+	UnlinkEntry(cache, p);
+	if(p->spill_file != 0)
+	{
+		MakeRoom(cache, DataSize(p));
+		if(UnspillEntry(cache, p) == 0)
+		{
+			LinkNewest(cache, p);
+			RemoveEntry(cache, p);
+			return(NULL);
+		}
+	}
+	LinkNewest(cache, p);
+	return(p);
+}
+
+
+void SoundCacheStart(SOUND_CACHE *cache, const void *key, int key_len)
+{//===================================================================
+// Start to record the sound for 'key', which SoundCacheRecord() is given
+	SOUND_CACHE_ENTRY *p;
+
+	SoundCacheEnd(cache, 0);
+	if((p = (SOUND_CACHE_ENTRY *)calloc(1, sizeof(SOUND_CACHE_ENTRY))) == NULL)
+		return;
+	if((p->key = (unsigned char *)malloc(key_len + 1)) == NULL)
+	{
+		free(p);
+		return;
+	}
+	memcpy(p->key, key, key_len);
+	p->key_len = key_len;
+	p->hash = SoundCacheHash(p->key, key_len);
+	cache->recording = p;
+	cache->recording_max_bufs = 0;
+	cache->recording_max_bytes = 0;
+	cache->recording_max_events = 0;
+}
+
+
+void SoundCacheRecord(SOUND_CACHE *cache, const void *sound, int n_bytes, espeak_EVENT *events)
+{//============================================================================================
+	SOUND_CACHE_ENTRY *p;
+	int n_events;
+	void *q;
+
+	if((p = cache->recording) == NULL)
+		return;
+
+	for(n_events=0; events[n_events].type != espeakEVENT_LIST_TERMINATED; n_events++)
+	{
+		if((events[n_events].type == espeakEVENT_MARK) || (events[n_events].type == espeakEVENT_PLAY))
+		{
+			// these refer to names which are not kept
+			SoundCacheEnd(cache, 0);
+			return;
+		}
+	}
+
+	if(IndexSize(p) + DataSize(p) + n_bytes + (n_events+1) * sizeof(espeak_EVENT) > (unsigned int)cache->max_size)
+	{
+		// too big for the cache
+		SoundCacheEnd(cache, 0);
+		return;
+	}
+
+	if(p->n_bufs >= cache->recording_max_bufs)
+	{
+		cache->recording_max_bufs += 16;
+		if((q = realloc(p->bufs, cache->recording_max_bufs * sizeof(SOUND_CACHE_BUF))) == NULL)
+		{
+			SoundCacheEnd(cache, 0);
+			return;
+		}
+		p->bufs = (SOUND_CACHE_BUF *)q;
+	}
+	if(p->n_bytes + n_bytes > cache->recording_max_bytes)
+	{
+		cache->recording_max_bytes = (p->n_bytes + n_bytes) * 2;
+		if((q = realloc(p->sound, cache->recording_max_bytes)) == NULL)
+		{
+			SoundCacheEnd(cache, 0);
+			return;
+		}
+		p->sound = (unsigned char *)q;
+	}
+	if(p->n_events + n_events > cache->recording_max_events)
+	{
+		cache->recording_max_events = (p->n_events + n_events) * 2;
+		if((q = realloc(p->events, cache->recording_max_events * sizeof(espeak_EVENT))) == NULL)
+		{
+			SoundCacheEnd(cache, 0);
+			return;
+		}
+		p->events = (espeak_EVENT *)q;
+	}
+
+	p->bufs[p->n_bufs].n_bytes = n_bytes;
+	p->bufs[p->n_bufs].n_events = n_events;
+	p->n_bufs++;
+	if(n_bytes > 0)
+		memcpy(&p->sound[p->n_bytes], sound, n_bytes);
+	p->n_bytes += n_bytes;
+	memcpy(&p->events[p->n_events], events, n_events * sizeof(espeak_EVENT));
+	p->n_events += n_events;
+}
+
+
+void SoundCacheEnd(SOUND_CACHE *cache, int complete)
+{//=================================================
+// Finish recording.  If the sound is complete, add it to the cache.
+	SOUND_CACHE_ENTRY *p;
+	void *q;
+	int size;
+
+	if((p = cache->recording) == NULL)
+		return;
+	cache->recording = NULL;
+
+	size = IndexSize(p) + DataSize(p);
+	if(!complete || (size > cache->max_size) || (FindEntry(cache, p->key, p->key_len, p->hash) != NULL))
+	{
+		FreeEntry(p);
+		return;
+	}
+
+	// free the unused space
+	if((p->n_bytes > 0) && ((q = realloc(p->sound, p->n_bytes)) != NULL))
+		p->sound = (unsigned char *)q;
+	if((p->n_events > 0) && ((q = realloc(p->events, p->n_events * sizeof(espeak_EVENT))) != NULL))
+		p->events = (espeak_EVENT *)q;
+	if((p->n_bufs > 0) && ((q = realloc(p->bufs, p->n_bufs * sizeof(SOUND_CACHE_BUF))) != NULL))
+		p->bufs = (SOUND_CACHE_BUF *)q;
+
+	MakeRoom(cache, size);
+	p->next = cache->hash[p->hash & (N_SOUND_CACHE_HASH-1)];
+	cache->hash[p->hash & (N_SOUND_CACHE_HASH-1)] = p;
+	LinkNewest(cache, p);
+	cache->size += size;
+}
@@ -0,0 +1,58 @@
+#ifndef SOUNDCACHE_H
+#define SOUNDCACHE_H
+
+/*
+A cache of the sound of texts: the characters and keys which are spoken by
+espeak_Char() and espeak_Key(), and whole texts given to espeak_Synth().
+
+An entry holds what was passed to the SynthCallback function: the buffers
+of sound, as bytes so that any output format can be kept, and the events
+of each buffer.  The key is a string of bytes, which the caller makes from
+the text and anything else which the sound depends on.
+
+The cache has a limit on the memory which it uses.  When it's full, the
+entries which have been used least recently are removed, or if there is a
+spill directory their sound is written to a file there, and read back when
+the entry is next used.  The files belong to the process and are deleted
+when their entries are removed.
+
+SoundCacheState() gives the voice, speech parameters and output settings,
+which the caller can put in a key.  Or SoundCacheCheck() empties the cache
+when any of these have changed.
+*/
+
+typedef struct {
+	int n_bytes;
+	int n_events;
+} SOUND_CACHE_BUF;
+
+typedef struct SOUND_CACHE_ENTRY {
+	struct SOUND_CACHE_ENTRY *next;    // in the same hash chain
+	struct SOUND_CACHE_ENTRY *newer;   // the list of entries, in order of use
+	struct SOUND_CACHE_ENTRY *older;
+	unsigned int hash;
+	unsigned char *key;
+	int key_len;
+	int n_bufs;
+	SOUND_CACHE_BUF *bufs;
+	unsigned char *sound;              // the sound of all the buffers
+	espeak_EVENT *events;              // the events of all the buffers
+	int n_bytes;
+	int n_events;
+	int spill_file;                    // the sound and events are in this file, not in memory, or 0
+} SOUND_CACHE_ENTRY;
+
+typedef struct SOUND_CACHE SOUND_CACHE;
+
+SOUND_CACHE *SoundCacheCreate(int max_size);
+void SoundCacheDelete(SOUND_CACHE *cache);
+int SoundCacheSpill(SOUND_CACHE *cache, const char *path, int max_size);
+void SoundCacheClear(SOUND_CACHE *cache);
+int SoundCacheState(const unsigned char **state, const int *output, int n_output);
+int SoundCacheCheck(SOUND_CACHE *cache, const int *output, int n_output);
+SOUND_CACHE_ENTRY *SoundCacheLookup(SOUND_CACHE *cache, const void *key, int key_len);
+void SoundCacheStart(SOUND_CACHE *cache, const void *key, int key_len);
+void SoundCacheRecord(SOUND_CACHE *cache, const void *sound, int n_bytes, espeak_EVENT *events);
+void SoundCacheEnd(SOUND_CACHE *cache, int complete);
+
+#endif
@@ -36,6 +36,9 @@
 #include <winreg.h>
 #else  /* PLATFORM_POSIX */
 #include <unistd.h>
+#include <errno.h>
+#include <signal.h>
+#include <sys/wait.h>
 #endif
 
 #include "speak_lib.h"
@@ -44,10 +47,15 @@
 #include "voice.h"
 #include "translate.h"
 #include "debug.h"
+#include "databundle.h"
+#include "resample.h"
+#include "encode.h"
+#include "soundcache.h"
 
 #include "fifo.h"
 #include "event.h"
 #include "wave.h"
+#include "delivery.h"
 
 unsigned char *outbuf=NULL;
 
@@ -65,6 +73,47 @@ static int out_samplerate = 0;
 static int voice_samplerate = 22050;
 static espeak_ERROR err = EE_OK;
 
+// Conversion to the sample rate set by espeak_SetOutputRate()
+static int output_rate = 0;            // 0 = use the voice's sample rate
+static int synth_output_rate = 0;      // output_rate for the current Synthesize()
+static RESAMPLER *out_resampler = NULL;
+static int out_source_rate = 0;        // the sample rate being converted, 0 = not started
+static long out_source_base;           // count_samples when out_source_rate started
+static long out_rate_base;             // output samples at that point
+static long out_rate_count;            // output samples so far in this Synthesize()
+static short *out_rate_buf = NULL;
+static int out_rate_buf_size = 0;      // in samples
+
+// Encoding set by espeak_SetOutputFormat()
+static int output_format = espeakFORMAT_PCM16;
+static int synth_output_format = espeakFORMAT_PCM16;   // output_format for the current Synthesize()
+static int callback_format = espeakFORMAT_PCM16;       // the format of the sound which is being passed to synth_callback
+static ADPCM_STATE out_adpcm;
+static short out_adpcm_last;           // the last byte of the ADPCM stream
+
+// espeakINITIALIZE_ADAPTIVE_BUFFER: the first buffer of each text is short, and the next
+// ones double in size up to outbuf_size
+#define FIRST_BUFFER_MS  20
+static int adaptive_buffer = 0;
+
+// Events collected for espeak_GetEventTimeline()
+static int event_timeline = 0;         // espeakINITIALIZE_EVENT_TIMELINE
+static int synth_event_timeline = 0;   // event_timeline for the current Synthesize()
+static espeak_EVENT_TIMELINE timeline = {0, NULL, NULL, NULL, NULL, NULL};
+static int timeline_size = 0;
+static unsigned char *timeline_type = NULL;
+static int *timeline_length = NULL;
+static int *timeline_text_position = NULL;
+static int *timeline_sample = NULL;
+static int *timeline_number = NULL;
+
+// Caches of the sound of espeak_Char() and espeak_Key(), set by espeak_SetCharCache(),
+// and of espeak_Synth(), set by espeak_SetSynthCache()
+static SOUND_CACHE *char_cache = NULL;
+static int char_cache_options = 0;
+static SOUND_CACHE *synth_cache = NULL;
+static SOUND_CACHE *recording_cache = NULL;   // SoundCacheRecord() is given what is passed to the callback
+
 t_espeak_callback* synth_callback = NULL;
 int (* uri_callback)(int, const char *, const char *) = NULL;
 int (* phoneme_callback)(const char *) = NULL;
@@ -82,6 +131,40 @@ void WVoiceChanged(voice_t *wvoice)
 
 #ifdef USE_ASYNC
 
+// Time taken by espeak_Cancel(), for espeak_GetStats()
+static int64_t cancel_count = 0;
+static int64_t cancel_sum_us = 0;
+static int64_t cancel_max_us = 0;
+
+// The time from starting to synthesize a text to its first sound, and the time which each
+// buffer takes outside WavegenFill(), for espeak_GetStats().  These are read with STATS_LOAD()
+// in the caller's thread while the synthesis thread adds to them.
+static int64_t first_audio_count = 0;
+static int64_t first_audio_sum_us = 0;
+static int64_t first_audio_max_us = 0;
+static int64_t buffer_count = 0;
+static int64_t buffer_overhead_sum_us = 0;
+
+// A text which was suspended for commands of higher priority, and is being resumed
+static t_espeak_resume *resuming = NULL;
+static const char *text_file_path = NULL;   // the file which sync_espeak_SynthFile() is speaking
+
+// espeakINITIALIZE_CALLBACK_THREAD, in AUDIO_OUTPUT_RETRIEVAL mode: synth_callback is
+// QueueCallback(), and the delivery thread calls the SynthCallback function
+static int callback_thread = 0;
+static t_espeak_callback *user_callback = NULL;   // given to espeak_SetSynthCallback()
+
+static void WaitForEventSpace(void)
+{//================================
+// Wait until an event can be declared, but only for a short time so that a stop request is noticed
+	struct timespec the_end;
+
+	clock_gettime2(&the_end);
+	add_time_in_ms(&the_end, 5);
+	event_wait_for_space(&the_end);
+}
+
+
 static int dispatch_audio(short* outbuf, int length, espeak_EVENT* event)
 {//======================================================================
     int a_wave_can_be_played = fifo_is_command_enabled();
@@ -113,7 +196,8 @@ static int dispatch_audio(short* outbuf, int length, espeak_EVENT* event)
 			{
 				if(out_samplerate != 0)
 				{
-					// sound was previously open with a different sample rate
+					// sound was previously open with a different sample rate. Only a change by
+					// espeak_SetOutputRate() does this, other voices are converted to the device's rate
 					wave_close(my_audio);
                     espeakSleep(1000);
 				}
@@ -133,6 +217,11 @@ static int dispatch_audio(short* outbuf, int length, espeak_EVENT* event)
 		{
 			wave_write (my_audio, (char*)outbuf, 2*length);
 		}
+		else
+		if ((outbuf == NULL) && (out_samplerate != 0))
+		{
+			wave_flush(my_audio);   // the end of the sound
+		}
 
 		while(a_wave_can_be_played) {
             espeak_ERROR a_error = EE_OK;
@@ -151,7 +240,7 @@ static int dispatch_audio(short* outbuf, int length, espeak_EVENT* event)
 				break;
 			}
 			SHOW_TIME("dispatch_audio > EE_BUFFER_FULL\n");
-            espeakSleep(10);
+			WaitForEventSpace();
 			a_wave_can_be_played = fifo_is_command_enabled();
 		}
 	}
@@ -243,7 +332,7 @@ int sync_espeak_terminated_msg( uint32_t unique_identifier, void* user_data)
 		 		break;
 			}
 			SHOW_TIME("sync_espeak_terminated_msg > EE_BUFFER_FULL\n");
-            espeakSleep(10);
+			WaitForEventSpace();
 		}
 	}
 	else
@@ -329,6 +418,18 @@ void espeakSleep(unsigned int _ms){
 #endif
 }
 
+static int data_found(void)
+{//=======================
+// Is there an espeak-data directory, or a data bundle, at path_home ?
+	char fname[sizeof(path_home)+10];
+
+	if(GetFileLength(path_home) == -2)
+		return(1);
+
+	sprintf(fname,"%s.bundle",path_home);
+	return(GetFileLength(fname) > 0);
+}
+
 static void init_path(const char *path)
 {//====================================
 #ifdef PLATFORM_WINDOWS
@@ -347,7 +448,7 @@ static void init_path(const char *path)
     if((env = getenv("ESPEAK_DATA_PATH")) != NULL)
     {
         sprintf(path_home,"%s/espeak-data",env);
-        if(GetFileLength(path_home) == -2)
+        if(data_found())
             return;   // an espeak-data directory exists
     }
 
@@ -371,12 +472,12 @@ static void init_path(const char *path)
 	if((env = getenv("ESPEAK_DATA_PATH")) != NULL)
 	{
 		snprintf(path_home,sizeof(path_home),"%s/espeak-data",env);
-		if(GetFileLength(path_home) == -2)
+		if(data_found())
 			return;   // an espeak-data directory exists
 	}
 
 	snprintf(path_home,sizeof(path_home),"%s/espeak-data",getenv("HOME"));
-	if(access(path_home,R_OK) != 0)
+	if(!data_found())
 	{
 		strcpy(path_home,PATH_ESPEAK_DATA);
 	}
@@ -388,8 +489,17 @@ static int initialise(int control)
 	int param;
 	int result;
 	int srate = 22050;  // default sample rate 22050 Hz
+	char fname[sizeof(path_home)+10];
 
 	err = EE_OK;
+
+	// if there is a data bundle, the data files are read from that rather than from espeak-data
+#ifdef EMBED_DATA
+	AttachDataBundle(espeak_data_bundle, espeak_data_bundle_length);
+#endif
+	sprintf(fname,"%s.bundle",path_home);
+	OpenDataBundle(fname);
+
 	LoadConfig();
 
 	if((result = LoadPhData(&srate)) != 1)  // reads sample rate from espeak-data/phontab
@@ -405,6 +515,11 @@ static int initialise(int control)
 		else
 			fprintf(stderr,"Wrong version of espeak-data 0x%x (expects 0x%x) at %s\n",result,version_phdata,path_home);
 	}
+	if((output_rate >= 8000) && (output_rate < srate))
+	{
+		// synthesize at the lower rate, rather than converting the sound afterwards
+		srate = output_rate;
+	}
 	WavegenInit(srate,0);
 
 	memset(&current_voice_selected,0,sizeof(current_voice_selected));
@@ -419,14 +534,390 @@ static int initialise(int control)
 }
 
 
+static short *OutputRateBuffer(int n_samples)
+{//=========================================
+	short *p;
+
+	if(n_samples > out_rate_buf_size)
+	{
+		if((p = (short *)realloc(out_rate_buf, n_samples * sizeof(short))) == NULL)
+			return(NULL);
+		out_rate_buf = p;
+		out_rate_buf_size = n_samples;
+	}
+	return(out_rate_buf);
+}
+
+
+static void ResetOutputRate(void)
+{//==============================
+	ResampleDelete(out_resampler);
+	out_resampler = NULL;
+	out_source_rate = 0;
+	out_rate_count = 0;
+}
+
+
+static int FlushOutputRate(void)
+{//============================
+// Write the output for the end of the sound at the current rate into out_rate_buf.
+// Returns the number of samples.
+	int n = 0;
+	int max_out;
+
+	if(out_resampler != NULL)
+	{
+		max_out = ResampleLength(out_resampler->n_taps + 2, out_resampler->in_rate, out_resampler->out_rate);
+		if(OutputRateBuffer(max_out) != NULL)
+			n = ResampleFlush(out_resampler, out_rate_buf, max_out);
+		ResampleDelete(out_resampler);
+		out_resampler = NULL;
+	}
+	return(n);
+}
+
+
+static int ConvertOutputRate(short **buf, int length, espeak_EVENT *events)
+{//========================================================================
+// Convert the samples which WavegenFill() has made to synth_output_rate, and re-time the events.
+// *buf is changed to point to the converted samples. Returns their number.
+	int rate;
+	int n = 0;
+	int max_out;
+	short *out;
+	espeak_EVENT *ep;
+
+	rate = out_source_rate;
+	if(rate == 0)
+		rate = samplerate;
+
+	// a change of voice may change the sample rate, but report it as the output rate
+	for(ep = events; ep->type != espeakEVENT_LIST_TERMINATED; ep++)
+	{
+		if(ep->type == espeakEVENT_SAMPLERATE)
+		{
+			rate = ep->id.number;
+			ep->id.number = synth_output_rate;
+		}
+	}
+
+	if(rate != out_source_rate)
+	{
+		// finish the sound at the previous rate, and start converting from the new one
+		n = FlushOutputRate();
+		out_source_rate = rate;
+		out_source_base = count_samples - length;
+		out_rate_base = out_rate_count + n;
+		if(rate != synth_output_rate)
+			out_resampler = ResampleCreate(rate, synth_output_rate);
+	}
+
+	if((out_resampler == NULL) && (n == 0))
+	{
+		// this sound is already at the output rate, leave it in place
+		out = *buf;
+		n = length;
+	}
+	else
+	{
+		// this buffer may also complete output samples which were waiting for input
+		max_out = n + length;
+		if(out_resampler != NULL)
+			max_out = n + ResampleLength(length + out_resampler->n_taps + 2, out_resampler->in_rate, out_resampler->out_rate);
+		if((out = OutputRateBuffer(max_out)) == NULL)
+			return(0);
+
+		if(out_resampler == NULL)
+		{
+			memcpy(&out[n], *buf, length * sizeof(short));
+			n += length;
+		}
+		else
+		{
+			n += Resample(out_resampler, *buf, length, &out[n], max_out - n);
+		}
+	}
+
+	for(ep = events; ep->type != espeakEVENT_LIST_TERMINATED; ep++)
+	{
+		ep->sample = out_rate_base + (int)(((double)(ep->sample - out_source_base) * synth_output_rate) / out_source_rate + 0.5);
+		ep->audio_position = (int)(((double)ep->sample*1000.0)/synth_output_rate);
+	}
+
+	out_rate_count += n;
+	*buf = out;
+	return(n);
+}
+
+
+static int OutputBytes(int format, int length)
+{//===========================================
+// The size of 'length' samples, or bytes of encoded sound, as passed to the callback function
+	if(format == espeakFORMAT_PCM16)
+		return(length * 2);
+	return(length);
+}
+
+
+#ifdef USE_ASYNC
+static int QueueCallback(short *wav, int numsamples, espeak_EVENT *events)
+{//=======================================================================
+// The synth_callback with espeakINITIALIZE_CALLBACK_THREAD.  Returns 1 if the SynthCallback
+// function has asked to stop this text, as it would if it was called here.
+	return(delivery_add(wav, numsamples, (wav == NULL) ? 0 : OutputBytes(callback_format, numsamples), events));
+}
+
+
+static void SelectCallback(void)
+{//=============================
+	synth_callback = user_callback;
+	delivery_set_callback(user_callback);
+	if(callback_thread && (user_callback != NULL))
+		synth_callback = QueueCallback;
+}
+#endif
+
+
+static int EncodeOutput(int format, short *buf, int length, espeak_EVENT *events)
+{//=============================================================================
+// Encode the samples in place. Returns the number of bytes, and gives the events' positions in bytes.
+	espeak_EVENT *ep;
+
+	switch(format)
+	{
+	case espeakFORMAT_ULAW:
+		EncodeUlaw(buf, (unsigned char *)buf, length);
+		break;
+
+	case espeakFORMAT_ALAW:
+		EncodeAlaw(buf, (unsigned char *)buf, length);
+		break;
+
+	case espeakFORMAT_IMA_ADPCM:
+		for(ep = events; ep->type != espeakEVENT_LIST_TERMINATED; ep++)
+			ep->sample = ep->sample / 2;
+		length = EncodeAdpcm(&out_adpcm, buf, (unsigned char *)buf, length);
+		break;
+	}
+	return(length);
+}
+
+
+static int TimelineSize(int size)
+{//==============================
+	void *p;
+
+	if(size <= timeline_size)
+		return(0);
+	size += 256;
+	if((p = realloc(timeline_type, size)) == NULL)
+		return(-1);
+	timeline_type = (unsigned char *)p;
+	if((p = realloc(timeline_length, size * sizeof(int))) == NULL)
+		return(-1);
+	timeline_length = (int *)p;
+	if((p = realloc(timeline_text_position, size * sizeof(int))) == NULL)
+		return(-1);
+	timeline_text_position = (int *)p;
+	if((p = realloc(timeline_sample, size * sizeof(int))) == NULL)
+		return(-1);
+	timeline_sample = (int *)p;
+	if((p = realloc(timeline_number, size * sizeof(int))) == NULL)
+		return(-1);
+	timeline_number = (int *)p;
+	timeline_size = size;
+	return(0);
+}
+
+
+static void TimelineAdd(espeak_EVENT *events)
+{//==========================================
+// Move the events to the timeline, leaving the list empty
+	espeak_EVENT *ep;
+	int ix;
+
+	for(ep = events; ep->type != espeakEVENT_LIST_TERMINATED; ep++)
+	{
+		if(ep->type == espeakEVENT_SAMPLERATE)
+			continue;
+		if(TimelineSize(timeline.n_events + 1) != 0)
+			break;
+
+		ix = timeline.n_events++;
+		timeline_type[ix] = ep->type;
+		timeline_length[ix] = ep->length;
+		timeline_text_position[ix] = ep->text_position;
+		timeline_sample[ix] = ep->sample;
+		if((ep->type == espeakEVENT_MARK) || (ep->type == espeakEVENT_PLAY) || (ep->type == espeakEVENT_PHONEME))
+			timeline_number[ix] = 0;
+		else
+			timeline_number[ix] = ep->id.number;
+	}
+
+	// the arrays may have moved
+	timeline.type = timeline_type;
+	timeline.length = timeline_length;
+	timeline.text_position = timeline_text_position;
+	timeline.sample = timeline_sample;
+	timeline.number = timeline_number;
+
+	events[0].type = espeakEVENT_LIST_TERMINATED;
+	events[0].unique_identifier = my_unique_identifier;
+	events[0].user_data = my_user_data;
+}
+
+
+static int CountChars(const char *text, int length, int utf8)
+{//=========================================================
+	int ix;
+	int n_chars = 0;
+
+	for(ix=0; ix<length; ix++)
+	{
+		if(!utf8 || ((text[ix] & 0xc0) != 0x80))
+			n_chars++;
+	}
+	return(n_chars);
+}
+
+
+#ifdef USE_ASYNC
+static int SuspendText(const char *text, int flags)
+{//===============================================
+// A command of higher priority is waiting, at the end of a clause.  Queue a command which
+// speaks the rest of the text after it.  Returns 0 if the text can't be suspended here.
+	const char *position;
+	const char *p;
+	int ix;
+	int len = 0;
+	int tag_chars = 0;
+	int utf8 = ((flags & 7) < espeakCHARS_8BIT);
+	TEXT_SEGMENT seg;
+	t_espeak_resume r;
+	t_espeak_command *c;
+	char *buf;
+
+	if(synchronous_mode || skipping_text || (text == NULL) || ((position = ClausePosition()) == NULL) || (*position == 0))
+		return(0);
+	if((text_file_start != NULL) && ((flags & espeakSSML) || (text_file_path == NULL)))
+		return(0);   // an SSML file can't be read from a clause, without the tags in front of it
+	// wait for a clause which starts with a word, so that the SSML tags or punctuation
+	// in front of it don't make a clause of their own
+	for(p = position; isspace(*p); p++);
+	if(!isalnum(*p) && !(*p & 0x80))
+		return(0);
+	if(SegmentAt(text, position - text, flags, &seg) == 0)
+		return(0);
+
+	for(ix=0; ix<seg.n_tags; ix++)
+	{
+		tag_chars += CountChars(&text[seg.tag_offset[ix]], seg.tag_length[ix], utf8);
+		len += seg.tag_length[ix];
+	}
+
+	memset(&r, 0, sizeof(r));
+	r.unique_identifier = my_unique_identifier;
+	r.user_data = my_user_data;
+	r.flags = flags;
+	r.start_char = seg.char_offset;
+	r.char_shift = seg.char_offset - tag_chars;
+	r.word_base = count_words;
+	r.sentence_base = count_sentences;
+	r.new_sentence = new_sentence;
+	if(resuming != NULL)
+	{
+		r.start_char += resuming->char_shift;
+		r.char_shift += resuming->char_shift;
+		r.word_base += resuming->word_base;
+		r.sentence_base += resuming->sentence_base;
+	}
+	if(end_character_position > 0)
+	{
+		if(end_character_position <= seg.char_offset - tag_chars)
+			return(0);
+		r.end_position = end_character_position - (seg.char_offset - tag_chars);
+	}
+
+	if(text_file_start != NULL)
+	{
+		if((r.path = strdup(text_file_path)) == NULL)
+			return(0);
+		r.offset = position - text_file_start;
+	}
+	else
+	{
+		// the tags of the elements which are open, followed by the rest of the text
+		if((buf = (char *)malloc(len + strlen(position) + 4)) == NULL)
+			return(0);
+		len = 0;
+		for(ix=0; ix<seg.n_tags; ix++)
+		{
+			memcpy(&buf[len], &text[seg.tag_offset[ix]], seg.tag_length[ix]);
+			len += seg.tag_length[ix];
+		}
+		strcpy(&buf[len], position);
+		len += strlen(position);
+		memset(&buf[len], 0, 4);
+		r.text = buf;
+		r.size = len + 1;
+	}
+
+	if((c = create_espeak_resume(&r)) == NULL)
+		return(0);
+	fifo_resume_command(c);
+	return(1);
+}
+
+
+static int ElapsedUs(const struct timespec *start)
+{//===============================================
+// microseconds since start
+	struct timespec now;
+
+	clock_gettime_mono(&now);
+	return((now.tv_sec - start->tv_sec) * 1000000 + (now.tv_nsec - start->tv_nsec) / 1000);
+}
+
+
+static void AddTime(int64_t *count, int64_t *sum_us, int64_t *max_us, int us)
+{//==========================================================================
+// add a time to the counters of espeak_GetStats(), max_us may be NULL
+	STATS_STORE(*count, STATS_LOAD(*count) + 1);
+	STATS_STORE(*sum_us, STATS_LOAD(*sum_us) + us);
+	if((max_us != NULL) && (us > STATS_LOAD(*max_us)))
+		STATS_STORE(*max_us, us);
+}
+#endif
+
+
+static int HasSound(const short *samples, int length)
+{//==================================================
+// whether the samples are not all silence
+	while(length-- > 0)
+	{
+		if(*samples++ != 0)
+			return(1);
+	}
+	return(0);
+}
+
+
 static espeak_ERROR Synthesize(unsigned int unique_identifier, const void *text, int flags)
 {//========================================================================================
 	// Fill the buffer with output sound
 	int length;
+	short *out_samples;
 	int finished = 0;
 	int count_buffers = 0;
+	int suspended = 0;
+	int buffer_size = outbuf_size;
+	int had_sound = 0;
 #ifdef USE_ASYNC
 	uint32_t a_write_pos=0;
+	struct timespec synth_start;
+	struct timespec filled;
+
+	clock_gettime_mono(&synth_start);
 #endif
 
 #ifdef DEBUG_ENABLED
@@ -447,6 +938,31 @@ static espeak_ERROR Synthesize(unsigned int unique_identifier, const void *text,
 
 	count_samples = 0;
 
+	synth_output_rate = output_rate;
+	if(my_mode == AUDIO_OUTPUT_SYNCH_PLAYBACK)
+		synth_output_rate = 0;   // wavegen plays the sound itself
+	ResetOutputRate();
+
+	synth_output_format = output_format;
+	if((my_mode == AUDIO_OUTPUT_PLAYBACK) || (my_mode == AUDIO_OUTPUT_SYNCH_PLAYBACK))
+		synth_output_format = espeakFORMAT_PCM16;   // the sound is played
+	callback_format = synth_output_format;
+	AdpcmReset(&out_adpcm);
+
+	synth_event_timeline = event_timeline;
+	if((my_mode == AUDIO_OUTPUT_PLAYBACK) || (my_mode == AUDIO_OUTPUT_SYNCH_PLAYBACK))
+		synth_event_timeline = 0;
+	if(synth_event_timeline)
+		timeline.n_events = 0;
+
+	if(adaptive_buffer && (my_mode != AUDIO_OUTPUT_PLAYBACK))
+	{
+		// a short first buffer, so that the sound starts sooner
+		buffer_size = ((FIRST_BUFFER_MS * samplerate)/1000) * 2;
+		if(buffer_size > outbuf_size)
+			buffer_size = outbuf_size;
+	}
+
 #ifdef USE_ASYNC
 	if(my_mode == AUDIO_OUTPUT_PLAYBACK)
 	{
@@ -459,12 +975,24 @@ static espeak_ERROR Synthesize(unsigned int unique_identifier, const void *text,
 		SetVoiceByName("default");
 	}
 
+#ifdef USE_ASYNC
+	if((my_mode == AUDIO_OUTPUT_PLAYBACK) && (synth_output_rate == 0))
+	{
+		// Keep the audio device at one rate, and convert the sound of voices which
+		// have another rate (such as mbrola voices), rather than re-opening the device.
+		synth_output_rate = (out_samplerate != 0) ? out_samplerate : samplerate_native;
+	}
+#endif
+
 	SpeakNextClause(NULL,text,0);
 
 	if(my_mode == AUDIO_OUTPUT_SYNCH_PLAYBACK)
 	{
 		for(;;)
 		{
+#ifdef USE_ASYNC
+			WavegenWaitSound(300);   // until the sound output wants more, or 0.3s
+#else
 #ifdef PLATFORM_WINDOWS
 			Sleep(300);   // 0.3s
 #else
@@ -477,6 +1005,7 @@ static espeak_ERROR Synthesize(unsigned int unique_identifier, const void *text,
 #else
 			sleep(1);
 #endif
+#endif
 #endif
 			if(SynthOnTimer() != 0)
 				break;
@@ -490,9 +1019,12 @@ static espeak_ERROR Synthesize(unsigned int unique_identifier, const void *text,
 		SHOW("Synthesize > %s\n","for (next)");
 #endif
 		out_ptr = outbuf;
-		out_end = &outbuf[outbuf_size];
+		out_end = &outbuf[buffer_size];
 		event_list_ix = 0;
 		WavegenFill(0);
+#ifdef USE_ASYNC
+		clock_gettime_mono(&filled);
+#endif
 
 		length = (out_ptr - outbuf)/2;
 		count_samples += length;
@@ -500,11 +1032,29 @@ static espeak_ERROR Synthesize(unsigned int unique_identifier, const void *text,
 		event_list[event_list_ix].unique_identifier = my_unique_identifier;
 		event_list[event_list_ix].user_data = my_user_data;
 
+		out_samples = (short *)outbuf;
+		if(synth_output_rate != 0)
+			length = ConvertOutputRate(&out_samples, length, event_list);
+
+		if(!had_sound && HasSound(out_samples, length))
+		{
+			had_sound = 1;
+#ifdef USE_ASYNC
+			AddTime(&first_audio_count, &first_audio_sum_us, &first_audio_max_us, ElapsedUs(&synth_start));
+#endif
+		}
+		if(had_sound && (buffer_size < outbuf_size))
+		{
+			// espeakINITIALIZE_ADAPTIVE_BUFFER, fewer buffers after the start of the sound,
+			// but keep them short through leading silence
+			if((buffer_size *= 2) > outbuf_size)
+				buffer_size = outbuf_size;
+		}
 		count_buffers++;
 		if (my_mode==AUDIO_OUTPUT_PLAYBACK)
 		{
 #ifdef USE_ASYNC
-			finished = create_events((short *)outbuf, length, event_list, a_write_pos);
+			finished = create_events(out_samples, length, event_list, a_write_pos);
 			if(finished < 0)
 				return EE_INTERNAL_ERROR;
 			length = 0; // the wave data are played once.
@@ -512,8 +1062,17 @@ static espeak_ERROR Synthesize(unsigned int unique_identifier, const void *text,
 		}
 		else
 		{
-			finished = synth_callback((short *)outbuf, length, event_list);
+			if(synth_output_format != espeakFORMAT_PCM16)
+				length = EncodeOutput(synth_output_format, out_samples, length, event_list);
+			if(recording_cache != NULL)
+				SoundCacheRecord(recording_cache, out_samples, OutputBytes(synth_output_format, length), event_list);
+			if(synth_event_timeline)
+				TimelineAdd(event_list);
+			finished = synth_callback(out_samples, length, event_list);
 		}
+#ifdef USE_ASYNC
+		AddTime(&buffer_count, &buffer_overhead_sum_us, NULL, ElapsedUs(&filled));
+#endif
 		if(finished)
 		{
 			SpeakNextClause(NULL,0,2);  // stop
@@ -531,8 +1090,45 @@ static espeak_ERROR Synthesize(unsigned int unique_identifier, const void *text,
 				event_list[0].unique_identifier = my_unique_identifier;
 				event_list[0].user_data = my_user_data;
 
-				if(SpeakNextClause(NULL,NULL,1)==0)
+#ifdef USE_ASYNC
+				// speak the rest of the text after a command of higher priority
+				if(!synchronous_mode && fifo_is_preempted())
+					suspended = SuspendText((const char *)text, flags);
+#endif
+				if(suspended || (SpeakNextClause(NULL,NULL,1)==0))
 				{
+					if((synth_output_rate != 0) && ((length = FlushOutputRate()) > 0))
+					{
+						// the end of the sound, which the resampler was holding
+						event_list_ix = 0;
+#ifdef USE_ASYNC
+						if (my_mode==AUDIO_OUTPUT_PLAYBACK)
+						{
+							if(create_events(out_rate_buf, length, event_list, a_write_pos) < 0)
+								return err = EE_INTERNAL_ERROR;
+						}
+						else
+#endif
+						{
+							if(synth_output_format != espeakFORMAT_PCM16)
+								length = EncodeOutput(synth_output_format, out_rate_buf, length, event_list);
+							if(recording_cache != NULL)
+								SoundCacheRecord(recording_cache, out_rate_buf, OutputBytes(synth_output_format, length), event_list);
+							synth_callback(out_rate_buf, length, event_list);
+						}
+					}
+					if((synth_output_format == espeakFORMAT_IMA_ADPCM) && (AdpcmFlush(&out_adpcm, (unsigned char *)&out_adpcm_last) > 0))
+					{
+						event_list[0].type = espeakEVENT_LIST_TERMINATED;
+						if(recording_cache != NULL)
+							SoundCacheRecord(recording_cache, &out_adpcm_last, 1, event_list);
+						synth_callback(&out_adpcm_last, 1, event_list);
+					}
+					if((recording_cache != NULL) && !suspended)
+					{
+						SoundCacheEnd(recording_cache, 1);   // the sound is complete
+						recording_cache = NULL;
+					}
 #ifdef USE_ASYNC
 					if (my_mode==AUDIO_OUTPUT_PLAYBACK)
 					{
@@ -540,6 +1136,7 @@ static espeak_ERROR Synthesize(unsigned int unique_identifier, const void *text,
 							return err = EE_INTERNAL_ERROR;
 					}
 					else
+					if(!suspended)
 					{
 						synth_callback(NULL, 0, event_list);  // NULL buffer ptr indicates end of data
 					}
@@ -569,105 +1166,893 @@ static const char* label[] = {
 #endif
 
 
-void MarkerEvent(int type, unsigned int char_position, int value, int value2, unsigned char *out_ptr)
-{//==================================================================================================
-    // type: 1=word, 2=sentence, 3=named mark, 4=play audio, 5=end, 7=phoneme
-    espeak_EVENT *ep;
-    double time;
+void MarkerEvent(int type, unsigned int char_position, int value, int value2, unsigned char *out_ptr)
+{//==================================================================================================
+    // type: 1=word, 2=sentence, 3=named mark, 4=play audio, 5=end, 7=phoneme
+    espeak_EVENT *ep;
+    double time;
+
+	ENTER("MarkerEvent");
+
+	if((event_list == NULL) || (event_list_ix >= (n_event_list-2)))
+		return;
+
+	ep = &event_list[event_list_ix++];
+	ep->type = (espeak_EVENT_TYPE)type;
+	ep->unique_identifier = my_unique_identifier;
+	ep->user_data = my_user_data;
+	ep->text_position = char_position & 0xffffff;
+	ep->length = char_position >> 24;
+
+#ifdef USE_ASYNC
+	if(resuming != NULL)
+	{
+		// the events of the rest of a text are given for the whole text
+		if(type != espeakEVENT_SAMPLERATE)
+		{
+			if((ep->text_position + resuming->char_shift) > resuming->start_char)
+				ep->text_position += resuming->char_shift;
+			else
+			if(type == espeakEVENT_WORD)
+				ep->text_position = resuming->start_char;   // a word which is given the start of its clause
+			else
+			{
+				event_list_ix--;   // from the SSML tags which have been put in front of it
+				return;
+			}
+		}
+		if(type == espeakEVENT_WORD)
+			value += resuming->word_base;
+		else
+		if((type == espeakEVENT_SENTENCE) || (type == espeakEVENT_END))
+			value += resuming->sentence_base;
+	}
+#endif
+
+	time = ((double)(count_samples + mbrola_delay + (out_ptr - out_start)/2)*1000.0)/samplerate;
+	ep->audio_position = (int)time;
+	ep->sample = (count_samples + mbrola_delay + (out_ptr - out_start)/2);
+
+#ifdef DEBUG_ENABLED
+	SHOW("MarkerEvent > count_samples=%d, out_ptr=%x, out_start=0x%x\n",count_samples, out_ptr, out_start);
+	SHOW("*** MarkerEvent > type=%s, uid=%d, text_pos=%d, length=%d, audio_position=%d, sample=%d\n",
+			label[ep->type], ep->unique_identifier, ep->text_position, ep->length,
+			ep->audio_position, ep->sample);
+#endif
+
+	if((type == espeakEVENT_MARK) || (type == espeakEVENT_PLAY))
+		ep->id.name = &namedata[value];
+	else
+//#ifdef deleted
+// temporarily removed, don't introduce until after eSpeak version 1.46.02
+	if(type == espeakEVENT_PHONEME)
+	{
+		int *p;
+		p = (int *)(ep->id.string);
+		p[0] = value;
+		p[1] = value2;
+	}
+	else
+//#endif
+	{
+		ep->id.number = value;
+	}
+}  //  end of MarkerEvent
+
+
+
+
+static void CacheOutput(int *output)
+{//================================
+// The output settings which the sound in a cache depends on
+	output[0] = output_rate;
+	output[1] = output_format;
+	output[2] = option_no_events;
+	output[3] = option_phoneme_events;
+	output[4] = outbuf_size;
+	output[5] = n_event_list;
+}
+
+
+static int CacheAvailable(void)
+{//============================
+// Returns 1 if sound can be cached: it's passed to the callback function, not played
+	if((synth_callback == NULL) || (translator == NULL) ||
+		(my_mode == AUDIO_OUTPUT_PLAYBACK) || (my_mode == AUDIO_OUTPUT_SYNCH_PLAYBACK))
+		return(0);
+#ifdef USE_ASYNC
+	if(resuming != NULL)
+		return(0);   // the events of the rest of a text are changed by MarkerEvent()
+#endif
+	return(1);
+}
+
+
+static void CacheSpeak(SOUND_CACHE_ENTRY *entry)
+{//=============================================
+// Pass the sound and events of a cache entry to the callback function
+	unsigned char *sound;
+	espeak_EVENT *events;
+	short *buf;
+	int ix;
+	int j;
+	int n_bytes;
+	int n_events;
+
+	if(event_timeline)
+		timeline.n_events = 0;
+	callback_format = output_format;
+	sound = entry->sound;
+	events = entry->events;
+	for(ix=0; ix < entry->n_bufs; ix++)
+	{
+		n_bytes = entry->bufs[ix].n_bytes;
+		n_events = entry->bufs[ix].n_events;
+
+		// the callback may change the sound, so give it a copy
+		if((buf = OutputRateBuffer(n_bytes/2 + 1)) == NULL)
+			return;
+		memcpy(buf, sound, n_bytes);
+		memcpy(event_list, events, n_events * sizeof(espeak_EVENT));
+		for(j=0; j <= n_events; j++)
+		{
+			event_list[j].unique_identifier = my_unique_identifier;
+			event_list[j].user_data = my_user_data;
+		}
+		event_list[n_events].type = espeakEVENT_LIST_TERMINATED;
+		if(event_timeline)
+			TimelineAdd(event_list);
+
+		if(synth_callback(buf, (output_format == espeakFORMAT_PCM16) ? n_bytes/2 : n_bytes, event_list) != 0)
+			return;
+		sound += n_bytes;
+		events += n_events;
+	}
+
+	event_list[0].type = espeakEVENT_LIST_TERMINATED;
+	event_list[0].unique_identifier = my_unique_identifier;
+	event_list[0].user_data = my_user_data;
+	synth_callback(NULL, 0, event_list);  // NULL buffer ptr indicates end of data
+}
+
+
+static int CacheCallback(short *wav, int numsamples, espeak_EVENT *events)
+{//=====================================================================
+// The callback while the cache is being filled
+	(void)wav;
+	(void)numsamples;
+	(void)events;
+	return(0);
+}
+
+
+static void CharCacheAlphabet(void)
+{//================================
+// Put the letters of the language's alphabet into the cache
+	t_espeak_callback *callback = synth_callback;
+	int timeline_option = event_timeline;
+	int first;
+	int last;
+	int c;
+	char key[20];
+	char text[80];
+
+	first = translator->letter_bits_offset;
+	last = first + 0xff;
+	if(first == 0)
+	{
+		first = 'a';
+		last = 'z';
+	}
+
+	synth_callback = CacheCallback;
+	event_timeline = 0;
+	for(c = first; c <= last; c++)
+	{
+		if(!iswalpha2(c) || !iswlower2(c))
+			continue;
+		sprintf(key, "C%d", c);
+		if(SoundCacheLookup(char_cache, key, strlen(key)) != NULL)
+			continue;
+
+		SoundCacheStart(char_cache, key, strlen(key));
+		recording_cache = char_cache;
+		sprintf(text, "<say-as interpret-as=\"tts:char\">&#%d;</say-as>", c);
+		Synthesize(0, text, espeakSSML);
+		recording_cache = NULL;
+		SoundCacheEnd(char_cache, 0);
+	}
+	synth_callback = callback;
+	event_timeline = timeline_option;
+}
+
+
+static int CharCacheCheck(void)
+{//============================
+// Returns 1 if the sound of characters and keys can be cached, and empties the
+// cache if it was made with a different voice, parameters or output settings.
+	int output[6];
+
+	if((char_cache == NULL) || (CacheAvailable() == 0))
+		return(0);
+
+	CacheOutput(output);
+	if(SoundCacheCheck(char_cache, output, 6) && (char_cache_options & espeakCHARCACHE_ALPHABET))
+		CharCacheAlphabet();
+	return(1);
+}
+
+
+static void SpeakCached(const char *key, const char *text, int flags)
+{//==================================================================
+// Speak a character or key, using the cache if it's enabled.  key=NULL: don't cache it.
+	SOUND_CACHE_ENTRY *entry;
+
+	my_unique_identifier = 0;
+	my_user_data = NULL;
+
+	if((key != NULL) && CharCacheCheck())
+	{
+		if((entry = SoundCacheLookup(char_cache, key, strlen(key))) != NULL)
+		{
+			CacheSpeak(entry);
+			return;
+		}
+		SoundCacheStart(char_cache, key, strlen(key));
+		recording_cache = char_cache;
+	}
+	Synthesize(0, text, flags);
+
+	// if the sound was not completed, it's not kept
+	if(recording_cache != NULL)
+	{
+		SoundCacheEnd(recording_cache, 0);
+		recording_cache = NULL;
+	}
+}
+
+
+static unsigned char *SynthCacheKey(const void *text, unsigned int flags, int *key_len)
+{//===================================================================================
+// The key for the sound of 'text' in synth_cache: the voice, speech parameters and output
+// settings, the flags, and the text.  Returns NULL if the sound should not be cached.
+	const unsigned char *state;
+	unsigned char *key;
+	int state_len;
+	int text_len;
+	int output[6];
+
+	if((text == NULL) || (option_phonemes != 0) || (phoneme_callback != NULL) ||
+		((flags & espeakSSML) && (uri_callback != NULL)))
+		return(NULL);   // these callbacks and outputs would be missed when the sound is cached
+
+	switch(flags & 7)
+	{
+	case espeakCHARS_WCHAR:
+		text_len = wcslen((const wchar_t *)text) * sizeof(wchar_t);
+		break;
+
+	case espeakCHARS_16BIT:
+		for(text_len=0; ((const unsigned short *)text)[text_len] != 0; text_len++);
+		text_len *= 2;
+		break;
+
+	default:
+		text_len = strlen((const char *)text);
+		break;
+	}
+
+	CacheOutput(output);
+	state_len = SoundCacheState(&state, output, 6);
+	*key_len = state_len + sizeof(flags) + text_len;
+	if((key = (unsigned char *)malloc(*key_len)) == NULL)
+		return(NULL);
+	memcpy(key, state, state_len);
+	memcpy(&key[state_len], &flags, sizeof(flags));
+	memcpy(&key[state_len + sizeof(flags)], text, text_len);
+	return(key);
+}
+
+
+espeak_ERROR sync_espeak_Synth(unsigned int unique_identifier, const void *text, size_t size,
+		      unsigned int position, espeak_POSITION_TYPE position_type,
+		      unsigned int end_position, unsigned int flags, void* user_data)
+{//===========================================================================
+    espeak_ERROR aStatus;
+    int i=0;
+	unsigned char *key;
+	int key_len;
+	SOUND_CACHE_ENTRY *entry;
+
+#ifdef DEBUG_ENABLED
+	ENTER("sync_espeak_Synth");
+	SHOW("sync_espeak_Synth > position=%d, position_type=%d, end_position=%d, flags=%d, user_data=0x%x, text=%s\n", position, position_type, end_position, flags, user_data, text);
+#endif
+
+	InitText(flags);
+#ifdef USE_ASYNC
+	if(resuming != NULL)
+		new_sentence = resuming->new_sentence;
+#endif
+	my_unique_identifier = unique_identifier;
+	my_user_data = user_data;
+
+    for (i=0; i < N_SPEECH_PARAM; i++)
+		saved_parameters[i] = param_stack[0].parameter[i];
+
+	switch(position_type)
+		{
+		case POS_CHARACTER:
+			skip_characters = position;
+			break;
+
+		case POS_WORD:
+			skip_words = position;
+			break;
+
+		case POS_SENTENCE:
+			skip_sentences = position;
+			break;
+
+		}
+	if(skip_characters || skip_words || skip_sentences)
+		skipping_text = 1;
+
+	end_character_position = end_position;
+
+	if((synth_cache != NULL) && (translator == NULL))
+		SetVoiceByName("default");   // as Synthesize() would, so that the voice is in the cache key
+
+	if((synth_cache != NULL) && (position == 0) && (end_position == 0) && CacheAvailable() &&
+		((key = SynthCacheKey(text, flags, &key_len)) != NULL))
+	{
+		entry = SoundCacheLookup(synth_cache, key, key_len);
+		if(entry == NULL)
+		{
+			SoundCacheStart(synth_cache, key, key_len);
+			recording_cache = synth_cache;
+		}
+		free(key);
+		if(entry != NULL)
+		{
+			CacheSpeak(entry);
+			return(EE_OK);
+		}
+	}
+
+	aStatus = Synthesize(unique_identifier, text, flags);
+
+	// if the sound was not completed, it's not kept
+	if(recording_cache != NULL)
+	{
+		SoundCacheEnd(recording_cache, 0);
+		recording_cache = NULL;
+	}
+	#ifdef USE_ASYNC
+	wave_flush(my_audio);
+	#endif
+
+	SHOW_TIME("LEAVE sync_espeak_Synth");
+	return aStatus;
+}  //  end of sync_espeak_Synth
+
+
+
+
+espeak_ERROR sync_espeak_SynthFile(unsigned int unique_identifier, const char *path,
+			   unsigned int offset, unsigned int flags, void* user_data)
+{//=========================================================================
+	espeak_ERROR aStatus;
+	char *data;
+	unsigned int length;
+	int mapped = 1;
+	FILE *f;
+
+	if((flags & 7) == espeakCHARS_WCHAR)
+		return(EE_INTERNAL_ERROR);
+
+	// the text is used in place from the mapped file, which is followed by a zero byte
+	if((data = MapFile(path, &length, 1)) == NULL)
+	{
+		// can't be mapped with a terminator, read it instead
+		mapped = 0;
+		length = GetFileLength(path);
+		if((length > 0x7fffffff) || ((f = fopen(path,"rb")) == NULL))
+			return(EE_INTERNAL_ERROR);
+		if((data = (char *)malloc(length + 2)) == NULL)
+		{
+			fclose(f);
+			return(EE_INTERNAL_ERROR);
+		}
+		length = fread(data, 1, length, f);
+		data[length] = data[length+1] = 0;
+		fclose(f);
+	}
+
+	if(offset > length)
+		offset = length;
+
+	text_file_start = data;
+#ifdef USE_ASYNC
+	text_file_path = path;
+#endif
+	aStatus = sync_espeak_Synth(unique_identifier, &data[offset], length - offset + 1, 0, POS_CHARACTER, 0, flags, user_data);
+	text_file_start = NULL;
+#ifdef USE_ASYNC
+	text_file_path = NULL;
+#endif
+
+	if(mapped)
+		UnmapFile(data, length);
+	else
+		free(data);
+
+	SHOW_TIME("LEAVE sync_espeak_SynthFile");
+	return(aStatus);
+}  //  end of sync_espeak_SynthFile
+
+
+#ifdef USE_ASYNC
+espeak_ERROR sync_espeak_Resume(t_espeak_resume *resume)
+{//=====================================================
+// Speak the rest of a text or file, which was suspended by SuspendText()
+	espeak_ERROR aStatus;
+
+	ENTER("sync_espeak_Resume");
+
+	resuming = resume;
+	if(resume->text != NULL)
+		aStatus = sync_espeak_Synth(resume->unique_identifier, resume->text, resume->size, 0, POS_CHARACTER,
+				resume->end_position, resume->flags, resume->user_data);
+	else
+		aStatus = sync_espeak_SynthFile(resume->unique_identifier, resume->path, resume->offset,
+				resume->flags, resume->user_data);
+	resuming = NULL;
+
+	return(aStatus);
+}  //  end of sync_espeak_Resume
+#endif
+
+
+
+// Speaking a long text in parallel.
+// The text is split into segments by FindSegments().  Worker processes, which are forked from
+// this one, speak the segments into temporary files.  These are passed to the callback function
+// in order, with their events adjusted to match the whole text.  All the workers are forked from
+// the state at the start of the text, so that they give the same speech as speaking it here.
+
+#ifdef PLATFORM_POSIX
+
+#define SEGMENT_MIN_LENGTH  1000   // bytes
+
+typedef struct {
+	pid_t pid;     // 0 if the worker is not running
+	FILE *f_out;   // NULL if the worker has not been started
+} SEGMENT_WORKER;
+
+static FILE *f_segment_out = NULL;   // output from a worker process
+static t_espeak_callback *segment_callback = NULL;
+static int segment_finished;
+static int segment_start_char;       // character offset of the segment in the text
+static int segment_char_shift;       // adjustment to text_position
+static long segment_sample_base;     // number of samples in the previous segments
+static long segment_samples;
+static int segment_word_base;
+static int segment_sentence_base;
+static int segment_format;           // the output format, which is encoded here rather than by the segments
+static int segment_timeline;         // event_timeline, which is collected here
+
+
+static char *SegmentText(const char *text, TEXT_SEGMENT *segments, int seg_ix, int n_segments, int text_length, int *length)
+{//=================================================================================================================
+// Make a copy of the text of segment seg_ix, preceded by the SSML tags of the elements which
+// are open at the start of the segment
+	TEXT_SEGMENT *seg = &segments[seg_ix];
+	int end = text_length;
+	int ix;
+	int len = 0;
+	char *buf;
+
+	if(seg_ix+1 < n_segments)
+		end = segments[seg_ix+1].offset;
+
+	for(ix=0; ix<seg->n_tags; ix++)
+		len += seg->tag_length[ix];
+
+	if((buf = (char *)malloc(len + end - seg->offset + 4)) == NULL)
+		return(NULL);
+
+	len = 0;
+	for(ix=0; ix<seg->n_tags; ix++)
+	{
+		memcpy(&buf[len], &text[seg->tag_offset[ix]], seg->tag_length[ix]);
+		len += seg->tag_length[ix];
+	}
+	memcpy(&buf[len], &text[seg->offset], end - seg->offset);
+	len += (end - seg->offset);
+	memset(&buf[len], 0, 4);
+
+	*length = len;
+	return(buf);
+}
+
+
+static int SegmentDeliver(short *wav, int numsamples, espeak_EVENT *events)
+{//=======================================================================
+// Callback for the segment which is being spoken.  Adjust the events for the position
+// of the segment in the text and pass them to the user's callback function.
+	espeak_EVENT *ep;
+	espeak_EVENT *ep2;
+
+	if(wav == NULL)
+		return(0);   // end of the segment, but not necessarily the end of the text
+
+	for(ep = ep2 = events; ep2->type != espeakEVENT_LIST_TERMINATED; ep2++)
+	{
+		if((segment_start_char > 0) && ((ep2->text_position + segment_char_shift) <= segment_start_char))
+			continue;   // from the SSML tags which have been put in front of the segment
+		*ep = *ep2;
+
+		ep->unique_identifier = my_unique_identifier;
+		ep->user_data = my_user_data;
+		ep->text_position += segment_char_shift;
+		ep->sample += segment_sample_base;
+		ep->audio_position = (int)(((double)ep->sample*1000.0)/((output_rate != 0) ? output_rate : samplerate));
+
+		switch(ep->type)
+		{
+		case espeakEVENT_WORD:
+			ep->id.number += segment_word_base;
+			break;
+		case espeakEVENT_SENTENCE:
+		case espeakEVENT_END:
+			ep->id.number += segment_sentence_base;
+			break;
+		default:
+			break;
+		}
+		ep++;
+	}
+	ep->type = espeakEVENT_LIST_TERMINATED;
+	ep->unique_identifier = my_unique_identifier;
+	ep->user_data = my_user_data;
+
+	segment_samples += numsamples;
+	if(segment_format != espeakFORMAT_PCM16)
+		numsamples = EncodeOutput(segment_format, wav, numsamples, events);
+	if(segment_timeline)
+		TimelineAdd(events);
+	callback_format = segment_format;
+	if(segment_callback(wav, numsamples, events) != 0)
+		segment_finished = 1;
+	return(segment_finished);
+}
+
+
+static void SegmentStart(const char *text, TEXT_SEGMENT *seg, int utf8)
+{//===================================================================
+	int ix;
+
+	segment_start_char = seg->char_offset;
+
+	// text positions in the segment include the SSML tags which have been put in front of it
+	segment_char_shift = seg->char_offset;
+	for(ix=0; ix<seg->n_tags; ix++)
+		segment_char_shift -= CountChars(&text[seg->tag_offset[ix]], seg->tag_length[ix], utf8);
+
+	segment_samples = 0;
+}
+
+
+static void SegmentEnd(int n_words, int n_sentences)
+{//================================================
+	segment_sample_base += segment_samples;
+	segment_word_base += n_words;
+	segment_sentence_base += n_sentences;
+}
+
+
+static unsigned int SegmentFlags(unsigned int flags, int seg_ix, int n_segments)
+{//============================================================================
+	// segments which are followed by another segment need the pause at the end
+	if(seg_ix+1 < n_segments)
+		return(flags | espeakENDPAUSE);
+	return(flags);
+}
+
+
+static espeak_ERROR SpeakSegment(const char *text, TEXT_SEGMENT *segments, int seg_ix, int n_segments, int text_length, unsigned int flags, void *user_data)
+{//=======================================================================================================================================================
+// Speak a segment in this process
+	espeak_ERROR aStatus;
+	int length;
+	char *buf;
+
+	if((buf = SegmentText(text, segments, seg_ix, n_segments, text_length, &length)) == NULL)
+		return(EE_INTERNAL_ERROR);
+	flags = SegmentFlags(flags, seg_ix, n_segments);
+
+	SegmentStart(text, &segments[seg_ix], (flags & 7) < espeakCHARS_8BIT);
+	synth_callback = SegmentDeliver;
+	aStatus = sync_espeak_Synth(my_unique_identifier, buf, length+1, 0, POS_CHARACTER, 0, flags, user_data);
+	synth_callback = segment_callback;
+	SegmentEnd(count_words, count_sentences);
+
+	free(buf);
+	return(aStatus);
+}
+
+
+static int SegmentWrite(short *wav, int numsamples, espeak_EVENT *events)
+{//=====================================================================
+// Callback in a worker process.  Write the sound and events to the output file,
+// with the names of MARK and PLAY events following the event list.
+	int n_events;
+	int len;
+	int header[2];
+
+	if(wav == NULL)
+		return(0);
+
+	for(n_events=0; events[n_events].type != espeakEVENT_LIST_TERMINATED; n_events++) ;
+
+	header[0] = numsamples;
+	header[1] = n_events;
+	fwrite(header, sizeof(header), 1, f_segment_out);
+	fwrite(wav, sizeof(short), numsamples, f_segment_out);
+	fwrite(events, sizeof(espeak_EVENT), n_events, f_segment_out);
+	for(; n_events > 0; events++, n_events--)
+	{
+		if((events->type == espeakEVENT_MARK) || (events->type == espeakEVENT_PLAY))
+		{
+			len = strlen(events->id.name) + 1;
+			fwrite(&len, sizeof(int), 1, f_segment_out);
+			fwrite(events->id.name, 1, len, f_segment_out);
+		}
+	}
+	return(ferror(f_segment_out));
+}
+
+
+static int SegmentRead(FILE *f, const char *text, TEXT_SEGMENT *seg, int utf8)
+{//==========================================================================
+// Read the output of a worker process and pass it to the callback function.
+// Returns 0 if the output is incomplete.
+	int ix;
+	int len;
+	int index;
+	int header[2];
+	int counts[2];
+	int complete = 0;
+	short *wav = NULL;
+	espeak_EVENT *events = NULL;
+	char *name = NULL;
+	void *p;
+
+	rewind(f);
+	SegmentStart(text, seg, utf8);
+	while(!segment_finished && (fread(header, sizeof(header), 1, f) == 1))
+	{
+		if(header[0] < 0)
+		{
+			// the end of the output, with the numbers of words and sentences
+			complete = (fread(counts, sizeof(counts), 1, f) == 1);
+			break;
+		}
+
+		// keep the old blocks if realloc fails, so that they are freed below
+		if((p = realloc(wav, (header[0] + 1) * sizeof(short))) == NULL)
+			break;
+		wav = (short *)p;
+		if((p = realloc(events, (header[1] + 1) * sizeof(espeak_EVENT))) == NULL)
+			break;
+		events = (espeak_EVENT *)p;
+		if((fread(wav, sizeof(short), header[0], f) != (size_t)header[0]) ||
+			(fread(events, sizeof(espeak_EVENT), header[1], f) != (size_t)header[1]))
+			break;
+
+		for(ix=0; ix<header[1]; ix++)
+		{
+			if((events[ix].type == espeakEVENT_MARK) || (events[ix].type == espeakEVENT_PLAY))
+			{
+				if((fread(&len, sizeof(int), 1, f) != 1) || (len <= 0) || ((p = realloc(name, len)) == NULL))
+					break;
+				name = (char *)p;
+				if(fread(name, 1, len, f) != (size_t)len)
+					break;
+				name[len-1] = 0;
+				if((index = AddNameData(name, 0)) >= 0)
+					events[ix].id.name = &namedata[index];
+				else
+					events[ix].id.name = "";
+			}
+		}
+		if(ix < header[1])
+			break;
+		events[header[1]].type = espeakEVENT_LIST_TERMINATED;
+
+		SegmentDeliver(wav, header[0], events);
+	}
+	free(wav);
+	free(events);
+	free(name);
+	if(complete)
+		SegmentEnd(counts[0], counts[1]);
+	return(complete || segment_finished);
+}
+
 
-	ENTER("MarkerEvent");
+static void StartSegmentWorker(SEGMENT_WORKER *worker, const char *text, TEXT_SEGMENT *segments, int seg_ix, int n_segments, int text_length, unsigned int flags, void *user_data)
+{//============================================================================================================================================================================
+	int length;
+	int header[2];
+	char *buf;
+	espeak_ERROR aStatus;
 
-	if((event_list == NULL) || (event_list_ix >= (n_event_list-2)))
+	if((worker->f_out = tmpfile()) == NULL)
 		return;
 
-	ep = &event_list[event_list_ix++];
-	ep->type = (espeak_EVENT_TYPE)type;
-	ep->unique_identifier = my_unique_identifier;
-	ep->user_data = my_user_data;
-	ep->text_position = char_position & 0xffffff;
-	ep->length = char_position >> 24;
+	if((worker->pid = fork()) != 0)
+	{
+		if(worker->pid < 0)
+			worker->pid = 0;
+		return;
+	}
 
-	time = ((double)(count_samples + mbrola_delay + (out_ptr - out_start)/2)*1000.0)/samplerate;
-	ep->audio_position = (int)time;
-	ep->sample = (count_samples + mbrola_delay + (out_ptr - out_start)/2);
+	// this is the worker process
+	if((buf = SegmentText(text, segments, seg_ix, n_segments, text_length, &length)) == NULL)
+		_exit(1);
+	flags = SegmentFlags(flags, seg_ix, n_segments);
+
+	f_segment_out = worker->f_out;
+	synth_callback = SegmentWrite;
+	aStatus = sync_espeak_Synth(0, buf, length+1, 0, POS_CHARACTER, 0, flags, user_data);
+
+	header[0] = header[1] = -1;
+	fwrite(header, sizeof(header), 1, f_segment_out);
+	header[0] = count_words;
+	header[1] = count_sentences;
+	fwrite(header, sizeof(header), 1, f_segment_out);
+	if((fflush(f_segment_out) != 0) || ferror(f_segment_out) || (aStatus != EE_OK))
+		_exit(1);
+	_exit(0);
+}
 
-#ifdef DEBUG_ENABLED
-	SHOW("MarkerEvent > count_samples=%d, out_ptr=%x, out_start=0x%x\n",count_samples, out_ptr, out_start);
-	SHOW("*** MarkerEvent > type=%s, uid=%d, text_pos=%d, length=%d, audio_position=%d, sample=%d\n",
-			label[ep->type], ep->unique_identifier, ep->text_position, ep->length,
-			ep->audio_position, ep->sample);
-#endif
 
-	if((type == espeakEVENT_MARK) || (type == espeakEVENT_PLAY))
-		ep->id.name = &namedata[value];
-	else
-//#ifdef deleted
-// temporarily removed, don't introduce until after eSpeak version 1.46.02
-	if(type == espeakEVENT_PHONEME)
-	{
-		int *p;
-		p = (int *)(ep->id.string);
-		p[0] = value;
-		p[1] = value2;
-	}
-	else
-//#endif
+static int FinishSegmentWorker(SEGMENT_WORKER *worker, int stop)
+{//=============================================================
+// Wait for a worker process to finish.  Returns 1 if it completed successfully.
+	int status = 1;
+
+	if(worker->pid != 0)
 	{
-		ep->id.number = value;
+		if(stop)
+			kill(worker->pid, SIGKILL);
+		while((waitpid(worker->pid, &status, 0) < 0) && (errno == EINTR)) ;
+		worker->pid = 0;
 	}
-}  //  end of MarkerEvent
+	return(WIFEXITED(status) && (WEXITSTATUS(status) == 0));
+}
+#endif
 
 
+static espeak_ERROR sync_espeak_SynthParallel(const void *text, size_t size, unsigned int flags, int n_workers, void* user_data)
+{//=====================================================================================================================
+#ifdef PLATFORM_POSIX
+	espeak_ERROR aStatus = EE_OK;
+	int length;
+	int min_length;
+	int n_segments;
+	int ix;
+	int next_worker;
+	int in_process = 0;
+	TEXT_SEGMENT *segments;
+	SEGMENT_WORKER *workers;
+	const char *p = (const char *)text;
 
+	if((n_workers < 2) || (synth_callback == NULL) || ((flags & 7) == espeakCHARS_WCHAR) || ((flags & 7) == espeakCHARS_16BIT))
+		return(sync_espeak_Synth(0, text, size, 0, POS_CHARACTER, 0, flags, user_data));
 
-espeak_ERROR sync_espeak_Synth(unsigned int unique_identifier, const void *text, size_t size,
-		      unsigned int position, espeak_POSITION_TYPE position_type,
-		      unsigned int end_position, unsigned int flags, void* user_data)
-{//===========================================================================
-    espeak_ERROR aStatus;
-    int i=0;
+	for(length=0; ((size_t)length < size) && (p[length] != 0) && (length < 0x7fffffff); length++) ;
 
-#ifdef DEBUG_ENABLED
-	ENTER("sync_espeak_Synth");
-	SHOW("sync_espeak_Synth > position=%d, position_type=%d, end_position=%d, flags=%d, user_data=0x%x, text=%s\n", position, position_type, end_position, flags, user_data, text);
-#endif
+	// several segments for each worker, so that they are kept busy
+	if((min_length = length / (n_workers*4)) < SEGMENT_MIN_LENGTH)
+		min_length = SEGMENT_MIN_LENGTH;
+	n_segments = length/min_length + 2;
 
-	InitText(flags);
-	my_unique_identifier = unique_identifier;
-	my_user_data = user_data;
+	if((segments = (TEXT_SEGMENT *)malloc(n_segments * sizeof(TEXT_SEGMENT))) == NULL)
+		return(EE_INTERNAL_ERROR);
+	n_segments = FindSegments(p, length, flags, min_length, segments, n_segments);
 
-    for (i=0; i < N_SPEECH_PARAM; i++)
-		saved_parameters[i] = param_stack[0].parameter[i];
+	if((n_segments < 2) || ((workers = (SEGMENT_WORKER *)calloc(n_segments, sizeof(SEGMENT_WORKER))) == NULL))
+	{
+		free(segments);
+		return(sync_espeak_Synth(0, text, size, 0, POS_CHARACTER, 0, flags, user_data));
+	}
 
-	switch(position_type)
-		{
-		case POS_CHARACTER:
-			skip_characters = position;
-			break;
+	if(f_logespeak)
+	{
+		fprintf(f_logespeak,"%d segments\n",n_segments);
+		fflush(f_logespeak);
+	}
 
-		case POS_WORD:
-			skip_words = position;
-			break;
+	segment_callback = synth_callback;
+	segment_finished = 0;
+	segment_sample_base = 0;
+
+	// encode the sound of all the segments as one stream, so that ADPCM continues from one to the next
+	segment_format = output_format;
+	output_format = espeakFORMAT_PCM16;
+	AdpcmReset(&out_adpcm);
+	segment_timeline = event_timeline;
+	event_timeline = 0;
+	timeline.n_events = 0;
+	segment_word_base = 0;
+	segment_sentence_base = 0;
+	my_unique_identifier = 0;
+	my_user_data = user_data;
 
-		case POS_SENTENCE:
-			skip_sentences = position;
-			break;
+	for(next_worker=0; (next_worker < n_segments) && (next_worker < n_workers); next_worker++)
+	{
+		StartSegmentWorker(&workers[next_worker], p, segments, next_worker, n_segments, length, flags, user_data);
+	}
 
-		}
-	if(skip_characters || skip_words || skip_sentences)
-		skipping_text = 1;
+	for(ix=0; (ix < n_segments) && !segment_finished && (aStatus == EE_OK); ix++)
+	{
+		if(!in_process)
+		{
+			if((workers[ix].f_out != NULL) && FinishSegmentWorker(&workers[ix], 0))
+			{
+				if(SegmentRead(workers[ix].f_out, p, &segments[ix], (flags & 7) < espeakCHARS_8BIT) == 0)
+					aStatus = EE_INTERNAL_ERROR;
+				fclose(workers[ix].f_out);
+				workers[ix].f_out = NULL;
 
-	end_character_position = end_position;
+				if(next_worker < n_segments)
+				{
+					StartSegmentWorker(&workers[next_worker], p, segments, next_worker, n_segments, length, flags, user_data);
+					next_worker++;
+				}
+				continue;
+			}
 
-	aStatus = Synthesize(unique_identifier, text, flags);
-	#ifdef USE_ASYNC
-	wave_flush(my_audio);
-	#endif
+			// the worker couldn't be started or it failed, speak the rest of the text here
+			in_process = 1;
+		}
+		aStatus = SpeakSegment(p, segments, ix, n_segments, length, flags, user_data);
+	}
 
-	SHOW_TIME("LEAVE sync_espeak_Synth");
-	return aStatus;
-}  //  end of sync_espeak_Synth
+	for(ix=0; ix<n_segments; ix++)
+	{
+		if(workers[ix].f_out != NULL)
+		{
+			FinishSegmentWorker(&workers[ix], 1);
+			fclose(workers[ix].f_out);
+		}
+	}
+	free(workers);
+	free(segments);
+
+	synth_callback = segment_callback;
+	output_format = segment_format;
+	callback_format = segment_format;
+	event_timeline = segment_timeline;
+	if(!segment_finished && (aStatus == EE_OK))
+	{
+		event_list[0].type = espeakEVENT_LIST_TERMINATED;
+		event_list[0].unique_identifier = my_unique_identifier;
+		event_list[0].user_data = my_user_data;
+		if((segment_format == espeakFORMAT_IMA_ADPCM) && (AdpcmFlush(&out_adpcm, (unsigned char *)&out_adpcm_last) > 0))
+			synth_callback(&out_adpcm_last, 1, event_list);
+		synth_callback(NULL, 0, event_list);  // NULL buffer ptr indicates end of data
+	}
 
+	SHOW_TIME("LEAVE sync_espeak_SynthParallel");
+	return(aStatus);
+#else
+	return(sync_espeak_Synth(0, text, size, 0, POS_CHARACTER, 0, flags, user_data));
+#endif
+}  //  end of sync_espeak_SynthParallel
 
 
 
@@ -704,6 +2089,7 @@ void sync_espeak_Key(const char *key)
 	// symbolic name, symbolicname_character  - is there a system resource of symbolic names per language?
 	int letter;
 	int ix;
+	char cache_key[80];
 
 	ix = utf8_in(&letter,key);
 	if(key[ix] == 0)
@@ -713,9 +2099,13 @@ void sync_espeak_Key(const char *key)
 		return;
 	}
 
-	my_unique_identifier = 0;
-	my_user_data = NULL;
-	Synthesize(0, key,0);   // speak key as a text string
+	if(strlen(key) < sizeof(cache_key)-1)
+	{
+		sprintf(cache_key, "K%s", key);
+		SpeakCached(cache_key, key, 0);   // speak key as a text string
+	}
+	else
+		SpeakCached(NULL, key, 0);
 }
 
 
@@ -723,11 +2113,11 @@ void sync_espeak_Char(wchar_t character)
 {//=====================================
 	// is there a system resource of character names per language?
 	char buf[80];
-	my_unique_identifier = 0;
-	my_user_data = NULL;
+	char key[20];
 
+	sprintf(key, "C%d", character);
 	sprintf(buf,"<say-as interpret-as=\"tts:char\">&#%d;</say-as>",character);
-	Synthesize(0, buf,espeakSSML);
+	SpeakCached(key, buf, espeakSSML);
 }
 
 
@@ -758,6 +2148,8 @@ ESPEAK_API void espeak_SetSynthCallback(t_espeak_callback* SynthCallback)
 	synth_callback = SynthCallback;
 #ifdef USE_ASYNC
 	event_set_callback(synth_callback);
+	user_callback = SynthCallback;
+	SelectCallback();
 #endif
 }
 
@@ -773,6 +2165,64 @@ ESPEAK_API void espeak_SetPhonemeCallback(int (* PhonemeCallback)(const char*))
 	phoneme_callback = PhonemeCallback;
 }
 
+ESPEAK_API espeak_ERROR espeak_SetOutputRate(int rate)
+{//===================================================
+	ENTER("espeak_SetOutputRate");
+	if((rate < 0) || ((rate > 0) && (rate < 4000)) || (rate > 192000))
+		return(EE_INTERNAL_ERROR);
+	output_rate = rate;
+	return(EE_OK);
+}
+
+ESPEAK_API const espeak_EVENT_TIMELINE *espeak_GetEventTimeline(void)
+{//=================================================================
+	ENTER("espeak_GetEventTimeline");
+	return(&timeline);
+}
+
+ESPEAK_API espeak_ERROR espeak_SetOutputFormat(espeak_OUTPUT_FORMAT format)
+{//========================================================================
+	ENTER("espeak_SetOutputFormat");
+	if((format < espeakFORMAT_PCM16) || (format > espeakFORMAT_IMA_ADPCM))
+		return(EE_INTERNAL_ERROR);
+	output_format = format;
+	return(EE_OK);
+}
+
+ESPEAK_API espeak_ERROR espeak_SetCharCache(int size, int options)
+{//===============================================================
+	ENTER("espeak_SetCharCache");
+	if(size < 0)
+		return(EE_INTERNAL_ERROR);
+	SoundCacheDelete(char_cache);
+	char_cache = NULL;
+	char_cache_options = options;
+	if((size > 0) && ((char_cache = SoundCacheCreate(size)) == NULL))
+		return(EE_INTERNAL_ERROR);
+	return(EE_OK);
+}
+
+ESPEAK_API espeak_ERROR espeak_SetSynthCache(int size, const char *path, int path_size)
+{//====================================================================================
+	ENTER("espeak_SetSynthCache");
+	if((size < 0) || (path_size < 0))
+		return(EE_INTERNAL_ERROR);
+	SoundCacheDelete(synth_cache);
+	synth_cache = NULL;
+	if(size == 0)
+		return(EE_OK);
+
+	if((synth_cache = SoundCacheCreate(size)) == NULL)
+		return(EE_INTERNAL_ERROR);
+	if(SoundCacheSpill(synth_cache, path, path_size) != 0)
+	{
+		SoundCacheDelete(synth_cache);
+		synth_cache = NULL;
+		return(EE_INTERNAL_ERROR);
+	}
+	return(EE_OK);
+}
+
 ESPEAK_API int espeak_Initialize(espeak_AUDIO_OUTPUT output_type, int buf_length, const char *path, int options)
 {//=============================================================================================================
     int param;
@@ -793,6 +2243,7 @@ ENTER("espeak_Initialize");
 				setlocale(LC_CTYPE,"");
 	}
 #endif
+	InitCharProperties();
 
 	init_path(path);
 	initialise(options);
@@ -807,7 +2258,7 @@ ENTER("espeak_Initialize");
 	if((buf_length == 0) || (output_type == AUDIO_OUTPUT_PLAYBACK) || (output_type == AUDIO_OUTPUT_SYNCH_PLAYBACK))
 		buf_length = 200;
 
-	outbuf_size = (buf_length * samplerate)/500;
+	outbuf_size = ((buf_length * samplerate)/1000) * 2;   // a whole number of samples
 	outbuf = (unsigned char*)realloc(outbuf,outbuf_size);
 	if((out_start = outbuf) == NULL)
 		return(EE_INTERNAL_ERROR);
@@ -821,6 +2272,11 @@ ENTER("espeak_Initialize");
 	option_phonemes = 0;
 	option_mbrola_phonemes = 0;
 	option_phoneme_events = (options & (espeakINITIALIZE_PHONEME_EVENTS | espeakINITIALIZE_PHONEME_IPA));
+	option_no_events = options & espeakINITIALIZE_NO_EVENTS;
+	if(option_no_events)
+		option_phoneme_events = 0;
+	event_timeline = options & espeakINITIALIZE_EVENT_TIMELINE;
+	adaptive_buffer = options & espeakINITIALIZE_ADAPTIVE_BUFFER;
 
 	VoiceReset(0);
 //	SetVoiceByName("default");
@@ -837,6 +2293,14 @@ ENTER("espeak_Initialize");
 
 #ifdef USE_ASYNC
 	fifo_init();
+
+	callback_thread = (output_type == AUDIO_OUTPUT_RETRIEVAL) && (options & espeakINITIALIZE_CALLBACK_THREAD);
+	if(callback_thread)
+	{
+		delivery_init();
+		delivery_set_callback_is_output_enabled(fifo_is_command_enabled);
+	}
+	SelectCallback();   // if espeak_SetSynthCallback() was called before this
 #endif
 
   return(samplerate);
@@ -911,6 +2375,111 @@ ESPEAK_API espeak_ERROR espeak_Synth(const void *text, size_t size,
 
 
 
+ESPEAK_API espeak_ERROR espeak_SynthFile(const char *path,
+					 unsigned int offset,
+					 unsigned int flags,
+					 unsigned int* unique_identifier,
+					 void* user_data)
+{//=========================================================================
+    espeak_ERROR a_error=EE_INTERNAL_ERROR;
+    static unsigned int temp_identifier;
+
+	ENTER("espeak_SynthFile");
+
+	if(f_logespeak)
+	{
+		fprintf(f_logespeak,"\nSYNTH FILE %s posn %d flags 0x%x\n",path,offset,flags);
+		fflush(f_logespeak);
+	}
+
+	if (unique_identifier == NULL)
+	{
+		unique_identifier = &temp_identifier;
+	}
+	*unique_identifier = 0;
+
+	if(synchronous_mode)
+	{
+		return(sync_espeak_SynthFile(0,path,offset,flags,user_data));
+	}
+
+#ifdef USE_ASYNC
+    {
+        t_espeak_command* c1 = NULL;
+        t_espeak_command* c2 = NULL;
+        FILE *f;
+
+        // the file is opened when the command is run, so check now that it can be read
+        if(((flags & 7) == espeakCHARS_WCHAR) || ((f = fopen(path,"rb")) == NULL))
+            return(EE_INTERNAL_ERROR);
+        fclose(f);
+
+        c1 = create_espeak_file(path, offset, flags, user_data);
+        if (c1)
+        {
+            *unique_identifier = c1->u.my_file.unique_identifier;
+            c2 = create_espeak_terminated_msg(*unique_identifier, user_data);
+        }
+
+        if (c1 && c2) {
+            a_error = fifo_add_commands(c1, c2);
+            if (a_error != EE_OK) {
+                delete_espeak_command(c1);
+                delete_espeak_command(c2);
+                c1=c2=NULL;
+            }
+        } else {
+            delete_espeak_command(c1);
+            delete_espeak_command(c2);
+        }
+    }
+#endif
+	return a_error;
+}  //  end of espeak_SynthFile
+
+
+
+ESPEAK_API espeak_ERROR espeak_SynthParallel(const void *text, size_t size,
+					 unsigned int flags,
+					 int n_workers,
+					 unsigned int* unique_identifier,
+					 void* user_data)
+{//=========================================================================
+	static unsigned int temp_identifier;
+
+	ENTER("espeak_SynthParallel");
+
+	// The worker processes are made by fork(), and the child would inherit the locks of the
+	// library's other threads but not the threads.  So it's not done while the wave and event
+	// threads of AUDIO_OUTPUT_PLAYBACK, or the delivery thread of espeakINITIALIZE_CALLBACK_THREAD,
+	// may be running.
+	if(my_mode == AUDIO_OUTPUT_PLAYBACK)
+		return(EE_INTERNAL_ERROR);
+#ifdef USE_ASYNC
+	if(callback_thread)
+		return(EE_INTERNAL_ERROR);
+#endif
+
+	if(!synchronous_mode)
+		return(espeak_Synth(text, size, 0, POS_CHARACTER, 0, flags, unique_identifier, user_data));
+
+	if(f_logespeak)
+	{
+		fprintf(f_logespeak,"\nSYNTH PARALLEL %d workers, flags 0x%x\n%s\n",n_workers,flags,(const char *)text);
+		fflush(f_logespeak);
+	}
+
+	if (unique_identifier == NULL)
+	{
+		unique_identifier = &temp_identifier;
+	}
+	*unique_identifier = 0;
+
+	return(sync_espeak_SynthParallel(text,size,flags,n_workers,user_data));
+}  //  end of espeak_SynthParallel
+
+
+
 ESPEAK_API espeak_ERROR espeak_Synth_Mark(const void *text, size_t size,
 					  const char *index_mark,
 					  unsigned int end_position,
@@ -1062,7 +2631,12 @@ ESPEAK_API espeak_ERROR espeak_SetVoiceByName(const char *name)
 	}
 	return a_error;
 #else
-	return(SetVoiceByName(name));
+	espeak_ERROR result;
+
+	result = SetVoiceByName(name);
+	if((result == EE_OK) && synchronous_mode)
+		CharCacheCheck();   // fill the cache with the new voice's alphabet
+	return(result);
 #endif
 }  // end of espeak_SetVoiceByName
 
@@ -1089,7 +2663,12 @@ ESPEAK_API espeak_ERROR espeak_SetVoiceByProperties(espeak_VOICE *voice_selector
 	}
 	return a_error;
 #else
-	return(SetVoiceByProperties(voice_selector));
+	espeak_ERROR result;
+
+	result = SetVoiceByProperties(voice_selector);
+	if((result == EE_OK) && synchronous_mode)
+		CharCacheCheck();   // fill the cache with the new voice's alphabet
+	return(result);
 #endif
 }  // end of espeak_SetVoiceByProperties
 
@@ -1210,18 +2789,46 @@ ESPEAK_API void espeak_CompileDictionary(const char *path, FILE *log, int flags)
 }   //  end of espeak_CompileDirectory
 
 
+ESPEAK_API espeak_ERROR espeak_SetPriority(int priority)
+{//=====================================================
+	ENTER("espeak_SetPriority");
+
+	if((priority != espeakPRIORITY_NORMAL) && (priority != espeakPRIORITY_HIGH))
+		return(EE_INTERNAL_ERROR);
+#ifdef USE_ASYNC
+	fifo_set_priority(priority);
+#endif
+	return(EE_OK);
+}   //  end of espeak_SetPriority
+
+
 ESPEAK_API espeak_ERROR espeak_Cancel(void)
 {//===============================
     int i = 0;
 #ifdef USE_ASYNC
+	struct timespec start;
+
 	ENTER("espeak_Cancel");
+	clock_gettime_mono(&start);
+
+	if(my_mode == AUDIO_OUTPUT_PLAYBACK)
+	{
+		// silence the sound now, and make the synthesis stop at its next check,
+		// rather than at the end of the buffer or clause that it is making
+		synth_stop_request = 1;
+		wave_abort(my_audio);
+	}
 	fifo_stop();
+	synth_stop_request = 0;
 	event_clear_all();
+	delivery_clear_all();   // the sound which is waiting for the callback
 
 	if(my_mode == AUDIO_OUTPUT_PLAYBACK)
 	{
 		wave_close(my_audio);
 	}
+
+	AddTime(&cancel_count, &cancel_sum_us, &cancel_max_us, ElapsedUs(&start));
 	SHOW_TIME("espeak_Cancel > LEAVE");
 #endif
 	embedded_value[EMBED_T] = 0;    // reset echo for pronunciation announcements
@@ -1240,22 +2847,84 @@ ESPEAK_API int espeak_IsPlaying(void)
 	if((my_mode == AUDIO_OUTPUT_PLAYBACK) && wave_is_busy(my_audio))
 		return(1);
 
-	return(fifo_is_busy());
+	return(fifo_is_busy() || delivery_is_busy());
 #else
 	return(0);
 #endif
 }   //  end of espeak_IsPlaying
 
 
+ESPEAK_API const espeak_STATS *espeak_GetStats(void)
+{//=================================================
+	static espeak_STATS stats;
+
+	ENTER("espeak_GetStats");
+#ifdef USE_ASYNC
+	uint32_t underruns;
+	uint32_t overruns;
+	int64_t count;
+
+	wave_get_xruns(&underruns, &overruns);
+	stats.audio_underruns = underruns;
+	stats.audio_overruns = overruns;
+	event_get_delays(&stats.event_callbacks, &stats.event_delay_mean, &stats.event_delay_max);
+	count = STATS_LOAD(cancel_count);
+	stats.cancels = (unsigned int)count;
+	stats.cancel_time_mean = (count == 0) ? 0 : (int)(STATS_LOAD(cancel_sum_us) / count);
+	stats.cancel_time_max = (int)STATS_LOAD(cancel_max_us);
+	delivery_get_stats(&stats.callback_queue_depth, &stats.callback_queue_max,
+			&stats.callback_stalls, &stats.callback_stall_mean, &stats.callback_stall_max);
+	count = STATS_LOAD(first_audio_count);
+	stats.texts = (unsigned int)count;
+	stats.first_audio_mean = (count == 0) ? 0 : (int)(STATS_LOAD(first_audio_sum_us) / count);
+	stats.first_audio_max = (int)STATS_LOAD(first_audio_max_us);
+	count = STATS_LOAD(buffer_count);
+	stats.buffers = (unsigned int)count;
+	stats.buffer_overhead_mean = (count == 0) ? 0 : (int)(STATS_LOAD(buffer_overhead_sum_us) / count);
+#endif
+	return(&stats);
+}   //  end of espeak_GetStats
+
+
+ESPEAK_API int espeak_WaitIdle(int timeout)
+{//==========================================
+#ifdef USE_ASYNC
+	struct timespec the_end;
+	struct timespec *p_end = NULL;
+
+	ENTER("espeak_WaitIdle");
+	if(timeout >= 0)
+	{
+		clock_gettime2(&the_end);
+		add_time_in_ms(&the_end, timeout);
+		p_end = &the_end;
+	}
+
+	do {
+		if(fifo_wait_idle(p_end))
+			return(1);
+
+		if(my_mode == AUDIO_OUTPUT_PLAYBACK)
+		{
+			// the sound, and then the events which are timed by it
+			if(wave_wait_idle(my_audio, p_end) || event_wait_idle(p_end))
+				return(1);
+		}
+		else
+		if(delivery_wait_idle(p_end))
+			return(1);   // the sound which is waiting for the callback
+	} while(fifo_is_busy());   // another command has been started meanwhile
+#endif
+	return(0);
+}   //  end of espeak_WaitIdle
+
+
 ESPEAK_API espeak_ERROR espeak_Synchronize(void)
 {//=============================================
 	espeak_ERROR berr = err;
 #ifdef USE_ASYNC
 	SHOW_TIME("espeak_Synchronize > ENTER");
-	while (espeak_IsPlaying())
-	{
-        espeakSleep(20);
-	}
+	espeak_WaitIdle(-1);
 #endif
 	err = EE_OK;
 	SHOW_TIME("espeak_Synchronize > LEAVE");
@@ -1273,6 +2942,9 @@ ESPEAK_API espeak_ERROR espeak_Terminate(void)
 	fifo_stop();
 	fifo_terminate();
 	event_terminate();
+	delivery_terminate();
+	callback_thread = 0;
+	SelectCallback();
 
 	if(my_mode == AUDIO_OUTPUT_PLAYBACK)
 	{
@@ -1286,6 +2958,22 @@ ESPEAK_API espeak_ERROR espeak_Terminate(void)
 	event_list = NULL;
 	Free(outbuf);
 	outbuf = NULL;
+	ResetOutputRate();
+	Free(out_rate_buf);
+	out_rate_buf = NULL;
+	out_rate_buf_size = 0;
+	Free(timeline_type);
+	Free(timeline_length);
+	Free(timeline_text_position);
+	Free(timeline_sample);
+	Free(timeline_number);
+	timeline_type = NULL;
+	timeline_length = timeline_text_position = timeline_sample = timeline_number = NULL;
+	timeline_size = 0;
+	memset(&timeline, 0, sizeof(timeline));
+	SoundCacheDelete(char_cache);
+	SoundCacheDelete(synth_cache);
+	char_cache = synth_cache = NULL;
 	FreePhData();
 	FreeVoiceList();
 
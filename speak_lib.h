@@ -34,7 +34,7 @@
 #define ESPEAK_API
 #endif
 
-#define ESPEAK_API_REVISION  9
+#define ESPEAK_API_REVISION  25
 /*
 Revision 2
    Added parameter "options" to eSpeakInitialize()
@@ -61,6 +61,59 @@ Revision 8  26.Apr.2013
 Revision 9  30.May.2013
   Changed function espeak_TextToPhonemes().
 
+Revision 10
+  Added functions espeak_Preload() and espeak_ListPreloaded().
+
+Revision 11
+  Added function espeak_SynthFile() and the espeakEVENT_CLAUSE event.
+
+Revision 12
+  Added function espeak_SynthParallel().
+
+Revision 13
+  Added function espeak_SetOutputRate().
+
+Revision 14
+  espeak_SetOutputRate() before espeak_Initialize() sets the synthesis sample rate.
+
+Revision 15
+  Added function espeak_SetOutputFormat().
+
+Revision 16
+  Added espeakINITIALIZE_NO_EVENTS and espeakINITIALIZE_EVENT_TIMELINE options for espeak_Initialize().
+  Added function espeak_GetEventTimeline().
+
+Revision 17
+  Added function espeak_SetCharCache().
+
+Revision 18
+  Added function espeak_SetSynthCache().
+
+Revision 19
+  Added function espeak_GetStats().
+
+Revision 20
+  Added function espeak_WaitIdle().
+
+Revision 21
+  Added event_callbacks, event_delay_mean and event_delay_max to espeak_STATS.
+
+Revision 22
+  espeak_Cancel() silences AUDIO_OUTPUT_PLAYBACK sound at once.
+  Added cancels, cancel_time_mean and cancel_time_max to espeak_STATS.
+
+Revision 23
+  Added function espeak_SetPriority().
+
+Revision 24
+  Added espeakINITIALIZE_CALLBACK_THREAD option for espeak_Initialize().
+  Added callback_queue_depth, callback_queue_max, callback_stalls, callback_stall_mean
+  and callback_stall_max to espeak_STATS.
+
+Revision 25
+  Added espeakINITIALIZE_ADAPTIVE_BUFFER option for espeak_Initialize().
+  Added texts, first_audio_mean, first_audio_max, buffers and buffer_overhead_mean to espeak_STATS.
+
 */
          /********************/
          /*  Initialization  */
@@ -81,7 +134,8 @@ typedef enum {
   espeakEVENT_END = 5,             // End of sentence or clause
   espeakEVENT_MSG_TERMINATED = 6,  // End of message
   espeakEVENT_PHONEME = 7,         // Phoneme, if enabled in espeak_Initialize()
-  espeakEVENT_SAMPLERATE = 8       // internal use, set sample rate
+  espeakEVENT_SAMPLERATE = 8,      // internal use, set sample rate
+  espeakEVENT_CLAUSE = 9           // Start of clause, for espeak_SynthFile()
 } espeak_EVENT_TYPE;
 
 
@@ -95,7 +149,7 @@ typedef struct espeak_EVENT{
 	int sample;           // sample id (internal use)
 	void* user_data;      // pointer supplied by the calling program
 	union {
-		int number;        // used for WORD and SENTENCE events.
+		int number;        // used for WORD and SENTENCE events, and the byte offset for CLAUSE events.
 		const char *name;  // used for MARK and PLAY events.  UTF8 string
 		char string[8];    // used for phoneme names (UTF8). Terminated by a zero byte unless the name needs the full 8 bytes.
 	} id;
@@ -141,6 +195,8 @@ typedef struct espeak_EVENT{
 
    A MARK event indicates a <mark> element in the text.
    A PLAY event indicates an <audio> element in the text, for which the calling program should play the named sound file.
+   A CLAUSE event indicates the start of a clause from espeak_SynthFile().  id.number is the byte offset
+   of the clause in the file.
 */
 
 
@@ -177,6 +233,10 @@ typedef enum {
 
 #define espeakINITIALIZE_PHONEME_EVENTS 0x0001
 #define espeakINITIALIZE_PHONEME_IPA   0x0002
+#define espeakINITIALIZE_NO_EVENTS     0x0004
+#define espeakINITIALIZE_EVENT_TIMELINE 0x0008
+#define espeakINITIALIZE_CALLBACK_THREAD 0x0010
+#define espeakINITIALIZE_ADAPTIVE_BUFFER 0x0020
 #define espeakINITIALIZE_DONT_EXIT     0x8000
 
 #ifdef __cplusplus
@@ -189,11 +249,31 @@ ESPEAK_API int espeak_Initialize(espeak_AUDIO_OUTPUT output, int buflength, cons
    buflength:  The length in mS of sound buffers passed to the SynthCallback function.
             Value=0 gives a default of 200mS.
             This paramater is only used for AUDIO_OUTPUT_RETRIEVAL and AUDIO_OUTPUT_SYNCHRONOUS modes.
+            With the espeakINITIALIZE_ADAPTIVE_BUFFER option, it is the longest buffer.
 
    path: The directory which contains the espeak-data directory, or NULL for the default location.
 
    options: bit 0:  1=allow espeakEVENT_PHONEME events.
             bit 1:  1= espeakEVENT_PHONEME events give IPA phoneme names, not eSpeak phoneme names
+            bit 2:  1= espeakINITIALIZE_NO_EVENTS: don't make any events for words, sentences,
+                    phonemes etc.  For rendering when the events are not needed.  Events for
+                    SSML <mark> and <audio> elements (espeakEVENT_MARK and espeakEVENT_PLAY)
+                    are still given.
+            bit 3:  1= espeakINITIALIZE_EVENT_TIMELINE: in AUDIO_OUTPUT_RETRIEVAL and
+                    AUDIO_OUTPUT_SYNCHRONOUS modes, collect the events of each text in a
+                    timeline, see espeak_GetEventTimeline(), rather than pass them to the
+                    SynthCallback function.
+            bit 4:  1= espeakINITIALIZE_CALLBACK_THREAD: in AUDIO_OUTPUT_RETRIEVAL mode, call
+                    the SynthCallback function from a thread of its own, with the sound and
+                    events passed through a queue, so that synthesis continues while the
+                    callback is working.  If the queue is full, synthesis waits for it (see
+                    espeak_GetStats).  Returning 1 from the callback stops the text, as before,
+                    but the sound which is already queued for the text is then dropped.
+                    espeak_Synchronize() waits until the callback has been given everything.
+            bit 5:  1= espeakINITIALIZE_ADAPTIVE_BUFFER: in AUDIO_OUTPUT_RETRIEVAL and
+                    AUDIO_OUTPUT_SYNCHRONOUS modes, the first sound buffer of each text is 20mS
+                    long, so that the sound starts sooner, and each buffer after it is twice as
+                    long as the one before, up to buflength.
             bit 15: 1=don't exit if espeak_data is not found (used for --help)
 
    Returns: sample rate in Hz, or -1 (EE_INTERNAL_ERROR).
@@ -229,6 +309,29 @@ int SynthCallback(short *wav, int numsamples, espeak_EVENT *events);
    Callback returns: 0=continue synthesis,  1=abort synthesis.
 */
 
+typedef struct {
+	int n_events;
+	const unsigned char *type;      // espeak_EVENT_TYPE
+	const int *length;              // as in espeak_EVENT
+	const int *text_position;
+	const int *sample;
+	const int *number;              // id.number, or 0 for MARK, PLAY and PHONEME events
+} espeak_EVENT_TIMELINE;
+
+#ifdef __cplusplus
+extern "C"
+#endif
+ESPEAK_API const espeak_EVENT_TIMELINE *espeak_GetEventTimeline(void);
+/* Used with the espeakINITIALIZE_EVENT_TIMELINE option of espeak_Initialize().
+   Returns the events of the text which is being spoken, as arrays of n_events items
+   in order of sample, instead of the lists of espeak_EVENT which are otherwise passed
+   to the SynthCallback function.  espeakEVENT_SAMPLERATE events are not included.
+
+   The timeline is complete when the SynthCallback function is called with wav=NULL,
+   and stays until the next text is spoken.  In AUDIO_OUTPUT_SYNCHRONOUS mode it can
+   also be read after espeak_Synth() etc. returns.
+*/
+
 #ifdef __cplusplus
 extern "C"
 #endif
@@ -253,6 +356,122 @@ int UriCallback(int type, const char *uri, const char *base);
              occurs.  The calling program can then play the sound at that point.
 */
 
+#ifdef __cplusplus
+extern "C"
+#endif
+ESPEAK_API espeak_ERROR espeak_SetOutputRate(int rate);
+/* Sets the sample rate of the sound which is passed to the SynthCallback function
+   or played, eg. 8000 or 16000 for telephony, 24000 or 48000.  The sound is converted
+   from the voice's own sample rate (22050 Hz, or that of an mbrola voice), so the
+   output rate stays the same when the voice changes.
+
+   rate: in Hz, from 4000 to 192000.  0 = use the voice's sample rate (the default).
+         With AUDIO_OUTPUT_PLAYBACK, 0 opens the audio device at the sample rate of
+         the espeak-data, and the sound of voices with other rates is converted to it.
+
+   The sample and audio_position of events are given at the output rate, and
+   espeakEVENT_SAMPLERATE events report the output rate.
+   Takes effect from the next text to be spoken.  It has no effect with
+   AUDIO_OUTPUT_SYNCH_PLAYBACK.
+
+   If this is called before espeak_Initialize() with a rate from 8000 to below 22050,
+   eg. 8000, 11025 or 16000, the speech is synthesized at that rate instead of being
+   converted, which takes less processing.
+
+   Return: EE_OK: operation achieved
+           EE_INTERNAL_ERROR: the rate is out of range.
+*/
+
+typedef enum {
+	espeakFORMAT_PCM16 = 0,      // 16 bit signed samples (the default)
+	espeakFORMAT_ULAW = 1,       // G.711 mu-law, 1 byte per sample
+	espeakFORMAT_ALAW = 2,       // G.711 A-law, 1 byte per sample
+	espeakFORMAT_IMA_ADPCM = 3   // IMA ADPCM, 2 samples per byte, the earlier one in the low 4 bits
+} espeak_OUTPUT_FORMAT;
+
+#ifdef __cplusplus
+extern "C"
+#endif
+ESPEAK_API espeak_ERROR espeak_SetOutputFormat(espeak_OUTPUT_FORMAT format);
+/* Sets the encoding of the sound which is passed to the SynthCallback function, in
+   AUDIO_OUTPUT_RETRIEVAL and AUDIO_OUTPUT_SYNCHRONOUS modes.  The sound is encoded
+   after any change of sample rate by espeak_SetOutputRate().
+
+   With an encoded format, 'wav' in the SynthCallback function points to the encoded
+   bytes, and 'numsamples' is the number of bytes.  The sample field of events is
+   also given in bytes of the encoded stream.  For IMA ADPCM that is the byte which
+   contains the sample.
+
+   IMA ADPCM is a headerless stream which starts with the predictor and step index at
+   zero, and continues from one callback to the next until the end of the text.  If
+   there is an odd number of samples, the high 4 bits of the last byte are zero.
+
+   Takes effect from the next text to be spoken.
+
+   Return: EE_OK: operation achieved
+           EE_INTERNAL_ERROR: the format is not known.
+*/
+
+#define espeakCHARCACHE_ALPHABET  0x01
+
+#ifdef __cplusplus
+extern "C"
+#endif
+ESPEAK_API espeak_ERROR espeak_SetCharCache(int size, int options);
+/* Keeps the sound of espeak_Char() and espeak_Key(), in AUDIO_OUTPUT_RETRIEVAL and
+   AUDIO_OUTPUT_SYNCHRONOUS modes, so that when the same character or key is spoken
+   again the SynthCallback function is given the same sound and events without the
+   delay of synthesizing it.
+
+   size: the most memory for the cache, in bytes.  0 = no cache (the default).
+      When it's full, the sounds which have been used least recently are removed.
+
+   options:
+      espeakCHARCACHE_ALPHABET: also put the lower case letters of the voice's alphabet
+      into the cache.  In AUDIO_OUTPUT_SYNCHRONOUS mode this is done when the voice is
+      selected, otherwise at the next call of espeak_Char() or espeak_Key().
+
+   The cache is emptied when the voice, the speech parameters or the output settings
+   change.  Sounds which include <mark> or <audio> events are not kept.
+
+   Return: EE_OK: operation achieved
+           EE_INTERNAL_ERROR: the size is negative.
+*/
+
+#ifdef __cplusplus
+extern "C"
+#endif
+ESPEAK_API espeak_ERROR espeak_SetSynthCache(int size, const char *path, int path_size);
+/* Keeps the sound of texts which are spoken by espeak_Synth(), in AUDIO_OUTPUT_RETRIEVAL
+   and AUDIO_OUTPUT_SYNCHRONOUS modes, so that when the same text is spoken again the
+   SynthCallback function is given the same sound and events without synthesizing it.
+   This suits applications which speak the same prompts many times.
+
+   A sound is found again only if the text, the flags, the voice, the speech parameters
+   and the output settings are all the same.  The text must match exactly, including
+   spaces and line breaks, which affect the pauses.  Texts which are spoken from a
+   position other than the start, or with an end_position, are not cached, nor are
+   sounds which include <mark> or <audio> events.  There is no caching while
+   espeak_SetPhonemeTrace() or espeak_SetPhonemeCallback() is active, or for SSML while
+   there is a UriCallback, since those would not be called.
+
+   size: the most memory for the cache, in bytes.  0 = no cache (the default).
+      When it's full, the sounds which have been used least recently are removed
+      from memory.
+
+   path: a directory, or NULL.  If given, sounds which are removed from memory are
+      written to files there, up to path_size bytes, and are read back when they
+      are next used.  The files are deleted when they are no longer needed, and
+      by espeak_SetSynthCache() and espeak_Terminate().
+
+   path_size: the most bytes of sound to keep in files in 'path'.
+
+   Calling this empties the cache.  Don't call it while text is being spoken.
+
+   Return: EE_OK: operation achieved
+           EE_INTERNAL_ERROR: size or path_size is negative, or path is not a directory.
+*/
+
 
          /********************/
          /*    Synthesis     */
@@ -354,6 +573,68 @@ ESPEAK_API espeak_ERROR espeak_Synth_Mark(const void *text,
 	   EE_INTERNAL_ERROR.
 */
 
+#ifdef __cplusplus
+extern "C"
+#endif
+ESPEAK_API espeak_ERROR espeak_SynthFile(const char *path,
+	unsigned int offset,
+	unsigned int flags,
+	unsigned int* unique_identifier,
+	void* user_data);
+/* Synthesize speech for the text in a file.  The file is mapped into memory and read in place,
+   rather than being copied, so this is suitable for very large texts.
+
+   path: The name of the text file.
+
+   offset: The byte offset in the file where speaking starts.  This should be zero, or the
+      id.number of an espeakEVENT_CLAUSE event from a previous call for the same file, for
+      example to resume after the program was stopped.
+
+   flags: As for espeak_Synth().  espeakCHARS_WCHAR is not valid.
+
+   An espeakEVENT_CLAUSE event is given at the start of each clause.  Its id.number is the byte
+   offset of the clause in the file, which can be used to show progress.
+
+   unique_identifier, user_data: As for espeak_Synth().
+
+   Return: EE_OK: operation achieved
+           EE_BUFFER_FULL: the command can not be buffered;
+             you may try after a while to call the function again.
+	   EE_INTERNAL_ERROR: the file can't be read.  In asynchronous mode this is checked
+             before the command is queued.
+*/
+
+#ifdef __cplusplus
+extern "C"
+#endif
+ESPEAK_API espeak_ERROR espeak_SynthParallel(const void *text,
+	size_t size,
+	unsigned int flags,
+	int n_workers,
+	unsigned int* unique_identifier,
+	void* user_data);
+/* Synthesize speech for a long text, such as a book, using several worker processes.
+   The text is split at paragraphs and the ends of sentences, and the parts are spoken at
+   the same time.  The sound and events are given to the callback function in order, and
+   are the same as from espeak_Synth(), with text_position and audio_position measured from
+   the start of the whole text.  With SSML, the voice and prosody of the elements which are
+   open at a split are carried into the next part.
+
+   This is only done in AUDIO_OUTPUT_SYNCHRONOUS mode, and on systems which have fork().
+   In AUDIO_OUTPUT_RETRIEVAL mode, on other systems, or if the text is short, it is the same
+   as espeak_Synth() from position 0.  The worker processes are made by fork(), which is not
+   safe while the library's own audio, event or callback threads are running, so it is not
+   supported in AUDIO_OUTPUT_PLAYBACK mode or with espeakINITIALIZE_CALLBACK_THREAD.
+
+   text, size, flags, unique_identifier, user_data: As for espeak_Synth().
+      espeakCHARS_WCHAR and espeakCHARS_16BIT text is spoken without being split.
+
+   n_workers: The number of worker processes, for example the number of processor cores.
+
+   Return: as for espeak_Synth().
+           EE_INTERNAL_ERROR: in AUDIO_OUTPUT_PLAYBACK mode or with espeakINITIALIZE_CALLBACK_THREAD.
+*/
+
 #ifdef __cplusplus
 extern "C"
 #endif
@@ -623,6 +904,69 @@ ESPEAK_API espeak_VOICE *espeak_GetCurrentVoice(void);
    This is not affected by temporary voice changes caused by SSML elements such as <voice> and <s>
 */
 
+#ifdef __cplusplus
+extern "C"
+#endif
+ESPEAK_API int espeak_Preload(const char **voices, int n);
+/* Loads voices in advance and keeps their voice files and dictionaries in memory for the life
+   of the process, so that later espeak_SetVoiceByName() calls and SSML <voice> changes to them
+   don't need to read and index the data files again.
+
+   voices  An array of n voice names, as for espeak_SetVoiceByName(), eg. "en", "de", "en+f3".
+
+   The currently selected voice is not changed.  Call this after espeak_Initialize() and
+   before synthesis is started, or while nothing is being spoken.
+
+   Return: the number of voices which were loaded.
+*/
+
+typedef struct {
+	const char *name;   // voice file name or dictionary name, NULL terminates the list
+	int type;           // 1=voice file, 2=dictionary
+	int size;           // bytes of memory which are held
+} espeak_PRELOADED;
+
+#ifdef __cplusplus
+extern "C"
+#endif
+ESPEAK_API const espeak_PRELOADED *espeak_ListPreloaded(void);
+/* Reports the voice files and dictionaries which have been made resident by espeak_Preload().
+   Returns an array which is terminated by an entry with name=NULL.  It is valid until the
+   next call of espeak_Preload() or espeak_ListPreloaded().
+*/
+
+#define espeakPRIORITY_NORMAL  0
+#define espeakPRIORITY_HIGH    1
+
+#ifdef __cplusplus
+extern "C"
+#endif
+ESPEAK_API espeak_ERROR espeak_SetPriority(int priority);
+/* Sets the priority of the commands which are given after this, in the asynchronous modes
+   (AUDIO_OUTPUT_PLAYBACK and AUDIO_OUTPUT_RETRIEVAL):  espeak_Synth(), espeak_Synth_Mark(),
+   espeak_SynthFile(), espeak_Key(), espeak_Char(), and the changes of parameters and voice.
+
+   priority:
+      espeakPRIORITY_NORMAL  The default.  Commands run in the order in which they are given.
+
+      espeakPRIORITY_HIGH  The commands run before any commands of normal priority which are
+         waiting.  A text of normal priority which is being spoken is interrupted at the end
+         of its current clause, and continues from the next clause after the commands of high
+         priority.  For example, to speak the echo of a key while a document is being read.
+
+   The rest of an interrupted text has the same unique_identifier and user_data, and its
+   events give the positions, and the word and sentence numbers, of the whole text.  SSML
+   elements which are open where it was interrupted are continued.  Changes of parameters or
+   voice which were given with high priority also apply to it.
+
+   Text which is wchar_t or 16 bit, or an SSML file, is not interrupted.
+   In AUDIO_OUTPUT_PLAYBACK mode, the sound which has already been sent to the audio
+   device is played before the commands of high priority.
+
+   Return: EE_OK: operation achieved
+	   EE_INTERNAL_ERROR: priority is not valid.
+*/
+
 #ifdef __cplusplus
 extern "C"
 #endif
@@ -652,6 +996,54 @@ ESPEAK_API espeak_ERROR espeak_Synchronize(void);
 	   EE_INTERNAL_ERROR.
 */
 
+#ifdef __cplusplus
+extern "C"
+#endif
+ESPEAK_API int espeak_WaitIdle(int timeout);
+/* Waits until all the commands have been run and, with AUDIO_OUTPUT_PLAYBACK,
+   the last sample has been played and the last event has been notified.
+
+   timeout: the longest time to wait, in mS.  -1 = no limit.
+
+   Returns 0 if the library is idle, or 1 if it is still speaking after the timeout.
+*/
+
+typedef struct {
+	// AUDIO_OUTPUT_PLAYBACK mode, counted since the library was loaded
+	unsigned int audio_underruns;   // the audio device ran out of sound while more was still to come
+	unsigned int audio_overruns;    // synthesis had to wait for space in the audio buffer
+	unsigned int event_callbacks;   // events which were timed by the sound, and given to the SynthCallback function
+	int event_delay_mean;           // microseconds from the event's sound reaching the audio output to its callback
+	int event_delay_max;            //   (negative if early), the mean and the largest, early or late
+
+	unsigned int cancels;           // calls of espeak_Cancel()
+	int cancel_time_mean;           // microseconds taken by espeak_Cancel(), the mean and the largest
+	int cancel_time_max;
+
+	// AUDIO_OUTPUT_RETRIEVAL mode with espeakINITIALIZE_CALLBACK_THREAD
+	unsigned int callback_queue_depth;   // buffers waiting for the SynthCallback function, now
+	unsigned int callback_queue_max;     //   and the most there have been
+	unsigned int callback_stalls;        // synthesis had to wait for space in the queue
+	int callback_stall_mean;             // microseconds that it waited, the mean and the largest
+	int callback_stall_max;
+
+	// synthesis of each text, except in AUDIO_OUTPUT_SYNCH_PLAYBACK mode
+	unsigned int texts;             // texts which have produced sound
+	int first_audio_mean;           // microseconds from starting to synthesize a text to its first sound being
+	int first_audio_max;            //   ready for the SynthCallback function or the audio output, the mean and the largest
+	unsigned int buffers;           // sound buffers which the synthesis has filled
+	int buffer_overhead_mean;       // microseconds per buffer for its events, encoding and callback, after it has been filled
+} espeak_STATS;
+
+#ifdef __cplusplus
+extern "C"
+#endif
+ESPEAK_API const espeak_STATS *espeak_GetStats(void);
+/* Reports counts and measurements of the library's performance.
+   The structure is valid until the next call of espeak_GetStats().
+   Later revisions may add fields at the end of it.
+*/
+
 #ifdef __cplusplus
 extern "C"
 #endif
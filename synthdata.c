@@ -31,6 +31,8 @@
 #include "voice.h"
 #include "translate.h"
 #include "wave.h"
+#include "databundle.h"
+#include "resample.h"
 
 const char *version_string = "1.48.03  04.Mar.14";
 const int version_phdata  = 0x014801;
@@ -49,11 +51,35 @@ USHORT *phoneme_index=NULL;
 char *phondata_ptr=NULL;
 unsigned char *wavefile_data=NULL;
 static unsigned char *phoneme_tab_data = NULL;
+static int phondata_samplerate = 22050;   // the sample rate of the sounds in phondata
+
+// Copies of the sounds in phondata, converted to samplerate_native when that is lower, set up by GetWavefile()
+#define N_WAVEFILE_COPY  2048    // a power of 2
+typedef struct {
+	int index;                   // position in phondata, 0 = empty slot
+	unsigned char *data;
+} WAVEFILE_COPY;
+static WAVEFILE_COPY wavefile_copy[N_WAVEFILE_COPY];
+static int n_wavefile_copy = 0;
+static int wavefile_copy_rate = 0;
+static void ClearWavefileCopies(void);
 
 int n_phoneme_tables;
 PHONEME_TAB_LIST phoneme_tab_list[N_PHONEME_TABS];
 int phoneme_tab_number = 0;
 
+// Hash tables of the phoneme mnemonics in phoneme_tab[], set up by SelectPhonemeTable()
+#define N_MNEM_HASH  512     // a power of 2, at least 2*N_PHONEME_TAB
+typedef struct {
+	unsigned int mnemonic;
+	short code;              // -1 = empty slot
+} MNEM_HASH;
+
+static MNEM_HASH mnem_hash_all[N_MNEM_HASH];     // for PhonemeCode(), all the phonemes
+static MNEM_HASH mnem_hash_valid[N_MNEM_HASH];   // for EncodePhonemes(), excluding phINVALID
+static int mnem_hash_table = -1;                 // the phoneme table for which they were made
+static void ClearMnemHash(void);
+
 int wavefile_ix;              // a wavefile to play along with the synthesis
 int wavefile_amp;
 int wavefile_ix2;
@@ -75,6 +101,16 @@ static char *ReadPhFile(void *ptr, const char *fname, int *size)
 	unsigned int  length;
 	char buf[sizeof(path_home)+40];
 
+	if((p = (char *)BundleLookup(fname,(int *)&length)) != NULL)
+	{
+		// use the data in place from the mapped bundle
+		if(ptr != NULL)
+			FreeData(ptr);
+		if(size != NULL)
+			*size = length;
+		return(p);
+	}
+
 	sprintf(buf,"%s%c%s",path_home,PATHSEP,fname);
 	length = GetFileLength(buf);
 
@@ -85,7 +121,7 @@ static char *ReadPhFile(void *ptr, const char *fname, int *size)
 	}
 
 	if(ptr != NULL)
-		Free(ptr);
+		FreeData(ptr);
 
 	if((p = Alloc(length)) == NULL)
 	{
@@ -163,6 +199,10 @@ int LoadPhData(int *srate)
 	if(phoneme_tab_number >= n_phoneme_tables)
 		phoneme_tab_number = 0;
 
+	ClearMnemHash();
+	ClearWavefileCopies();
+	phondata_samplerate = rate;
+
     if(srate != NULL)
         *srate = rate;
 	return(result);
@@ -171,10 +211,11 @@ int LoadPhData(int *srate)
 
 void FreePhData(void)
 {//==================
-	Free(phoneme_tab_data);
-	Free(phoneme_index);
-	Free(phondata_ptr);
-	Free(tunes);
+	FreeData(phoneme_tab_data);
+	FreeData(phoneme_index);
+	FreeData(phondata_ptr);
+	FreeData(tunes);
+	ClearWavefileCopies();
 	phoneme_tab_data=NULL;
 	phoneme_index=NULL;
 	phondata_ptr=NULL;
@@ -182,17 +223,246 @@ void FreePhData(void)
 }
 
 
-int PhonemeCode(unsigned int mnem)
-{//===============================
+static void ClearWavefileCopies(void)
+{//=================================
+	int ix;
+
+	for(ix=0; ix<N_WAVEFILE_COPY; ix++)
+	{
+		if(wavefile_copy[ix].index != 0)
+		{
+			free(wavefile_copy[ix].data);
+			wavefile_copy[ix].index = 0;
+		}
+	}
+	n_wavefile_copy = 0;
+}
+
+
+static unsigned char *ConvertWavefile(unsigned char *p)
+{//====================================================
+// Make a copy of a sound from phondata at samplerate_native. It has the same layout:
+// 2 bytes length (in bytes), 1 byte scale (0 = 16 bit samples), 1 byte, then the samples.
 	int ix;
+	int value;
+	int n_in;
+	int n_out;
+	int length;
+	int scale;
+	short *in;
+	short *out;
+	unsigned char *data;
+	RESAMPLER *rs;
+
+	length = p[0] + (p[1] << 8);
+	scale = p[2];
+	n_in = (scale == 0) ? length/2 : length;
+	n_out = ResampleLength(n_in, phondata_samplerate, samplerate_native);
+
+	in = (short *)malloc((n_in + n_out + 1) * sizeof(short));
+	data = (unsigned char *)malloc(4 + n_out*2);
+	if((in == NULL) || (data == NULL) || ((rs = ResampleCreate(phondata_samplerate, samplerate_native)) == NULL))
+	{
+		free(in);
+		free(data);
+		return(NULL);
+	}
+	out = &in[n_in];
+
+	for(ix=0; ix<n_in; ix++)
+	{
+		if(scale == 0)
+			value = p[4+ix*2] + ((signed char)p[5+ix*2] * 256);
+		else
+			value = (signed char)p[4+ix] * scale;
+		if(value > 32767)
+			value = 32767;
+		else
+		if(value < -32768)
+			value = -32768;
+		in[ix] = value;
+	}
+
+	ix = Resample(rs, in, n_in, out, n_out);
+	n_out = ix + ResampleFlush(rs, &out[ix], n_out - ix);
+	ResampleDelete(rs);
+
+	// keep the same sample size, so the length in bytes is no more than before
+	for(ix=0; ix<n_out; ix++)
+	{
+		value = out[ix];
+		if(scale == 0)
+		{
+			data[4+ix*2] = value & 0xff;
+			data[5+ix*2] = (value >> 8) & 0xff;
+		}
+		else
+		{
+			value = (value >= 0) ? (value + scale/2)/scale : (value - scale/2)/scale;
+			if(value > 127)
+				value = 127;
+			else
+			if(value < -128)
+				value = -128;
+			data[4+ix] = value & 0xff;
+		}
+	}
+	free(in);
+
+	length = (scale == 0) ? n_out*2 : n_out;
+	data[0] = length & 0xff;
+	data[1] = (length >> 8) & 0xff;
+	data[2] = scale;
+	data[3] = p[3];
+	return(data);
+}
+
+
+unsigned char *GetWavefile(int index)
+{//==================================
+// Returns the sound at 'index' in phondata.
+// If samplerate_native is lower than the rate of phondata, this is a copy which has been converted to samplerate_native.
+	int ix;
+	unsigned char *data;
+
+	if((samplerate_native >= phondata_samplerate) || (index == 0))
+		return(&wavefile_data[index]);
+
+	if(wavefile_copy_rate != samplerate_native)
+	{
+		ClearWavefileCopies();
+		wavefile_copy_rate = samplerate_native;
+	}
+
+	ix = (((unsigned int)index * 0x9e3779b1u) >> 16) & (N_WAVEFILE_COPY-1);
+	while(wavefile_copy[ix].index != 0)
+	{
+		if(wavefile_copy[ix].index == index)
+			return(wavefile_copy[ix].data);
+		ix = (ix + 1) & (N_WAVEFILE_COPY-1);
+	}
+
+	if((n_wavefile_copy >= (N_WAVEFILE_COPY*3)/4) || ((data = ConvertWavefile(&wavefile_data[index])) == NULL))
+		return(&wavefile_data[index]);   // play it unconverted
+
+	wavefile_copy[ix].index = index;
+	wavefile_copy[ix].data = data;
+	n_wavefile_copy++;
+	return(data);
+}
+
+
+static MNEM_HASH *LookupMnemHash(MNEM_HASH *table, unsigned int mnem)
+{//===================================================================
+// Returns the slot for this mnemonic, or the empty slot where it would go
+	int ix;
+
+	ix = ((mnem * 0x9e3779b1) >> 16) & (N_MNEM_HASH-1);
+	while((table[ix].code >= 0) && (table[ix].mnemonic != mnem))
+	{
+		ix = (ix + 1) & (N_MNEM_HASH-1);
+	}
+	return(&table[ix]);
+}
+
+
+static void AddMnemHash(MNEM_HASH *table, unsigned int mnem, int code)
+{//===================================================================
+	MNEM_HASH *h;
+
+	h = LookupMnemHash(table, mnem);
+	if(h->code < 0)
+	{
+		// keep the first phoneme with this mnemonic, as a search of phoneme_tab[] would find
+		h->mnemonic = mnem;
+		h->code = code;
+	}
+}
+
+
+static void ClearMnemHash(void)
+{//===========================
+	int ix;
+
+	for(ix=0; ix<N_MNEM_HASH; ix++)
+	{
+		mnem_hash_all[ix].code = -1;
+		mnem_hash_valid[ix].code = -1;
+	}
+	mnem_hash_table = -1;
+}
+
+
+static void SetUpMnemHash(int number)
+{//==================================
+	int ix;
+	int n;
+	unsigned int mnem;
+
+	if(number == mnem_hash_table)
+		return;   // phoneme_tab[] holds the same phonemes as when they were made
+
+	ClearMnemHash();
+	mnem_hash_table = number;
 
 	for(ix=0; ix<n_phoneme_tab; ix++)
 	{
 		if(phoneme_tab[ix] == NULL)
 			continue;
-		if(phoneme_tab[ix]->mnemonic == mnem)
-			return(phoneme_tab[ix]->code);
+		mnem = phoneme_tab[ix]->mnemonic;
+		AddMnemHash(mnem_hash_all, mnem, phoneme_tab[ix]->code);
+
+		if((ix > 0) && (phoneme_tab[ix]->type != phINVALID))
+		{
+			// EncodePhonemes() matches the mnemonic only as far as its first zero byte
+			for(n=0; (n<4) && (((mnem >> (n*8)) & 0xff) != 0); n++);
+			if(n < 4)
+				mnem &= (1 << (n*8)) - 1;
+			AddMnemHash(mnem_hash_valid, mnem, phoneme_tab[ix]->code);
+		}
+	}
+}
+
+
+int PhonemeCode(unsigned int mnem)
+{//===============================
+	MNEM_HASH *h;
+
+	h = LookupMnemHash(mnem_hash_all, mnem);
+	if(h->code < 0)
+		return(0);
+	return(h->code);
+}
+
+
+int MatchPhonemeMnemonic(const char *p, int *n_chars)
+{//==================================================
+// Find the phoneme with the longest mnemonic which matches the start of 'p'.
+// Returns the phoneme code, or 0 if none matches.  n_chars returns the length of the match.
+	int n;
+	int ix;
+	unsigned int c;
+	unsigned int mnem = 0;
+	unsigned int mnems[5];
+	MNEM_HASH *h;
+
+	mnems[0] = 0;
+	for(n=0; (n<4) && ((c = (unsigned char)p[n]) > ' '); n++)
+	{
+		mnem |= (c << (n*8));
+		mnems[n+1] = mnem;
+	}
+
+	for(ix=n; ix>=0; ix--)
+	{
+		h = LookupMnemHash(mnem_hash_valid, mnems[ix]);
+		if(h->code >= 0)
+		{
+			*n_chars = ix;
+			return(h->code);
+		}
 	}
+	*n_chars = 0;
 	return(0);
 }
 
@@ -421,6 +691,7 @@ void SelectPhonemeTable(int number)
 	SetUpPhonemeTable(number,0);  // recursively for included phoneme tables
 	n_phoneme_tab++;
 	current_phoneme_table = number;
+	SetUpMnemHash(number);
 }  //  end of SelectPhonemeTable
 
 
@@ -463,7 +734,7 @@ void LoadConfig(void)
 {//==================
 // Load configuration file, if one exists
 	char buf[sizeof(path_home)+10];
-	FILE *f;
+	DATA_FILE f;
 	int ix;
 	char c1;
 	char *p;
@@ -477,13 +748,12 @@ void LoadConfig(void)
 		soundicon_tab[ix].data = NULL;
 	}
 
-	sprintf(buf,"%s%c%s",path_home,PATHSEP,"config");
-	if((f = fopen(buf,"r"))==NULL)
+	if(DataOpen(&f,"config") != 0)
 	{
 		return;
 	}
 
-	while(fgets(buf,sizeof(buf),f)!=NULL)
+	while(DataGets(buf,sizeof(buf),&f)!=NULL)
 	{
 		if(buf[0] == '/')  continue;
 
@@ -516,7 +786,7 @@ void LoadConfig(void)
 			}
 		}
 	}
-	fclose(f);
+	DataClose(&f);
 }  //  end of LoadConfig
 
 
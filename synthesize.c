@@ -43,6 +43,8 @@ PHONEME_LIST phoneme_list[N_PHONEME_LIST+1];
 int mbrola_delay;
 char mbrola_name[20];
 
+const char *text_file_start = NULL;   // espeak_SynthFile(): the start of the file, for espeakEVENT_CLAUSE
+
 SPEED_FACTORS speed;
 
 static int  last_pitch_cmd;
@@ -260,7 +262,7 @@ static int DoSample2(int index, int which, int std_length, int control, int leng
 	unsigned char *p;
 
 	index = index & 0x7fffff;
-	p = &wavefile_data[index];
+	p = GetWavefile(index);
 	wav_scale = p[2];
 	wav_length = (p[1] * 256);
 	wav_length += p[0];    //  length in bytes
@@ -335,7 +337,7 @@ static int DoSample2(int index, int which, int std_length, int control, int leng
 
 	len4 = wav_length / 4;
 
-	index += 4;
+	p += 4;   // the samples
 
 	if(which & 0x100)
 	{
@@ -344,7 +346,7 @@ static int DoSample2(int index, int which, int std_length, int control, int leng
 		q = wcmdq[wcmdq_tail];
 		q[0] = WCMD_WAVE2;
 		q[1] = length | (wav_length << 16);   // length in samples
-		q[2] = (long64)(&wavefile_data[index]);
+		q[2] = (long64)p;
 		q[3] = wav_scale + (amp << 8);
 		WcmdqInc();
 		return(length);
@@ -365,7 +367,7 @@ static int DoSample2(int index, int which, int std_length, int control, int leng
 	q = wcmdq[wcmdq_tail];
 	q[0] = WCMD_WAVE;
 	q[1] = x;   // length in samples
-	q[2] = (long64)(&wavefile_data[index]);
+	q[2] = (long64)p;
 	q[3] = wav_scale + (amp << 8);
 	WcmdqInc();
 
@@ -380,7 +382,7 @@ static int DoSample2(int index, int which, int std_length, int control, int leng
 		q = wcmdq[wcmdq_tail];
 		q[0] = WCMD_WAVE;
 		q[1] = len4*2;   // length in samples
-		q[2] = (long64)(&wavefile_data[index+x]);
+		q[2] = (long64)(&p[x]);
 		q[3] = wav_scale + (amp << 8);
 		WcmdqInc();
 
@@ -396,7 +398,7 @@ static int DoSample2(int index, int which, int std_length, int control, int leng
 		q = wcmdq[wcmdq_tail];
 		q[0] = WCMD_WAVE;
 		q[1] = length;   // length in samples
-		q[2] = (long64)(&wavefile_data[index+x]);
+		q[2] = (long64)(&p[x]);
 		q[3] = wav_scale + (amp << 8);
 		WcmdqInc();
 	}
@@ -1217,6 +1219,9 @@ void DoMarker(int type, int char_posn, int length, int value)
 {//==========================================================
 // This could be used to return an index to the word currently being spoken
 // Type 1=word, 2=sentence, 3=named marker, 4=play audio, 5=end
+	if(option_no_events && (type != espeakEVENT_MARK) && (type != espeakEVENT_PLAY))
+		return;   // but the calling program must still be told of <mark> and <audio> elements
+
 	if(WcmdqFree() > 5)
 	{
 		wcmdq[wcmdq_tail][0] = WCMD_MARKER + (type << 8);
@@ -1397,7 +1402,7 @@ int Generate(PHONEME_LIST *phoneme_list, int *n_ph, int resume)
 		else
 			free_min = MIN_WCMDQ;  // 25
 
-		if(WcmdqFree() <= free_min)
+		if((WcmdqFree() <= free_min) || synth_stop_request)
 			return(1);  // wait
 
 		prev = &phoneme_list[ix-1];
@@ -1856,6 +1861,19 @@ int SynthStatus()
 
 
 
+static const void *p_text=NULL;   // the text which SpeakNextClause() is speaking, at the next clause
+
+
+const char *ClausePosition(void)
+{//=============================
+// Returns the position in the text of the clause which SpeakNextClause() will speak next,
+// or NULL if that isn't known, for a text which is not UTF8 or 8-bit in memory.
+	if((option_multibyte == espeakCHARS_WCHAR) || (option_multibyte == espeakCHARS_16BIT))
+		return(NULL);
+	return(InputPosition(p_text));
+}
+
+
 int SpeakNextClause(FILE *f_in, const void *text_in, int control)
 {//==============================================================
 // Speak text from file (f_in) or memory (text_in)
@@ -1872,8 +1890,8 @@ int SpeakNextClause(FILE *f_in, const void *text_in, int control)
 	int clause_tone;
 	char *voice_change;
 	static FILE *f_text=NULL;
-	static const void *p_text=NULL;
 	const char *phon_out;
+	const char *clause_start;
 
 	if(control == 4)
 	{
@@ -1955,6 +1973,9 @@ int SpeakNextClause(FILE *f_in, const void *text_in, int control)
 
 	// read the next clause from the input text file, translate it, and generate
 	// entries in the wavegen command queue
+	clause_start = NULL;
+	if(text_file_start != NULL)
+		clause_start = InputPosition(p_text);
 	p_text = TranslateClause(translator, f_text, p_text, &clause_tone, &voice_change);
 
 	CalcPitches(translator, clause_tone);
@@ -1984,6 +2005,12 @@ int SpeakNextClause(FILE *f_in, const void *text_in, int control)
 		return(1);
 	}
 
+	if((text_file_start != NULL) && (clause_start != NULL))
+	{
+		// report the clause's position in the file, so that speaking can be resumed from here
+		DoMarker(espeakEVENT_CLAUSE, clause_start_char, 0, clause_start - text_file_start);
+	}
+
 	Generate(phoneme_list,&n_phoneme_list,0);
 	WavegenOpenSound();
 
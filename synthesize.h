@@ -364,6 +364,7 @@ typedef struct {
 typedef struct {
 	int name;
 	int length;
+	int rate;         // the sample rate which data has been converted to
 	char *data;
 	char *filename;
 } SOUND_ICON;
@@ -477,6 +478,7 @@ extern unsigned char pitch_adjust_tab[MAX_PITCH_VALUE+1];
 extern long64 wcmdq[N_WCMDQ][4];
 extern int wcmdq_head;
 extern int wcmdq_tail;
+extern volatile int synth_stop_request;
 
 // from Wavegen file
 int  WcmdqFree();
@@ -486,6 +488,7 @@ void WcmdqInc();
 int  WavegenOpenSound();
 int  WavegenCloseSound();
 int  WavegenInitSound();
+void WavegenWaitSound(int timeout);
 void WavegenInit(int rate, int wavemult_fact);
 float polint(float xa[],float ya[],int n,float x);
 int WavegenFill(int fill_zeros);
@@ -493,6 +496,7 @@ void MarkerEvent(int type, unsigned int char_position, int value, int value2, un
 
 
 extern unsigned char *wavefile_data;
+unsigned char *GetWavefile(int index);
 extern int samplerate;
 extern int samplerate_native;
 
@@ -524,6 +528,8 @@ int  Generate(PHONEME_LIST *phoneme_list, int *n_ph, int resume);
 void MakeWave2(PHONEME_LIST *p, int n_ph);
 int  SynthOnTimer(void);
 int  SpeakNextClause(FILE *f_text, const void *text_in, int control);
+const char *ClausePosition(void);
+extern const char *text_file_start;
 int  SynthStatus(void);
 void SetSpeed(int control);
 void SetEmbedded(int control, int value);
@@ -0,0 +1,137 @@
+/* Checks that the Bloom filter of a _dict file never changes the pronunciation of a word.
+
+   It compiles en_dict, which then has a Bloom filter, and translates each word of en_list,
+   and some inflected forms of it, with the filter and again without it.
+
+   usage: bloom_test <directory which contains espeak-data> <dictsource directory>
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "speak_lib.h"
+#include "speech.h"
+#include "phoneme.h"
+#include "synthesize.h"
+#include "translate.h"
+
+#define N_WORD_MAX  40
+
+static const char *suffixes[] = {"", "s", "es", "ed", "d", "ing", "er", "ly", NULL};
+
+
+static char **ReadWords(const char *dictsource, int *n_words) {
+    // the words of en_list, and their inflected forms
+    FILE *f;
+    char fname[200];
+    char line[200];
+    char word[N_WORD_MAX];
+    char **words = NULL;
+    int n = 0;
+    int max = 0;
+    int ix;
+
+    sprintf(fname, "%sen_list", dictsource);
+    if ((f = fopen(fname, "r")) == NULL)
+        return (NULL);
+
+    while (fgets(line, sizeof(line), f) != NULL) {
+        if (sscanf(line, "%30[a-z]", word) != 1)
+            continue;
+        if ((line[strlen(word)] != ' ') && (line[strlen(word)] != '\t'))
+            continue;   // not a plain word
+
+        for (ix = 0; suffixes[ix] != NULL; ix++) {
+            if (n == max) {
+                max = (max == 0) ? 1024 : max * 2;
+                if ((words = (char **) realloc(words, max * sizeof(char *))) == NULL)
+                    return (NULL);
+            }
+            if ((words[n] = (char *) malloc(N_WORD_MAX)) == NULL)
+                return (NULL);
+            sprintf(words[n++], "%s%s", word, suffixes[ix]);
+        }
+    }
+    fclose(f);
+    *n_words = n;
+    return (words);
+}
+
+
+static char **Translate(char **words, int n_words) {
+    // the phonemes of each word
+    char **phonemes;
+    const void *text;
+    const char *ph;
+    int ix;
+
+    if ((phonemes = (char **) malloc(n_words * sizeof(char *))) == NULL)
+        return (NULL);
+    for (ix = 0; ix < n_words; ix++) {
+        text = words[ix];
+        ph = espeak_TextToPhonemes(&text, espeakCHARS_AUTO, 0);
+        if ((phonemes[ix] = strdup((ph == NULL) ? "" : ph)) == NULL)
+            return (NULL);
+    }
+    return (phonemes);
+}
+
+
+int main(int argc, char **argv) {
+    char dictsource[200];
+    char **words;
+    char **with_filter;
+    char **without_filter;
+    unsigned char *bloom;
+    FILE *log;
+    int n_words = 0;
+    int n_differ = 0;
+    int ix;
+
+    if (argc < 3) {
+        fprintf(stderr, "usage: bloom_test <directory which contains espeak-data> <dictsource directory>\n");
+        return (2);
+    }
+    sprintf(dictsource, "%s%c", argv[2], PATHSEP);
+
+    if (espeak_Initialize(AUDIO_OUTPUT_SYNCHRONOUS, 0, argv[1], espeakINITIALIZE_DONT_EXIT) < 0) {
+        fprintf(stderr, "can't initialize from %s\n", argv[1]);
+        return (1);
+    }
+    espeak_SetVoiceByName("en");
+
+    // compile en_dict, with its Bloom filter, and load it
+    log = tmpfile();
+    espeak_CompileDictionary(dictsource, log, 0);
+    if (log != NULL)
+        fclose(log);
+    if ((LoadDictionary(translator, "en", 0) != 0) || (translator->dict_bloom == NULL)) {
+        fprintf(stderr, "en_dict was not compiled with a Bloom filter\n");
+        return (1);
+    }
+
+    if ((words = ReadWords(dictsource, &n_words)) == NULL) {
+        fprintf(stderr, "can't read %sen_list\n", dictsource);
+        return (1);
+    }
+
+    with_filter = Translate(words, n_words);
+    bloom = translator->dict_bloom;
+    translator->dict_bloom = NULL;
+    without_filter = Translate(words, n_words);
+    translator->dict_bloom = bloom;
+    if ((with_filter == NULL) || (without_filter == NULL))
+        return (1);
+
+    for (ix = 0; ix < n_words; ix++) {
+        if (strcmp(with_filter[ix], without_filter[ix]) != 0) {
+            if (n_differ++ < 20)
+                printf("%s: [%s] with the filter, [%s] without\n", words[ix], with_filter[ix], without_filter[ix]);
+        }
+    }
+    printf("%d words, %d differ\n", n_words, n_differ);
+
+    espeak_Terminate();
+    return (n_differ == 0) ? 0 : 1;
+}
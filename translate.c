@@ -44,6 +44,7 @@ int option_tone2 = 0;
 int option_tone_flags = 0;   // bit 8=emphasize allcaps, bit 9=emphasize penultimate stress
 int option_phonemes = 0;
 int option_phoneme_events = 0;
+int option_no_events = 0;    // don't make events for words, sentences, marks etc.
 int option_quiet = 0;
 int option_endpause = 0;  // suppress pause after end of text
 int option_capitals = 0;
@@ -381,6 +382,9 @@ int IsAlpha(unsigned int c)
 		0
 	};
 
+	if(HaveCharProps(c))
+		return((CharProps(c)->flags & CHP_ISALPHA) != 0);
+
 	if(iswalpha2(c))
 		return(1);
 
@@ -439,6 +443,9 @@ int IsDigit09(unsigned int c)
 
 int IsDigit(unsigned int c)
 {//========================
+	if(HaveCharProps(c))
+		return((CharProps(c)->flags & CHP_DIGIT) != 0);
+
 	if(iswdigit(c))
 		return(1);
 
@@ -452,6 +459,8 @@ int IsSpace(unsigned int c)
 {//========================
 	if(c == 0)
 		return(0);
+	if(HaveCharProps(c))
+		return((CharProps(c)->flags & CHP_SPACE) != 0);
 	if((c >= 0x2500) && (c < 0x25a0))
 		return(1);  // box drawing characters
 	if((c >= 0xfff9) && (c <= 0xffff))
@@ -464,8 +473,7 @@ int IsSpace(unsigned int c)
 
 void DeleteTranslator(Translator *tr)
 {//==================================
-	if(tr->data_dictlist != NULL)
-		Free(tr->data_dictlist);
+	ReleaseDictionary(tr);
 	Free(tr);
 }
 
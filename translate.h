@@ -31,6 +31,8 @@
 
 #define N_RULE_GROUP2    120          // max num of two-letter rule chains
 #define N_HASH_DICT     1024
+#define DICT_BLOOM_K      6           // number of hash functions in a dictionary's Bloom filter
+#define DICT_BLOOM_BITS  12           // bits per word in the Bloom filter
 #define N_CHARSETS        20
 #define N_LETTER_GROUPS   95          // maximum is 127-32
 
@@ -626,7 +628,10 @@ typedef struct
 
 	char *data_dictrules;     // language_1   translation rules file
 	char *data_dictlist;      // language_2   dictionary lookup file
+	int data_dictsize;        // size of the _dict file
 	char *dict_hashtab[N_HASH_DICT];   // hash table to index dictionary lookup file
+	unsigned char *dict_bloom;         // Bloom filter of the words in the lookup file, or NULL
+	unsigned int dict_bloom_mask;      // number of bits in dict_bloom, minus 1
 	char *letterGroups[N_LETTER_GROUPS];
 
 	// groups1 and groups2 are indexes into data_dictrules, set up by InitGroups()
@@ -671,6 +676,7 @@ extern int option_quiet;
 extern int option_phonemes;
 extern int option_mbrola_phonemes;
 extern int option_phoneme_events;
+extern int option_no_events;
 extern int option_linelength;     // treat lines shorter than this as end-of-clause
 extern int option_multibyte;
 extern int option_capitals;
@@ -685,6 +691,7 @@ extern int option_wordgap;
 extern int count_characters;
 extern int count_words;
 extern int count_sentences;
+extern int new_sentence;
 extern int skip_characters;
 extern int skip_words;
 extern int skip_sentences;
@@ -722,22 +729,45 @@ int TransposeAlphabet(Translator *tr, char *text);
 int utf8_in(int *c, const char *buf);
 int utf8_in2(int *c, const char *buf, int backwards);
 int utf8_out(unsigned int c, char *buf);
+// Properties of the characters U+0080 to U+FFFF, made by InitCharProperties().
+// Indexed by the top 8 bits of the character code, then the bottom 8 bits.
+#define CHP_ALPHA     0x01   // iswalpha2()
+#define CHP_ISALPHA   0x02   // IsAlpha()
+#define CHP_UPPER     0x04   // iswupper2()
+#define CHP_LOWER     0x08   // iswlower2()
+#define CHP_DIGIT     0x10   // IsDigit()
+#define CHP_SPACE     0x20   // IsSpace()
+#define CHP_CASE      0x40   // 'lower' and 'upper' are valid
+typedef struct {
+	unsigned char flags;
+	short lower;     // towlower2(c) - c
+	short upper;     // towupper2(c) - c
+} CHAR_PROPS;
+
+extern CHAR_PROPS *char_props[256];
+#define HaveCharProps(c)  ((((unsigned int)(c) - 0x80) < 0xff80) && (char_props[(c) >> 8] != NULL))
+#define CharProps(c)      (&char_props[(c) >> 8][(c) & 0xff])
+
 int utf8_nbytes(const char *buf);
 int lookupwchar(const unsigned short *list,int c);
 int lookupwchar2(const unsigned short *list,int c);
 int Eof(void);
+const char *InputPosition(const void *p_input);
 char *strchr_w(const char *s, int c);
 int IsBracket(int c);
 void InitNamedata(void);
+int AddNameData(const char *name, int wide);
 void InitText(int flags);
 void InitText2(void);
 int IsDigit(unsigned int c);
 int IsDigit09(unsigned int c);
+int IsSpace(unsigned int c);
 int IsAlpha(unsigned int c);
 int IsVowel(Translator *tr, int c);
 int IsSuperscript(int letter);
 int iswalpha2(int c);
 int isspace2(unsigned int c);
+void InitCharProperties(void);
 int iswlower2(int c);
 int iswupper2(int c);
 int towlower2(unsigned int c);
@@ -763,7 +793,12 @@ int TranslateLetter(Translator *tr, char *letter, char *phonemes, int control);
 void LookupLetter(Translator *tr, unsigned int letter, int next_byte, char *ph_buf, int control);
 void LookupAccentedLetter(Translator *tr, unsigned int letter, char *ph_buf);
 
+#define N_RESIDENT_DICT  40
 int LoadDictionary(Translator *tr, const char *name, int no_error);
+int PinDictionary(Translator *tr);
+void UnpinDictionary(const char *name);
+const char *ResidentDictionary(int ix, int *size);
+void ReleaseDictionary(Translator *tr);
 int LookupDictList(Translator *tr, char **wordptr, char *ph_out, unsigned int *flags, int end_flags, WORD_TAB *wtab);
 
 void MakePhonemeList(Translator *tr, int post_pause, int new_sentence);
@@ -782,6 +817,18 @@ int TranslateWord(Translator *tr, char *word1, int next_pause, WORD_TAB *wtab, c
 void *TranslateClause(Translator *tr, FILE *f_text, const void *vp_input, int *tone, char **voice_change);
 int ReadClause(Translator *tr, FILE *f_in, char *buf, short *charix, int *charix_top, int n_buf, int *tone_type, char *voice_change);
 
+#define N_SEGMENT_TAGS  8
+// A part of the text which can be spoken separately, found by FindSegments()
+typedef struct {
+	int offset;        // byte offset in the text
+	int char_offset;   // character offset in the text
+	int n_tags;        // SSML tags of the elements which are open at the start of the segment
+	int tag_offset[N_SEGMENT_TAGS];
+	int tag_length[N_SEGMENT_TAGS];
+} TEXT_SEGMENT;
+int FindSegments(const char *text, int length, int flags, int min_length, TEXT_SEGMENT *segments, int n_segments);
+int SegmentAt(const char *text, int offset, int flags, TEXT_SEGMENT *seg);
+
 void SetVoiceStack(espeak_VOICE *v, const char *variant_name);
 void InterpretPhoneme(Translator *tr, int control, PHONEME_LIST *plist, PHONEME_DATA *phdata, WORD_PH_DATA *worddata);
 void InterpretPhoneme2(int phcode, PHONEME_DATA *phdata);
@@ -39,6 +39,7 @@
 #include "synthesize.h"
 #include "voice.h"
 #include "translate.h"
+#include "databundle.h"
 
 
 MNEM_TAB genders [] = {
@@ -66,6 +67,9 @@ static espeak_VOICE *voices_list[N_VOICES_LIST];
 static int len_path_voices;
 
 espeak_VOICE current_voice_selected;
+static char voice_identifier[40];  // file name for  current_voice_selected
+static char voice_name[40];        // voice name for current_voice_selected
+static char voice_languages[100];  // list of languages and priorities for current_voice_selected
 
 
 enum {
@@ -191,14 +195,25 @@ const char *variant_lists[3] = {variants_either, variants_male, variants_female}
 static voice_t voicedata;
 voice_t *voice = &voicedata;
 
+// Voice files which are kept in memory by espeak_Preload()
+#define N_RESIDENT_VOICES  40
+typedef struct {
+	char name[40];     // the name which was given to LoadVoice()
+	const char *data;
+	int size;
+} RESIDENT_VOICE;
 
-static char *fgets_strip(char *buf, int size, FILE *f_in)
-{//======================================================
+static RESIDENT_VOICE resident_voices[N_RESIDENT_VOICES];
+static int n_resident_voices = 0;
+
+
+static char *fgets_strip(char *buf, int size, DATA_FILE *f_in)
+{//===========================================================
 // strip trailing spaces, and truncate lines at // comment
 	int len;
 	char *p;
 
-	if(fgets(buf,size,f_in) == NULL)
+	if(DataGets(buf,size,f_in) == NULL)
 		return(NULL);
 
 	if(buf[0] == '#')
@@ -218,6 +233,56 @@ static char *fgets_strip(char *buf, int size, FILE *f_in)
 }
 
 
+static int OpenResidentVoice(DATA_FILE *df, const char *name)
+{//==========================================================
+// Read a voice file from memory, if it was preloaded
+	int ix;
+
+	for(ix=0; ix<n_resident_voices; ix++)
+	{
+		if(strcmp(name, resident_voices[ix].name) == 0)
+		{
+			df->f = NULL;
+			df->p = resident_voices[ix].data;
+			df->end = df->p + resident_voices[ix].size;
+			return(0);
+		}
+	}
+	return(-1);
+}
+
+
+static void PinVoice(DATA_FILE *df, const char *name)
+{//==================================================
+// Keep the contents of a voice file which has just been opened.  Further reading is from the memory copy.
+	int size;
+	char *data;
+	RESIDENT_VOICE *rv;
+
+	if(n_resident_voices >= N_RESIDENT_VOICES)
+		return;
+
+	if(df->f != NULL)
+	{
+		fseek(df->f,0,SEEK_END);
+		size = ftell(df->f);
+		fseek(df->f,0,SEEK_SET);
+		if((data = Alloc(size)) == NULL)
+			return;
+		size = fread(data,1,size,df->f);
+		fclose(df->f);
+		df->f = NULL;
+		df->p = data;
+		df->end = data + size;
+	}
+
+	rv = &resident_voices[n_resident_voices++];
+	strncpy0(rv->name, name, sizeof(rv->name));
+	rv->data = df->p;
+	rv->size = df->end - df->p;
+}
+
+
 static int LookupTune(const char *name)
 {//====================================
 	int ix;
@@ -288,8 +353,8 @@ void ReadTonePoints(char *string, int *tone_pts)
 
 
 
-static espeak_VOICE *ReadVoiceFile(FILE *f_in, const char *fname, const char*leafname)
-{//===================================================================================
+static espeak_VOICE *ReadVoiceFile(DATA_FILE *f_in, const char *fname, const char*leafname)
+{//========================================================================================
 // Read a Voice file, allocate a VOICE_DATA and set data from the
 // file's  language, gender, name  lines
 
@@ -560,8 +625,10 @@ voice_t *LoadVoice(const char *vname, int control)
 //          bit 1  1 = change tone only, not language
 //          bit 2  1 = don't report error on LoadDictionary
 //          bit 4  1 = vname = full path
+//          bit 5  1 = preload, keep the voice file and its dictionary resident
 
-	FILE *f_voice = NULL;
+	DATA_FILE f_voice;
+	int  voice_found;
 	char *p;
 	int  key;
 	int  ix;
@@ -588,7 +655,6 @@ voice_t *LoadVoice(const char *vname, int control)
 	char option_name[40];
 	const char *language_type;
 	char buf[sizeof(path_home)+30];
-	char path_voices[sizeof(path_home)+12];
 
 	int dict_min = 0;
 	int stress_amps[8];
@@ -602,10 +668,6 @@ voice_t *LoadVoice(const char *vname, int control)
 	int pitch1;
 	int pitch2;
 
-	static char voice_identifier[40];  // file name for  current_voice_selected
-	static char voice_name[40];        // voice name for current_voice_selected
-	static char voice_languages[100];  // list of languages and priorities for current_voice_selected
-
 	// which directory to look for a named voice. List of voice names, must end in a space.
 	static const char *voices_asia =
 		"az bn fa fa-pin hi hy hy-west id ka kn ku ml ms ne pa ta te tr vi vi-hue vi-sgn zh zh-yue ";
@@ -619,16 +681,24 @@ voice_t *LoadVoice(const char *vname, int control)
 		strcpy(buf,vname);
 		if(GetFileLength(buf) <= 0)
 			return(NULL);
+
+		f_voice.p = NULL;
+		f_voice.f = fopen(buf,"r");
+		voice_found = (f_voice.f != NULL);
 	}
 	else
 	{
 		if(voicename[0]==0)
 			strcpy(voicename,"default");
 
-		sprintf(path_voices,"%s%cvoices%c",path_home,PATHSEP,PATHSEP);
-		sprintf(buf,"%s%s",path_voices,voicename);  // first, look in the main voices directory
+		// names are relative to espeak-data, so that they can also be found in the data bundle
+		sprintf(buf,"voices%c%s",PATHSEP,voicename);  // first, look in the main voices directory
 
-		if(GetFileLength(buf) <= 0)
+		if(OpenResidentVoice(&f_voice,voicename) == 0)
+		{
+			buf[0] = 0;  // preloaded, no need to look for the file
+		}
+		else if(DataFileLength(buf) <= 0)
 		{
 			// then look in the appropriate subdirectory
 			if((voicename[0]=='m') && (voicename[1]=='b'))
@@ -645,21 +715,28 @@ voice_t *LoadVoice(const char *vname, int control)
 				else
 					voice_dir = "other";
 
-				sprintf(buf,"%s%s%c%s", path_voices,voice_dir,PATHSEP,voicename);
+				sprintf(buf,"voices%c%s%c%s",PATHSEP,voice_dir,PATHSEP,voicename);
 
-				if(GetFileLength(buf) <= 0)
+				if(DataFileLength(buf) <= 0)
 				{
 					// if not found, look in "test" sub-directory
-					sprintf(buf,"%stest%c%s",path_voices,PATHSEP,voicename);
+					sprintf(buf,"voices%ctest%c%s",PATHSEP,PATHSEP,voicename);
 				}
 			}
 		}
-	}
 
-	f_voice = fopen(buf,"r");
+		if(buf[0] == 0)
+		{
+			voice_found = 1;
+		}
+		else if((voice_found = (DataOpen(&f_voice,buf) == 0)) && (control & 0x20))
+		{
+			PinVoice(&f_voice,voicename);
+		}
+	}
 
 	language_type = "en";    // default
-	if(f_voice == NULL)
+	if(!voice_found)
 	{
 		if(control & 3)
 			return(NULL);  // can't open file
@@ -705,7 +782,7 @@ voice_t *LoadVoice(const char *vname, int control)
 		SelectPhonemeTableName(phonemes_name);  // set up phoneme_tab
 
 
-	while((f_voice != NULL) && (fgets_strip(buf,sizeof(buf),f_voice) != NULL))
+	while(voice_found && (fgets_strip(buf,sizeof(buf),&f_voice) != NULL))
 	{
 		// isolate the attribute name
 		for(p=buf; (*p != 0) && !isspace(*p); p++);
@@ -1063,8 +1140,8 @@ voice_t *LoadVoice(const char *vname, int control)
 			break;
 		}
 	}
-	if(f_voice != NULL)
-		fclose(f_voice);
+	if(voice_found)
+		DataClose(&f_voice);
 
 	if((new_translator == NULL) && (!tone_only))
 	{
@@ -1099,6 +1176,9 @@ voice_t *LoadVoice(const char *vname, int control)
 		if(dictionary_name[0]==0)
 			return(NULL);   // no dictionary loaded
 
+		if(control & 0x20)
+			PinDictionary(new_translator);
+
 		new_translator->dict_condition = conditional_rules;
 
 		voice_languages[langix] = 0;
@@ -1413,8 +1493,8 @@ static int SetVoiceScores(espeak_VOICE *voice_select, espeak_VOICE **voices, int
 			lang_len = 2;
 		}
 
-		sprintf(buf, "%s/voices/%s", path_home, language);
-		if(GetFileLength(buf) == -2)
+		sprintf(buf, "voices/%s", language);
+		if(DataFileLength(buf) == -2)
 		{
 			// A subdirectory name has been specified.  List all the voices in that subdirectory
 			language[lang_len++] = PATHSEP;
@@ -1670,7 +1750,7 @@ char const *SelectVoice(espeak_VOICE *voice_select, int *found)
 
 static void GetVoices(const char *path)
 {//====================================
-	FILE *f_voice;
+	DATA_FILE f_voice;
 	espeak_VOICE *voice_data;
 	int ftype;
 	char fname[sizeof(path_home)+100];
@@ -1711,12 +1791,12 @@ static void GetVoices(const char *path)
 		else
 		{
 			// a regular line, add it to the voices list
-			if((f_voice = fopen(fname,"r")) == NULL)
+			if((f_voice.f = fopen(fname,"r")) == NULL)
 				continue;
 
 			// pass voice file name within the voices directory
-			voice_data = ReadVoiceFile(f_voice, fname+len_path_voices, &buf[20]);
-			fclose(f_voice);
+			voice_data = ReadVoiceFile(&f_voice, fname+len_path_voices, &buf[20]);
+			DataClose(&f_voice);
 
 			if(voice_data != NULL)
 			{
@@ -1752,12 +1832,12 @@ static void GetVoices(const char *path)
 			else if(ftype > 0)
 			{
 				// a regular line, add it to the voices list
-				if((f_voice = fopen(fname,"r")) == NULL)
+				if((f_voice.f = fopen(fname,"r")) == NULL)
 					continue;
 
 				// pass voice file name within the voices directory
-				voice_data = ReadVoiceFile(f_voice, fname+len_path_voices, FindFileData.cFileName);
-				fclose(f_voice);
+				voice_data = ReadVoiceFile(&f_voice, fname+len_path_voices, FindFileData.cFileName);
+				DataClose(&f_voice);
 
 				if(voice_data != NULL)
 				{
@@ -1795,12 +1875,12 @@ static void GetVoices(const char *path)
 		else if(ftype > 0)
 		{
 			// a regular line, add it to the voices list
-			if((f_voice = fopen(fname,"r")) == NULL)
+			if((f_voice.f = fopen(fname,"r")) == NULL)
 				continue;
 
 			// pass voice file name within the voices directory
-			voice_data = ReadVoiceFile(f_voice, fname+len_path_voices, ent->d_name);
-			fclose(f_voice);
+			voice_data = ReadVoiceFile(&f_voice, fname+len_path_voices, ent->d_name);
+			DataClose(&f_voice);
 
 			if(voice_data != NULL)
 			{
@@ -1814,6 +1894,67 @@ static void GetVoices(const char *path)
 }   // end of GetVoices
 
 
+static void GetBundleVoices(void)
+{//==============================
+// Add the voice files which are in the data bundle to the voices list.
+	int ix;
+	int size;
+	const char *name;
+	const char *leafname;
+	DATA_FILE f_voice;
+	espeak_VOICE *voice_data;
+
+	for(ix=0; (name = BundleEntry(ix, &size)) != NULL; ix++)
+	{
+		if(n_voices_list >= (N_VOICES_LIST-2))
+			break;   // voices list is full
+
+		if((memcmp(name,"voices/",7) != 0) || (size <= 0))
+			continue;
+
+		if((leafname = strrchr(name,'/')) == NULL)
+			continue;
+		leafname++;
+
+		if(DataOpen(&f_voice, name) != 0)
+			continue;
+
+		// pass voice file name within the voices directory
+		voice_data = ReadVoiceFile(&f_voice, &name[7], leafname);
+		DataClose(&f_voice);
+
+		if(voice_data != NULL)
+		{
+			voices_list[n_voices_list++] = voice_data;
+		}
+	}
+}   // end of GetBundleVoices
+
+
+static void RemoveDuplicateVoices(int n_first)
+{//===========================================
+// Remove the voices after the first n_first which have the identifier of one of those
+	int ix;
+	int j;
+
+	for(ix=n_first; ix<n_voices_list; )
+	{
+		for(j=0; j<n_first; j++)
+		{
+			if(strcmp(voices_list[ix]->identifier, voices_list[j]->identifier) == 0)
+				break;
+		}
+		if(j < n_first)
+		{
+			free(voices_list[ix]);
+			voices_list[ix] = voices_list[--n_voices_list];
+		}
+		else
+			ix++;
+	}
+}   // end of RemoveDuplicateVoices
+
+
 
 espeak_ERROR SetVoiceByName(const char *name)
 {//=========================================
@@ -1908,6 +2049,41 @@ void FreeVoiceList()
 }
 
 
+static int PreloadVoice(const char *name)
+{//=======================================
+// Load a voice and keep its voice file and dictionary resident.
+// 'name' may be a voice file name or a voice name, with an optional variant.
+	int ix;
+	espeak_VOICE *v;
+	char *variant_name;
+	char buf[60];
+
+	strncpy0(buf,name,sizeof(buf));
+	variant_name = ExtractVoiceVariantName(buf, 0, 1);
+
+	for(ix=0; ; ix++)
+	{
+		// convert voice name to lower case  (ascii)
+		if((buf[ix] = tolower(buf[ix])) == 0)
+			break;
+	}
+
+	if(LoadVoice(buf,0x21) == NULL)
+	{
+		if(n_voices_list == 0)
+			espeak_ListVoices(NULL);   // create the voices list
+
+		if(((v = SelectVoiceByName(voices_list,buf)) == NULL) || (LoadVoice(v->identifier,0x20) == NULL))
+			return(-1);
+	}
+
+	if(variant_name[0] != 0)
+		LoadVoice(variant_name,0x22);
+	return(0);
+}
+
+
+
 //=======================================================================
 //  Library Interface Functions
 //=======================================================================
@@ -1943,7 +2119,11 @@ ESPEAK_API const espeak_VOICE **espeak_ListVoices(espeak_VOICE *voice_spec)
 	sprintf(path_voices,"%s%cvoices",path_home,PATHSEP);
 	len_path_voices = strlen(path_voices)+1;
 
+	// the voices in the data bundle, and the installed voices which the bundle doesn't replace
+	GetBundleVoices();
+	ix = n_voices_list;
 	GetVoices(path_voices);
+	RemoveDuplicateVoices(ix);
 	voices_list[n_voices_list] = NULL;  // voices list terminator
 	voices = (espeak_VOICE **)realloc(voices, sizeof(espeak_VOICE *)*(n_voices_list+1));
 
@@ -1982,6 +2162,85 @@ ESPEAK_API espeak_VOICE *espeak_GetCurrentVoice(void)
 	return(&current_voice_selected);
 }
 
+
+ESPEAK_API int espeak_Preload(const char **voices, int n)
+{//======================================================
+	int ix;
+	int count = 0;
+	int have_voice;
+	voice_t saved_voice;
+	espeak_VOICE saved_selected;
+	char saved_identifier[sizeof(voice_identifier)];
+	char saved_name[sizeof(voice_name)];
+	char saved_languages[sizeof(voice_languages)];
+
+	// loading the voices changes the current voice, so keep the selection and its parameters
+	if((have_voice = ((translator != NULL) && (current_voice_selected.identifier != NULL))) != 0)
+	{
+		memcpy(&saved_voice, voice, sizeof(saved_voice));
+		memcpy(&saved_selected, &current_voice_selected, sizeof(saved_selected));
+		memcpy(saved_identifier, voice_identifier, sizeof(saved_identifier));
+		memcpy(saved_name, voice_name, sizeof(saved_name));
+		memcpy(saved_languages, voice_languages, sizeof(saved_languages));
+	}
+
+	for(ix=0; ix<n; ix++)
+	{
+		if((voices[ix] != NULL) && (PreloadVoice(voices[ix]) == 0))
+			count++;
+	}
+
+	if(have_voice)
+	{
+		// load the translator, dictionary and phoneme table of the voice and its variant again,
+		// then restore exactly what was selected, as it may have been changed since the voice was loaded
+		LoadVoiceVariant(saved_identifier, 0);
+		memcpy(voice, &saved_voice, sizeof(saved_voice));
+		SelectPhonemeTable(voice->phoneme_tab_ix);
+		memcpy(&current_voice_selected, &saved_selected, sizeof(current_voice_selected));
+		memcpy(voice_identifier, saved_identifier, sizeof(voice_identifier));
+		memcpy(voice_name, saved_name, sizeof(voice_name));
+		memcpy(voice_languages, saved_languages, sizeof(voice_languages));
+	}
+	else
+	{
+		if(translator != NULL)
+			DeleteTranslator(translator);
+		translator = NULL;
+		memset(&current_voice_selected,0,sizeof(current_voice_selected));
+	}
+	return(count);
+}
+
+
+ESPEAK_API const espeak_PRELOADED *espeak_ListPreloaded(void)
+{//=========================================================
+	int ix;
+	int n = 0;
+	int size;
+	const char *name;
+	static espeak_PRELOADED list[N_RESIDENT_VOICES + N_RESIDENT_DICT + 1];
+
+	for(ix=0; ix<n_resident_voices; ix++)
+	{
+		list[n].name = resident_voices[ix].name;
+		list[n].type = 1;
+		list[n++].size = resident_voices[ix].size;
+	}
+
+	for(ix=0; (name = ResidentDictionary(ix, &size)) != NULL; ix++)
+	{
+		if(name[0] == 0)
+			continue;   // replaced by a recompiled dictionary
+		list[n].name = name;
+		list[n].type = 2;
+		list[n++].size = size;
+	}
+
+	list[n].name = NULL;
+	return(list);
+}
+
 #ifdef __GNUC__
 #pragma GCC visibility pop
 #endif // __GNUC__
@@ -14,6 +14,9 @@ extern void* wave_open(const char* the_api);
 extern size_t wave_write(void* theHandler, char* theMono16BitsWaveBuffer, size_t theSize);
 extern int wave_close(void* theHandler);
 extern void wave_flush(void* theHandler);
+// Stop the sound at once, for espeak_Cancel(): the stream plays silence, and
+// wave_write() writes nothing, until wave_close() is called.
+extern void wave_abort(void* theHandler);
 extern int wave_is_busy(void* theHandler);
 extern void wave_terminate();
 extern uint32_t wave_get_read_position(void* theHandler);
@@ -27,15 +30,43 @@ extern uint32_t wave_get_write_position(void* theHandler);
 // return 0 if ok or -1 otherwise (stream not opened).
 extern int wave_get_remaining_time(uint32_t sample, uint32_t* time);
 
+// Supply the time, on the monotonic clock (clock_gettime_mono), at which the
+// sample reaches the output of the audio device, or has reached it.
+// sample: sample identifier
+// the_time: supplied value
+//
+// return 0 if ok, 1 if the time is not yet known because the stream is not
+// playing (it's not yet started, or it's waiting for more sound),
+// or -1 if the stream is not opened.
+extern int wave_get_sample_time(uint32_t sample, struct timespec* the_time);
+
+// Supply the number of times that the audio device ran out of sound while more
+// was to come (underruns), and that wave_write had to wait for space in the
+// buffer (overruns).
+extern void wave_get_xruns(uint32_t* underruns, uint32_t* overruns);
+
+// Wait until the stream has played the last sample which it has been given,
+// or until the_end (NULL = no time limit).
+//
+// return 0 if the stream is idle, or 1 if it is still playing at the_end.
+extern int wave_wait_idle(void* theHandler, const struct timespec* the_end);
+
 // set the callback which informs if the output is still enabled.
 // Helpful if a new sample is waiting for free space whereas sound must be stopped.
 typedef int (t_wave_callback)(void);
 extern void wave_set_callback_is_output_enabled(t_wave_callback* cb);
 
 
+// For AUDIO_OUTPUT_SYNCH_PLAYBACK: the sound output signals that it wants more sound,
+// or has finished playing, and the synthesis thread waits for the signal (or timeout ms).
+extern void wave_signal_sound_wanted();
+extern void wave_wait_sound_wanted(int timeout);
+
 // general functions
 extern void clock_gettime2(struct timespec *ts);
+extern void clock_gettime_mono(struct timespec *ts);
 extern void add_time_in_ms(struct timespec *ts, int time_in_ms);
+extern int time_is_before(const struct timespec *ts, const struct timespec *the_end);
 
 // for tests
 extern void *wave_test_get_write_buffer();
@@ -37,6 +37,10 @@
 #include "sonic.h"
 #endif
 
+#ifdef USE_ASYNC
+#include "wave.h"
+#endif
+
 #ifdef USE_PORTAUDIO
 #include "portaudio.h"
 #undef USE_PORTAUDIO
@@ -133,6 +137,10 @@ long64 wcmdq[N_WCMDQ][4];
 int wcmdq_head=0;
 int wcmdq_tail=0;
 
+// set by espeak_Cancel() while the synthesis is stopped, so that Generate() and
+// WavegenFill() return at once instead of finishing the clause or the buffer
+volatile int synth_stop_request = 0;
+
 // pitch,speed,
 int embedded_default[N_EMBEDDED_VALUES]        = {0,    50,175,100,50, 0, 0, 0,175,0,0,0,0,0,0};
 static int embedded_max[N_EMBEDDED_VALUES]     = {0,0x7fff,750,300,99,99,99, 0,750,0,0,0,0,4,0};
@@ -426,6 +434,25 @@ static void WavegenInitPkData(int which)
 
 
 
+#ifdef USE_ASYNC
+static void SoundWanted()
+{//======================
+// Wake the synthesis thread, which waits in WavegenWaitSound(): the sound output
+// has used all the sound which has been generated, or it has finished playing.
+	wave_signal_sound_wanted();
+}
+#endif
+
+
+void WavegenWaitSound(int timeout)
+{//===============================
+// Wait until the sound output wants more sound or has finished, or for timeout mS
+#ifdef USE_ASYNC
+	wave_wait_sound_wanted(timeout);
+#endif
+}
+
+
 #ifdef USE_PORTAUDIO
 // PortAudio interface
 
@@ -479,6 +506,10 @@ static int WaveCallback(const void *inputBuffer, void *outputBuffer,
 #endif
 
 	result = WavegenFill(1);
+#ifdef USE_ASYNC
+	if(result)
+		SoundWanted();   // the queue of sound commands is empty
+#endif
 
 	// copy from the outbut buffer into the portaudio buffer
 	if(result && (out_ptr > out_end2))
@@ -568,6 +599,15 @@ static int WaveCallback(const void *inputBuffer, void *outputBuffer,
 }  //  end of WaveCallBack
 
 
+#if (USE_PORTAUDIO == 19) && defined(USE_ASYNC)
+static void WaveFinishedCallback(void *userData)
+{//=============================================
+// The stream has become inactive, after playing its last buffer, so it can be closed
+	SoundWanted();
+}
+#endif
+
+
 #if USE_PORTAUDIO == 19
 /* This is a fixed version of Pa_OpenDefaultStream() for use if the version in portaudio V19
    is broken */
@@ -652,6 +692,10 @@ int WavegenOpenSound()
 			out_channels=2;
 			err2 = Pa_OpenDefaultStream(&pa_stream,0,2,paInt16,(double)samplerate,512,WaveCallback,(void *)userdata);
 		}
+#ifdef USE_ASYNC
+		if(err2 == paNoError)
+			Pa_SetStreamFinishedCallback(pa_stream, WaveFinishedCallback);
+#endif
 #endif
 	}
 	err = Pa_StartStream(pa_stream);
@@ -1875,6 +1919,9 @@ int WavegenFill2(int fill_zeros)
 
 	while(out_ptr < out_end)
 	{
+		if(synth_stop_request)
+			return(0);
+
 		if(WcmdqUsed() <= 0)
 		{
 			if(echo_complete > 0)
@@ -2021,7 +2068,7 @@ static int SpeedUp(short *outbuf, int length_in, int length_out, int end_of_text
 	{
 		if(sonicSpeedupStream == NULL)
 		{
-			sonicSpeedupStream = sonicCreateStream(22050, 1);
+			sonicSpeedupStream = sonicCreateStream(samplerate, 1);
 		}
 		if(sonicGetSpeed(sonicSpeedupStream) != sonicSpeed)
 		{